@@ -33,6 +33,10 @@
 #define HAVE_SOCKET 1
 #define HAVE_SOCKLEN_T 1
 #define HAVE_IN_ADDR_T 1
+#ifndef __ANDROID__
+/* Define to 1 if you have the `fmemopen' function. */
+#define HAVE_FMEMOPEN 1
+#endif
 #endif
 
 #if defined(N3DS)
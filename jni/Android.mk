@@ -6,6 +6,7 @@ COMMONFLAGS :=
 INCFLAGS    :=
 
 EMUTYPE     ?= x64
+HAVE_THREADS := 1
 
 include $(CORE_DIR)/Makefile.common
 
@@ -16,6 +17,7 @@ COREFLAGS := -DCORE_NAME=\"$(EMUTYPE)\" \
   $(INCFLAGS) $(COMMONFLAGS) \
   -DHAVE_INET_ATON \
   -DHAVE_7ZIP -D_7ZIP_ST \
+  -DHAVE_THREADS \
   -D_INTTYPES_H
 
 GIT_VERSION := " $(shell git rev-parse --short HEAD || echo unknown)"
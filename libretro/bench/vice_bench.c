@@ -0,0 +1,1068 @@
+/* Headless benchmark frontend for the VICE libretro cores.
+ *
+ * Loads any vice_<emu>_libretro.so, runs a fixed number of retro_run()
+ * frames with null video and audio, and reports frames per second, the
+ * time per frame percentiles and the peak RSS. Without content the canned
+ * workloads fitting the core are run, each in its own process, so that
+ * the numbers stay comparable from one commit to the next.
+ *
+ * Build with `make bench`, then for example:
+ *    ./vice_bench vice_x64_libretro.so
+ *    ./vice_bench -w tde -s 100 vice_x64sc_libretro.so
+ *    ./vice_bench -f 5000 -x -o vice_sid_engine=FastSID vice_x64_libretro.so game.d64
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <ftw.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "libretro.h"
+
+#define MAX_OPTIONS        1024
+#define MAX_USER_OPTIONS   64
+#define DEFAULT_FRAMES     3000
+#define WARP_KEY           RETROK_F15
+#define WARP_KEY_NAME      "RETROK_F15"
+
+/*** Workloads ***/
+
+typedef struct
+{
+   uint8_t *data;
+   size_t size;
+   size_t max;
+} buffer_t;
+
+typedef bool (*workload_build_t)(const char *machine, buffer_t *out);
+
+typedef struct
+{
+   const char *name;
+   const char *description;
+   const char *machines;      /* Space separated EMUTYPEs */
+   const char *extension;
+   workload_build_t build;
+   const char *options;       /* Semicolon separated key=value */
+   unsigned frames;
+   unsigned warmup;           /* Frames excluded from the statistics */
+} workload_t;
+
+static void buffer_put(buffer_t *b, uint8_t value)
+{
+   if (b->size == b->max)
+   {
+      b->max  = b->max ? b->max * 2 : 256;
+      b->data = (uint8_t *)realloc(b->data, b->max);
+      if (!b->data)
+      {
+         fprintf(stderr, "Out of memory\n");
+         exit(1);
+      }
+   }
+   b->data[b->size++] = value;
+}
+
+static void buffer_put_word(buffer_t *b, unsigned value)
+{
+   buffer_put(b, value & 0xff);
+   buffer_put(b, (value >> 8) & 0xff);
+}
+
+/* Start of BASIC text, which is also the load address of the programs */
+static unsigned basic_start(const char *machine)
+{
+   if (!strcmp(machine, "x128"))
+      return 0x1c01;
+   if (!strcmp(machine, "xvic") || !strcmp(machine, "xplus4"))
+      return 0x1001;
+   if (!strcmp(machine, "xpet"))
+      return 0x0401;
+   return 0x0801;
+}
+
+/* BASIC V2 tokens, same on every machine used here */
+#define TOKEN_GOTO   0x89
+#define TOKEN_PRINT  0x99
+#define TOKEN_POKE   0x97
+#define TOKEN_SYS    0x9e
+#define TOKEN_PLUS   0xaa
+#define TOKEN_AND    0xaf
+#define TOKEN_EQUAL  0xb2
+
+/* Tokenized lines, each given as line number and body */
+static void basic_program(buffer_t *b, unsigned start, const unsigned *numbers,
+      const char **lines, const size_t *lengths, unsigned count)
+{
+   unsigned addr = start;
+   unsigned i;
+   size_t j;
+
+   buffer_put_word(b, start);
+   for (i = 0; i < count; i++)
+   {
+      addr += 2 + 2 + (unsigned)lengths[i] + 1;
+      buffer_put_word(b, addr);
+      buffer_put_word(b, numbers[i]);
+      for (j = 0; j < lengths[i]; j++)
+         buffer_put(b, (uint8_t)lines[i][j]);
+      buffer_put(b, 0);
+   }
+   buffer_put_word(b, 0);
+}
+
+/* 10 A=A+1:POKE53280,AAND15:GOTO10 */
+static bool build_basic_loop(const char *machine, buffer_t *out)
+{
+   static const char line[] = {
+      'A', TOKEN_EQUAL, 'A', TOKEN_PLUS, '1', ':',
+      TOKEN_POKE, '5', '3', '2', '8', '0', ',', 'A', TOKEN_AND, '1', '5', ':',
+      TOKEN_GOTO, '1', '0'
+   };
+   const char *lines[]   = { line };
+   size_t lengths[]      = { sizeof(line) };
+   unsigned numbers[]    = { 10 };
+
+   basic_program(out, basic_start(machine), numbers, lines, lengths, 1);
+   return true;
+}
+
+/* 10 PRINT"VICE BENCHMARK 80 COLUMNS ";:GOTO10 */
+static bool build_vdc_text(const char *machine, buffer_t *out)
+{
+   static const char line[] = {
+      TOKEN_PRINT, '"', 'V', 'I', 'C', 'E', ' ', 'B', 'E', 'N', 'C', 'H', 'M', 'A', 'R', 'K',
+      ' ', '8', '0', ' ', 'C', 'O', 'L', 'U', 'M', 'N', 'S', ' ', '"', ';', ':',
+      TOKEN_GOTO, '1', '0'
+   };
+   const char *lines[]   = { line };
+   size_t lengths[]      = { sizeof(line) };
+   unsigned numbers[]    = { 10 };
+
+   basic_program(out, basic_start(machine), numbers, lines, lengths, 1);
+   return true;
+}
+
+/* 6502 code emitted after a SYS line, using relative branches only */
+static void emit_sid_writes(buffer_t *b, unsigned base, const uint8_t *regs, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i += 2)
+   {
+      buffer_put(b, 0xa9);                   /* LDA #value */
+      buffer_put(b, regs[i + 1]);
+      buffer_put(b, 0x8d);                   /* STA base + reg */
+      buffer_put_word(b, base + regs[i]);
+   }
+}
+
+/* Sweeps three voices and the filter of two SIDs, at $D400 and $D420 */
+static bool build_sid_tune(const char *machine, buffer_t *out)
+{
+   static const uint8_t init[] = {
+      0x05, 0x09, 0x06, 0xf0, 0x04, 0x21,    /* Voice 1 sawtooth */
+      0x0c, 0x19, 0x0d, 0xf0, 0x0a, 0x08,
+      0x0b, 0x41,                            /* Voice 2 pulse */
+      0x13, 0x2a, 0x14, 0xf0, 0x12, 0x11,    /* Voice 3 triangle */
+      0x17, 0xf7, 0x18, 0x1f                 /* Resonance, lowpass, volume */
+   };
+   static const uint8_t sweep[][3] = {
+      { 0xee, 0x01, 0 }, { 0xee, 0x08, 0 }, { 0xce, 0x0f, 0 }, { 0xee, 0x16, 0 },
+      { 0xce, 0x01, 1 }, { 0xee, 0x08, 1 }, { 0xee, 0x0f, 1 }, { 0xce, 0x16, 1 },
+   };
+   char line[7];
+   const char *lines[]   = { line };
+   size_t lengths[]      = { 6 };
+   unsigned numbers[]    = { 10 };
+   unsigned start        = basic_start(machine);
+   size_t loop;
+   unsigned i;
+
+   /* SYS to the code following the BASIC text: line header, body, end
+    * of line and end of program */
+   line[0] = (char)TOKEN_SYS;
+   snprintf(line + 1, sizeof(line) - 1, "%05u", start + 2 + 2 + 6 + 1 + 2);
+   basic_program(out, start, numbers, lines, lengths, 1);
+
+   emit_sid_writes(out, 0xd400, init, sizeof(init));
+   emit_sid_writes(out, 0xd420, init, sizeof(init));
+
+   loop = out->size;
+   for (i = 0; i < sizeof(sweep) / sizeof(sweep[0]); i++)
+   {
+      buffer_put(out, sweep[i][0]);          /* INC/DEC register */
+      buffer_put_word(out, (sweep[i][2] ? 0xd420 : 0xd400) + sweep[i][1]);
+   }
+   buffer_put(out, 0xa0);                    /* LDY #0 */
+   buffer_put(out, 0x00);
+   buffer_put(out, 0x88);                    /* DEY */
+   buffer_put(out, 0xd0);                    /* BNE DEY */
+   buffer_put(out, 0xfd);
+   buffer_put(out, 0xb8);                    /* CLV */
+   buffer_put(out, 0x50);                    /* BVC loop */
+   buffer_put(out, (uint8_t)(loop - (out->size + 1)));
+   return true;
+}
+
+/* D64 holding the BASIC loop padded to FILE_BLOCKS blocks, loaded with
+ * true drive emulation from a 1541 interleave of 10 */
+#define D64_TRACKS      35
+#define D64_SIZE        174848
+#define D64_DIR_TRACK   18
+#define D64_INTERLEAVE  10
+#define FILE_BLOCKS     40
+
+static unsigned d64_sectors(unsigned track)
+{
+   if (track <= 17)
+      return 21;
+   if (track <= 24)
+      return 19;
+   if (track <= 30)
+      return 18;
+   return 17;
+}
+
+static uint8_t *d64_sector(uint8_t *image, unsigned track, unsigned sector)
+{
+   unsigned offset = 0;
+   unsigned t;
+
+   for (t = 1; t < track; t++)
+      offset += d64_sectors(t);
+   return image + (offset + sector) * 256;
+}
+
+static void d64_allocate(uint8_t *image, unsigned track, unsigned sector)
+{
+   uint8_t *entry = d64_sector(image, D64_DIR_TRACK, 0) + 4 * track;
+
+   entry[0]--;
+   entry[1 + sector / 8] &= ~(1 << (sector % 8));
+}
+
+static bool d64_free(uint8_t *image, unsigned track, unsigned sector)
+{
+   return d64_sector(image, D64_DIR_TRACK, 0)[4 * track + 1 + sector / 8] & (1 << (sector % 8));
+}
+
+/* Interleaved sector after the given one, or the first free one of the
+ * next track when the track is full */
+static void d64_next(uint8_t *image, unsigned *track, unsigned *sector)
+{
+   unsigned t = *track;
+   unsigned s = (*sector + D64_INTERLEAVE) % d64_sectors(t);
+
+   while (!d64_sector(image, D64_DIR_TRACK, 0)[4 * t])
+   {
+      t += (t + 1 == D64_DIR_TRACK) ? 2 : 1;
+      s  = 0;
+   }
+   while (!d64_free(image, t, s))
+      s = (s + 1) % d64_sectors(t);
+
+   *track  = t;
+   *sector = s;
+}
+
+static void d64_pad_name(uint8_t *dst, const char *name, size_t size)
+{
+   memset(dst, 0xa0, size);
+   memcpy(dst, name, strlen(name));
+}
+
+static bool build_tde_disk(const char *machine, buffer_t *out)
+{
+   buffer_t prg = {0};
+   uint8_t *image;
+   uint8_t *bam;
+   uint8_t *dir;
+   size_t pos = 0;
+   unsigned track = 1, sector = 0, blocks = 0;
+   unsigned t, s;
+
+   /* Program with payload after the end of the BASIC text */
+   build_basic_loop(machine, &prg);
+   while (prg.size < FILE_BLOCKS * 254)
+      buffer_put(&prg, (uint8_t)(prg.size * 7));
+
+   image = (uint8_t *)calloc(1, D64_SIZE);
+   if (!image)
+      return false;
+
+   bam = d64_sector(image, D64_DIR_TRACK, 0);
+   bam[0] = D64_DIR_TRACK;
+   bam[1] = 1;
+   bam[2] = 0x41;
+   for (t = 1; t <= D64_TRACKS; t++)
+   {
+      bam[4 * t] = d64_sectors(t);
+      for (s = 0; s < d64_sectors(t); s++)
+         bam[4 * t + 1 + s / 8] |= 1 << (s % 8);
+   }
+   d64_pad_name(bam + 0x90, "VICE BENCH", 16);
+   memset(bam + 0xa0, 0xa0, 11);
+   memcpy(bam + 0xa2, "VB", 2);
+   memcpy(bam + 0xa5, "2A", 2);
+   d64_allocate(image, D64_DIR_TRACK, 0);
+   d64_allocate(image, D64_DIR_TRACK, 1);
+
+   dir = d64_sector(image, D64_DIR_TRACK, 1);
+   dir[0] = 0;
+   dir[1] = 0xff;
+   dir[2] = 0x82;
+   dir[3] = track;
+   dir[4] = sector;
+   d64_pad_name(dir + 5, "BENCH", 16);
+
+   while (pos < prg.size)
+   {
+      uint8_t *data = d64_sector(image, track, sector);
+      size_t chunk  = prg.size - pos < 254 ? prg.size - pos : 254;
+
+      memcpy(data + 2, prg.data + pos, chunk);
+      d64_allocate(image, track, sector);
+      pos += chunk;
+      blocks++;
+
+      if (pos < prg.size)
+      {
+         d64_next(image, &track, &sector);
+         data[0] = track;
+         data[1] = sector;
+      }
+      else
+      {
+         data[0] = 0;
+         data[1] = (uint8_t)(chunk + 1);
+      }
+   }
+   dir[30] = blocks & 0xff;
+   dir[31] = blocks >> 8;
+
+   free(prg.data);
+   out->data = image;
+   out->size = out->max = D64_SIZE;
+   return true;
+}
+
+static const workload_t workloads[] = {
+   {
+      "basic", "BASIC loop poking the border colour",
+      "x64 x64sc x64dtv x128 xscpu64 xvic xplus4 xpet", "prg",
+      build_basic_loop, "", 3000, 300
+   },
+   {
+      "sid", "Filter and voice sweeps on two ReSID chips",
+      "x64 x64sc x128 xscpu64", "prg",
+      build_sid_tune, "vice_sid_engine=ReSID;vice_sid_extra=0xd420", 3000, 300
+   },
+   {
+      "tde", "Disk load through the 1541 with true drive emulation",
+      "x64 x64sc x128 xscpu64", "d64",
+      build_tde_disk, "vice_drive_true_emulation=enabled;vice_autoloadwarp=disabled", 1500, 0
+   },
+   {
+      "vdc", "Text printed on the 80 column VDC display",
+      "x128", "prg",
+      build_vdc_text, "vice_c128_video_output=VDC", 3000, 300
+   },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static bool workload_fits(const workload_t *w, const char *machine)
+{
+   const char *p   = w->machines;
+   size_t len      = strlen(machine);
+
+   while ((p = strstr(p, machine)))
+   {
+      if ((p == w->machines || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+         return true;
+      p += len;
+   }
+   return false;
+}
+
+/*** Frontend ***/
+
+typedef struct
+{
+   char key[64];
+   char value[128];
+} option_t;
+
+static struct
+{
+   void *handle;
+   void (*init)(void);
+   void (*deinit)(void);
+   void (*set_environment)(retro_environment_t);
+   void (*set_video_refresh)(retro_video_refresh_t);
+   void (*set_audio_sample)(retro_audio_sample_t);
+   void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+   void (*set_input_poll)(retro_input_poll_t);
+   void (*set_input_state)(retro_input_state_t);
+   void (*get_system_av_info)(struct retro_system_av_info *);
+   bool (*load_game)(const struct retro_game_info *);
+   void (*unload_game)(void);
+   void (*run)(void);
+   size_t (*serialize_size)(void);
+   bool (*serialize)(void *, size_t);
+   bool (*unserialize)(const void *, size_t);
+} core;
+
+static option_t options[MAX_OPTIONS];
+static unsigned num_options;
+static option_t user_options[MAX_USER_OPTIONS];
+static unsigned num_user_options;
+static char system_dir[256];
+static bool verbose;
+static FILE *report;
+static FILE *errors;
+static bool warp;
+
+static struct retro_perf_counter *perf_counters[64];
+static unsigned num_perf_counters;
+
+static void core_log(enum retro_log_level level, const char *fmt, ...)
+{
+   va_list ap;
+
+   if (!verbose)
+      return;
+   va_start(ap, fmt);
+   vfprintf(errors, fmt, ap);
+   va_end(ap);
+}
+
+static retro_time_t perf_get_time_usec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (retro_time_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static retro_perf_tick_t perf_get_counter(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (retro_perf_tick_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t perf_get_cpu_features(void)
+{
+   return 0;
+}
+
+static void perf_register(struct retro_perf_counter *counter)
+{
+   if (counter->registered || num_perf_counters == sizeof(perf_counters) / sizeof(perf_counters[0]))
+      return;
+   counter->registered = true;
+   perf_counters[num_perf_counters++] = counter;
+}
+
+static void perf_start(struct retro_perf_counter *counter)
+{
+   counter->start = perf_get_counter();
+}
+
+static void perf_stop(struct retro_perf_counter *counter)
+{
+   counter->total += perf_get_counter() - counter->start;
+   counter->call_cnt++;
+}
+
+static void perf_log(void)
+{
+}
+
+static const option_t *user_option_find(const char *key)
+{
+   unsigned i;
+
+   for (i = 0; i < num_user_options; i++)
+      if (!strcmp(user_options[i].key, key))
+         return &user_options[i];
+   return NULL;
+}
+
+/* Core option value, user given ones first */
+static const char *option_get(const char *key)
+{
+   const option_t *user = user_option_find(key);
+   unsigned i;
+
+   if (user)
+      return user->value;
+   for (i = 0; i < num_options; i++)
+      if (!strcmp(options[i].key, key))
+         return options[i].value;
+   return NULL;
+}
+
+static bool option_add(option_t *list, unsigned *count, unsigned max, const char *key, const char *value)
+{
+   unsigned i;
+
+   for (i = 0; i < *count; i++)
+      if (!strcmp(list[i].key, key))
+         break;
+   if (i == max)
+      return false;
+   snprintf(list[i].key, sizeof(list[i].key), "%s", key);
+   snprintf(list[i].value, sizeof(list[i].value), "%s", value);
+   if (i == *count)
+      (*count)++;
+   return true;
+}
+
+/* Semicolon separated key=value pairs */
+static bool option_parse(const char *pairs)
+{
+   char buf[1024];
+   char *token;
+
+   snprintf(buf, sizeof(buf), "%s", pairs);
+   for (token = strtok(buf, ";"); token; token = strtok(NULL, ";"))
+   {
+      char *eq = strchr(token, '=');
+
+      if (!eq)
+         return false;
+      *eq = '\0';
+      if (!option_add(user_options, &num_user_options, MAX_USER_OPTIONS, token, eq + 1))
+         return false;
+   }
+   return true;
+}
+
+static bool environment(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+         ((struct retro_log_callback *)data)->log = core_log;
+         return true;
+      case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+         *(const char **)data = system_dir;
+         return true;
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         return true;
+      case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+      {
+         struct retro_perf_callback *perf = (struct retro_perf_callback *)data;
+
+         perf->get_time_usec    = perf_get_time_usec;
+         perf->get_cpu_features = perf_get_cpu_features;
+         perf->get_perf_counter = perf_get_counter;
+         perf->perf_register    = perf_register;
+         perf->perf_start       = perf_start;
+         perf->perf_stop        = perf_stop;
+         perf->perf_log         = perf_log;
+         return true;
+      }
+      case RETRO_ENVIRONMENT_SET_VARIABLES:
+      {
+         /* "Description; default|other|..." */
+         const struct retro_variable *var = (const struct retro_variable *)data;
+
+         for (; var->key; var++)
+         {
+            const char *value;
+            char buf[128];
+            size_t len;
+
+            if (!var->value || !(value = strchr(var->value, ';')))
+               continue;
+            for (value++; *value == ' '; value++);
+            len = strcspn(value, "|");
+            if (len >= sizeof(buf))
+               len = sizeof(buf) - 1;
+            memcpy(buf, value, len);
+            buf[len] = '\0';
+            option_add(options, &num_options, MAX_OPTIONS, var->key, buf);
+         }
+         return true;
+      }
+      case RETRO_ENVIRONMENT_GET_VARIABLE:
+      {
+         struct retro_variable *var = (struct retro_variable *)data;
+
+         var->value = option_get(var->key);
+         return var->value != NULL;
+      }
+      case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+         *(bool *)data = false;
+         return true;
+      default:
+         return false;
+   }
+}
+
+static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+}
+
+static void audio_sample(int16_t left, int16_t right)
+{
+}
+
+static size_t audio_sample_batch(const int16_t *data, size_t frames)
+{
+   return frames;
+}
+
+static void input_poll(void)
+{
+}
+
+/* Warp is held with its hotkey for the whole run */
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   return (warp && port == 0 && device == RETRO_DEVICE_KEYBOARD && id == WARP_KEY);
+}
+
+static bool core_open(const char *path)
+{
+   core.handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+   if (!core.handle)
+   {
+      fprintf(errors, "Cannot load core: %s\n", dlerror());
+      return false;
+   }
+
+#define CORE_SYMBOL(name) \
+   if (!(*(void **)&core.name = dlsym(core.handle, "retro_" #name))) \
+   { \
+      fprintf(errors, "Core has no retro_%s\n", #name); \
+      return false; \
+   }
+   CORE_SYMBOL(init);
+   CORE_SYMBOL(deinit);
+   CORE_SYMBOL(set_environment);
+   CORE_SYMBOL(set_video_refresh);
+   CORE_SYMBOL(set_audio_sample);
+   CORE_SYMBOL(set_audio_sample_batch);
+   CORE_SYMBOL(set_input_poll);
+   CORE_SYMBOL(set_input_state);
+   CORE_SYMBOL(get_system_av_info);
+   CORE_SYMBOL(load_game);
+   CORE_SYMBOL(unload_game);
+   CORE_SYMBOL(run);
+   CORE_SYMBOL(serialize_size);
+   CORE_SYMBOL(serialize);
+   CORE_SYMBOL(unserialize);
+#undef CORE_SYMBOL
+   return true;
+}
+
+/* EMUTYPE from the vice_<emu>_libretro file name */
+static bool core_machine(const char *path, char *machine, size_t size)
+{
+   const char *name = strrchr(path, '/');
+   const char *end;
+
+   name = name ? name + 1 : path;
+   if (strncmp(name, "vice_", 5) || !(end = strstr(name, "_libretro")))
+      return false;
+   name += 5;
+   if ((size_t)(end - name) >= size)
+      return false;
+   memcpy(machine, name, end - name);
+   machine[end - name] = '\0';
+   return true;
+}
+
+/*** Measurement ***/
+
+typedef struct
+{
+   unsigned frames;
+   unsigned warmup;
+   unsigned serialize_loops;
+} run_config_t;
+
+static int compare_ticks(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a;
+   uint64_t y = *(const uint64_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+static double percentile_usec(const uint64_t *sorted, unsigned count, unsigned percent)
+{
+   unsigned index = (unsigned)(((uint64_t)count * percent + 99) / 100);
+
+   if (!count)
+      return 0;
+   if (index)
+      index--;
+   if (index >= count)
+      index = count - 1;
+   return sorted[index] / 1000.0;
+}
+
+static void report_ticks(const char *label, uint64_t *ticks, unsigned count)
+{
+   qsort(ticks, count, sizeof(ticks[0]), compare_ticks);
+   fprintf(report, "  %-12s p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f us\n", label,
+         percentile_usec(ticks, count, 50), percentile_usec(ticks, count, 90),
+         percentile_usec(ticks, count, 99), percentile_usec(ticks, count, 100));
+}
+
+static void serialize_loop(unsigned loops)
+{
+   size_t size    = core.serialize_size();
+   void *state    = malloc(size);
+   uint64_t *save = (uint64_t *)calloc(loops, sizeof(uint64_t));
+   uint64_t *load = (uint64_t *)calloc(loops, sizeof(uint64_t));
+   unsigned i;
+
+   if (!size || !state || !save || !load)
+   {
+      fprintf(report, "  serialize    unavailable\n");
+      goto end;
+   }
+
+   for (i = 0; i < loops; i++)
+   {
+      uint64_t start = perf_get_counter();
+
+      if (!core.serialize(state, size))
+      {
+         fprintf(report, "  serialize    failed\n");
+         goto end;
+      }
+      save[i] = perf_get_counter() - start;
+
+      start = perf_get_counter();
+      if (!core.unserialize(state, size))
+      {
+         fprintf(report, "  unserialize  failed\n");
+         goto end;
+      }
+      load[i] = perf_get_counter() - start;
+   }
+
+   fprintf(report, "  state        %zu bytes, %u loops\n", size, loops);
+   report_ticks("serialize", save, loops);
+   report_ticks("unserialize", load, loops);
+
+end:
+   free(state);
+   free(save);
+   free(load);
+}
+
+/* Runs in the child process, one core instance per process */
+static int run_content(const char *core_path, const char *content, const run_config_t *config)
+{
+   struct retro_system_av_info av = {{0}};
+   struct retro_game_info game    = {0};
+   uint64_t *ticks;
+   uint64_t total = 0;
+   unsigned measured;
+   unsigned i;
+
+   /* Results and warnings go to the original streams, other core
+    * output only with the log */
+   if (!(report = fdopen(dup(STDOUT_FILENO), "w")) || !(errors = fdopen(dup(STDERR_FILENO), "w")))
+      return 1;
+   setvbuf(errors, NULL, _IONBF, 0);
+   if (!verbose)
+   {
+      freopen("/dev/null", "w", stdout);
+      freopen("/dev/null", "w", stderr);
+   }
+
+   if (!core_open(core_path))
+      return 1;
+
+   if (warp)
+      option_add(user_options, &num_user_options, MAX_USER_OPTIONS, "vice_mapper_warp_mode", WARP_KEY_NAME);
+
+   core.set_environment(environment);
+   core.set_video_refresh(video_refresh);
+   core.set_audio_sample(audio_sample);
+   core.set_audio_sample_batch(audio_sample_batch);
+   core.set_input_poll(input_poll);
+   core.set_input_state(input_state);
+   core.init();
+
+   game.path = content;
+   if (!core.load_game(&game))
+   {
+      fprintf(errors, "Cannot load content '%s'\n", content ? content : "");
+      return 1;
+   }
+   core.get_system_av_info(&av);
+
+   measured = config->frames > config->warmup ? config->frames - config->warmup : 0;
+   ticks    = (uint64_t *)calloc(measured ? measured : 1, sizeof(uint64_t));
+   if (!ticks)
+      return 1;
+
+   for (i = 0; i < config->frames; i++)
+   {
+      uint64_t start = perf_get_counter();
+
+      core.run();
+      if (i >= config->warmup)
+      {
+         ticks[i - config->warmup] = perf_get_counter() - start;
+         total += ticks[i - config->warmup];
+      }
+   }
+
+   if (measured)
+   {
+      double seconds = total / 1e9;
+
+      fprintf(report, "  frames       %u measured after %u, %.1f fps, %.2fx realtime\n",
+            measured, config->warmup, measured / seconds,
+            av.timing.fps > 0 ? measured / seconds / av.timing.fps : 0);
+      report_ticks("frame", ticks, measured);
+   }
+   free(ticks);
+
+   if (config->serialize_loops)
+      serialize_loop(config->serialize_loops);
+
+   for (i = 0; i < num_perf_counters; i++)
+      if (perf_counters[i]->call_cnt)
+         fprintf(report, "  counter      %-24s %10llu calls %10.3f ms\n", perf_counters[i]->ident,
+               (unsigned long long)perf_counters[i]->call_cnt, perf_counters[i]->total / 1e6);
+
+   fflush(report);
+
+   /* No retro_deinit(), the process exits right away */
+   core.unload_game();
+   return 0;
+}
+
+static int run_forked(const char *core_path, const char *content, const run_config_t *config)
+{
+   struct rusage usage;
+   int status = 0;
+   pid_t pid;
+
+   fflush(stdout);
+   pid = fork();
+   if (pid < 0)
+   {
+      perror("fork");
+      return 1;
+   }
+   if (pid == 0)
+      _exit(run_content(core_path, content, config));
+
+   if (wait4(pid, &status, 0, &usage) < 0)
+   {
+      perror("wait4");
+      return 1;
+   }
+   if (!WIFEXITED(status) || WEXITSTATUS(status))
+   {
+      fprintf(report, "  failed\n");
+      return 1;
+   }
+   fprintf(report, "  peak rss     %.1f MiB\n", usage.ru_maxrss / 1024.0);
+   return 0;
+}
+
+static bool write_file(const char *path, const buffer_t *b)
+{
+   FILE *file = fopen(path, "wb");
+   bool ok;
+
+   if (!file)
+      return false;
+   ok = fwrite(b->data, 1, b->size, file) == b->size;
+   return !fclose(file) && ok;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+   return remove(path);
+}
+
+static void usage(const char *name)
+{
+   unsigned i;
+
+   fprintf(stderr,
+         "Usage: %s [options] <vice_<emu>_libretro.so> [content]\n"
+         "\n"
+         "Without content, the canned workloads fitting the core are run.\n"
+         "\n"
+         "  -w name        Run only this workload\n"
+         "  -f frames      Frames to run (default: per workload, %u with content)\n"
+         "  -W frames      Frames excluded from the statistics\n"
+         "  -x             Warp mode\n"
+         "  -s loops       Serialize and unserialize after the run\n"
+         "  -o key=value   Core option, repeatable\n"
+         "  -d dir         System and save directory (default: temporary)\n"
+         "  -v             Core log\n"
+         "\n"
+         "Workloads:\n", name, DEFAULT_FRAMES);
+   for (i = 0; i < NUM_WORKLOADS; i++)
+      fprintf(stderr, "  %-8s %-52s %s\n", workloads[i].name, workloads[i].description, workloads[i].machines);
+}
+
+int main(int argc, char **argv)
+{
+   run_config_t config     = {0};
+   const char *workload    = NULL;
+   const char *core_path   = NULL;
+   const char *content     = NULL;
+   bool temporary          = false;
+   char machine[16];
+   int failed              = 0;
+   int ran                 = 0;
+   unsigned frames         = 0;
+   int warmup              = -1;
+   unsigned i;
+   int opt;
+
+   report = stdout;
+   errors = stderr;
+   while ((opt = getopt(argc, argv, "w:f:W:xs:o:d:vh")) != -1)
+   {
+      switch (opt)
+      {
+         case 'w': workload = optarg; break;
+         case 'f': frames = (unsigned)strtoul(optarg, NULL, 10); break;
+         case 'W': warmup = atoi(optarg); break;
+         case 'x': warp = true; break;
+         case 's': config.serialize_loops = (unsigned)strtoul(optarg, NULL, 10); break;
+         case 'o':
+            if (!option_parse(optarg))
+            {
+               fprintf(stderr, "Invalid option '%s'\n", optarg);
+               return 1;
+            }
+            break;
+         case 'd': snprintf(system_dir, sizeof(system_dir), "%s", optarg); break;
+         case 'v': verbose = true; break;
+         default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+      }
+   }
+   if (optind >= argc)
+   {
+      usage(argv[0]);
+      return 1;
+   }
+   core_path = argv[optind++];
+   if (optind < argc)
+      content = argv[optind++];
+
+   if (!core_machine(core_path, machine, sizeof(machine)))
+   {
+      fprintf(stderr, "Core file name should be vice_<emu>_libretro\n");
+      return 1;
+   }
+   /* dlopen() needs a path to not search the library path */
+   if (!strchr(core_path, '/'))
+   {
+      static char local[512];
+
+      snprintf(local, sizeof(local), "./%s", core_path);
+      core_path = local;
+   }
+
+   if (!*system_dir)
+   {
+      snprintf(system_dir, sizeof(system_dir), "%s/vice_bench.XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+      if (!mkdtemp(system_dir))
+      {
+         perror("mkdtemp");
+         return 1;
+      }
+      temporary = true;
+   }
+
+   if (content)
+   {
+      config.frames = frames ? frames : DEFAULT_FRAMES;
+      config.warmup = warmup >= 0 ? (unsigned)warmup : 0;
+      printf("%s %s%s\n", machine, content, warp ? " (warp)" : "");
+      failed = run_forked(core_path, content, &config);
+      ran    = 1;
+   }
+
+   for (i = 0; !content && i < NUM_WORKLOADS; i++)
+   {
+      const workload_t *w   = &workloads[i];
+      unsigned user_options_saved = num_user_options;
+      char path[512];
+      buffer_t data = {0};
+
+      if ((workload && strcmp(workload, w->name)) || !workload_fits(w, machine))
+         continue;
+
+      ran++;
+      snprintf(path, sizeof(path), "%s/%s.%s", system_dir, w->name, w->extension);
+      if (!w->build(machine, &data) || !write_file(path, &data))
+      {
+         fprintf(stderr, "Cannot create workload '%s'\n", path);
+         free(data.data);
+         failed = 1;
+         continue;
+      }
+      free(data.data);
+
+      /* Workload options, unless given by the user */
+      {
+         char buf[512];
+         char *token;
+
+         snprintf(buf, sizeof(buf), "%s", w->options);
+         for (token = strtok(buf, ";"); token; token = strtok(NULL, ";"))
+         {
+            char *eq = strchr(token, '=');
+
+            *eq = '\0';
+            if (!user_option_find(token))
+               option_add(user_options, &num_user_options, MAX_USER_OPTIONS, token, eq + 1);
+         }
+      }
+
+      config.frames = frames ? frames : w->frames;
+      config.warmup = warmup >= 0 ? (unsigned)warmup : w->warmup;
+      if (config.warmup >= config.frames)
+         config.warmup = 0;
+
+      printf("%s %s: %s%s\n", machine, w->name, w->description, warp ? " (warp)" : "");
+      failed |= run_forked(core_path, path, &config);
+      num_user_options = user_options_saved;
+   }
+
+   if (!ran)
+      fprintf(stderr, "No workload for '%s'\n", workload ? workload : machine);
+
+   if (temporary)
+      nftw(system_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+   return failed || !ran;
+}
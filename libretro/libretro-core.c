@@ -2,7 +2,12 @@
 #include "libretro-core.h"
 #include "libretro-mapper.h"
 #include "libretro-graph.h"
+#include "libretro-vfs.h"
+#include "libretro-perf.h"
+#include "libretro-profiler.h"
+#include "libretro-trace.h"
 #include "encodings/utf.h"
+#include "streams/file_stream.h"
 
 #include "archdep.h"
 #include "mem.h"
@@ -21,6 +26,7 @@
 #include "interrupt.h"
 #include "datasette.h"
 #include "cartridge.h"
+#include "crc32.h"
 #include "initcmdline.h"
 #include "vsync.h"
 #include "log.h"
@@ -47,6 +53,7 @@ unsigned retro_renderloop = 1;
 extern bool retro_vkbd;
 extern void print_vkbd(void);
 unsigned int opt_vkbd_theme = 0;
+static libretro_graph_layer_t vkbd_layer = {0};
 libretro_graph_alpha_t opt_vkbd_alpha = GRAPH_ALPHA_75;
 libretro_graph_alpha_t opt_vkbd_dim_alpha = GRAPH_ALPHA_25;
 
@@ -136,6 +143,20 @@ static struct {
    int32_t capacity;
 } output_audio_buffer = {NULL, 0, 0};
 
+/* Average frame cost of the previous Warp Mode batch, -1 if unknown */
+static long warp_frame_cost = -1;
+
+/* Warp Mode batch of the current retro_run(). The size of the next batch
+ * is decided when the current one ends, so that its first frame can be
+ * rendered if it is the one presented */
+static struct {
+   unsigned int max;
+   unsigned int count;
+   unsigned int next_max;
+   long start;
+   bool active;
+} warp_batch = {1, 0, 1, 0, false};
+
 /* Audio buffer copy for auto warp detection */
 int16_t *audio_buffer;
 static bool audio_is_playing = false;
@@ -171,6 +192,13 @@ unsigned int opt_autostart = 1;
 unsigned int opt_autoloadwarp = 0;
 unsigned int opt_warp_boost = 1;
 unsigned int opt_read_vicerc = 0;
+static unsigned int opt_boot_cache = 0;
+static unsigned int opt_profiler = 0;
+static unsigned int opt_profiler_interval = 997;
+#ifdef RETRO_TRACE
+static unsigned int opt_trace = 0;
+static char trace_path[RETRO_PATH_MAX] = {0};
+#endif
 unsigned int opt_work_disk_type = 0;
 unsigned int opt_work_disk_unit = 8;
 #if defined(__X64__) || defined(__X64SC__) || defined(__X128__) || defined(__XSCPU64__)
@@ -185,6 +213,7 @@ bool sound_drive_mute = false;
 unsigned int opt_audio_leak_volume = 0;
 int opt_datasette_sound_volume = 0;
 unsigned int opt_statusbar = 0;
+static libretro_graph_layer_t statusbar_layer = {0};
 unsigned int opt_reset_type = 0;
 bool opt_keyrah_keypad = false;
 bool opt_keyboard_pass_through = false;
@@ -734,42 +763,27 @@ static int process_cmdline(const char* argv)
          snprintf(nib_input, sizeof(nib_input), "%s", argv);
          snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_basename);
          path_mkdir(retro_temp_directory);
-         nib_convert(nib_input, nib_output);
+         nib_convert(nib_input, nib_output, false);
          argv = nib_output;
       }
 
       /* ZIP */
       if (strendswith(argv, "zip") || strendswith(argv, "7z"))
       {
-         path_mkdir(retro_temp_directory);
          if (strendswith(argv, "zip"))
-            zip_uncompress(full_path, retro_temp_directory, NULL);
+            zip_mount(full_path, retro_temp_directory, NULL);
          else if (strendswith(argv, "7z"))
-            sevenzip_uncompress(full_path, retro_temp_directory, NULL);
+            sevenzip_mount(full_path, retro_temp_directory, NULL);
 
          /* Default to directory mode */
          snprintf(full_path, sizeof(full_path), "%s", retro_temp_directory);
 
-         FILE *zip_m3u;
          zip_m3u_t zip_m3u_list = {0};
          snprintf(zip_m3u_list.path, sizeof(zip_m3u_list.path), "%s%s%s.m3u",
                retro_temp_directory, FSDEV_DIR_SEP_STR, utf8_to_local_string_alloc(zip_basename));
 
-         DIR *zip_dir;
-         struct dirent *zip_dirp;
-
          /* Convert all NIBs to G64 */
-         zip_dir = opendir(retro_temp_directory);
-         while ((zip_dirp = readdir(zip_dir)) != NULL)
-         {
-            if (dc_get_image_type(zip_dirp->d_name) == DC_IMAGE_TYPE_NIBBLER)
-            {
-               snprintf(nib_input, sizeof(nib_input), "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_dirp->d_name);
-               snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, path_remove_extension(zip_dirp->d_name));
-               nib_convert(nib_input, nib_output);
-            }
-         }
-         closedir(zip_dir);
+         nib_convert_dir(retro_temp_directory, NULL);
 
          if (string_is_empty(browsed_file))
             m3u_scan_recurse(retro_temp_directory, &zip_m3u_list);
@@ -784,13 +798,11 @@ static int process_cmdline(const char* argv)
                   else
                      snprintf(full_path, sizeof(full_path), "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, browsed_file);
                }
+               else /* File system device needs the files on disk */
+                  vfs_materialize_all();
                break;
             case 1: /* Generated playlist */
-               zip_m3u = fopen(zip_m3u_list.path, "w");
-               qsort(zip_m3u_list.list, zip_m3u_list.num, RETRO_PATH_MAX, qstrcmp);
-               for (int l = 0; l < zip_m3u_list.num; l++)
-                  fprintf(zip_m3u, "%s\n", zip_m3u_list.list[l]);
-               fclose(zip_m3u);
+               m3u_mount_list(&zip_m3u_list);
                snprintf(full_path, sizeof(full_path), "%s", zip_m3u_list.path);
                log_cb(RETRO_LOG_INFO, "->M3U: %s\n", zip_m3u_list.path);
                break;
@@ -811,6 +823,10 @@ static int process_cmdline(const char* argv)
       else
          opt_jiffydos_allow = 1;
 
+      /* Before the machine starts with it */
+      if (!opt_jiffydos_allow)
+         opt_jiffydos = 0;
+
       /* REU image check */
       if (path_is_valid(argv))
       {
@@ -1487,40 +1503,10 @@ void update_work_disk()
    }
 }
 
-/* Update autostart image from vice and add disk in drive to fliplist */
-void update_from_vice()
+/* Model request from file path tags, resolved before the machine starts */
+static void model_auto_resolve(void)
 {
-   const char* attachedImage = NULL;
-
-   /* Get autostart string from vice, handle carts differently */
-   if (dc->unit == 0 && autostartString != NULL)
-   {
-      free(autostartProgram);
-      autostartProgram = NULL;
-      free(autostartString);
-      autostartString = NULL;
-      attachedImage = dc->files[dc->index];
-      /* Disable AutostartWarp & WarpMode, otherwise warp gets stuck with PRGs in M3Us */
-      resources_set_int("AutostartWarp", 0);
-      resources_set_int("WarpMode", 0);
-   }
-   else
-   {
-      free(autostartProgram);
-      autostartProgram = x_strdup(dc->load[dc->index]);
-      free(autostartString);
-      autostartString = x_strdup(cmdline_get_autostart_string());
-      if (!autostartString && !string_is_empty(full_path))
-         autostartString = x_strdup(full_path);
-   }
-
-   if (autostartString)
-      log_cb(RETRO_LOG_INFO, "Image for autostart: '%s'\n", autostartString);
-   else
-      log_cb(RETRO_LOG_INFO, "No image for autostart\n");
-
 #if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__XVIC__)
-   /* Automatic model request */
    if (opt_model_auto && !string_is_empty(full_path))
    {
       if (strstr(full_path, "NTSC") ||
@@ -1559,7 +1545,79 @@ void update_from_vice()
    }
    else
       request_model_auto_set = -1;
+
+#if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__)
+   /* Keep the C64 or C64C variant of the model option */
+   switch (request_model_auto_set)
+   {
+      case C64MODEL_C64_PAL:
+      case C64MODEL_C64C_PAL:
+         if (vice_opt.Model == C64MODEL_C64_NTSC || vice_opt.Model == C64MODEL_C64_PAL)
+            request_model_auto_set = C64MODEL_C64_PAL;
+         else if (vice_opt.Model == C64MODEL_C64C_NTSC || vice_opt.Model == C64MODEL_C64C_PAL)
+            request_model_auto_set = C64MODEL_C64C_PAL;
+         break;
+      case C64MODEL_C64_NTSC:
+      case C64MODEL_C64C_NTSC:
+         if (vice_opt.Model == C64MODEL_C64_NTSC || vice_opt.Model == C64MODEL_C64_PAL)
+            request_model_auto_set = C64MODEL_C64_NTSC;
+         else if (vice_opt.Model == C64MODEL_C64C_NTSC || vice_opt.Model == C64MODEL_C64C_PAL)
+            request_model_auto_set = C64MODEL_C64C_NTSC;
+         break;
+   }
+
+   if (request_model_auto_set == C64MODEL_C64_NTSC)
+      log_cb(RETRO_LOG_INFO, "Forcing C64 NTSC mode\n");
+   else if (request_model_auto_set == C64MODEL_C64C_NTSC)
+      log_cb(RETRO_LOG_INFO, "Forcing C64C NTSC mode\n");
+   else if (request_model_auto_set == C64MODEL_C64_PAL)
+      log_cb(RETRO_LOG_INFO, "Forcing C64 PAL mode\n");
+   else if (request_model_auto_set == C64MODEL_C64C_PAL)
+      log_cb(RETRO_LOG_INFO, "Forcing C64C PAL mode\n");
+   else if (request_model_auto_set == C64MODEL_C64_GS)
+      log_cb(RETRO_LOG_INFO, "Forcing C64GS mode\n");
+   else if (request_model_auto_set == C64MODEL_ULTIMAX)
+      log_cb(RETRO_LOG_INFO, "Forcing ULTIMAX mode\n");
+#elif defined(__XVIC__)
+   if (request_model_auto_set == VIC20MODEL_VIC20_NTSC)
+      log_cb(RETRO_LOG_INFO, "Forcing NTSC mode\n");
+   else if (request_model_auto_set == VIC20MODEL_VIC20_PAL)
+      log_cb(RETRO_LOG_INFO, "Forcing PAL mode\n");
 #endif
+#endif
+}
+
+/* Update autostart image from vice and add disk in drive to fliplist */
+void update_from_vice()
+{
+   const char* attachedImage = NULL;
+
+   /* Get autostart string from vice, handle carts differently */
+   if (dc->unit == 0 && autostartString != NULL)
+   {
+      free(autostartProgram);
+      autostartProgram = NULL;
+      free(autostartString);
+      autostartString = NULL;
+      attachedImage = dc->files[dc->index];
+      /* Disable AutostartWarp & WarpMode, otherwise warp gets stuck with PRGs in M3Us */
+      resources_set_int("AutostartWarp", 0);
+      resources_set_int("WarpMode", 0);
+   }
+   else
+   {
+      free(autostartProgram);
+      autostartProgram = x_strdup(dc->load[dc->index]);
+      free(autostartString);
+      autostartString = x_strdup(cmdline_get_autostart_string());
+      if (!autostartString && !string_is_empty(full_path))
+         autostartString = x_strdup(full_path);
+   }
+
+   if (autostartString)
+      log_cb(RETRO_LOG_INFO, "Image for autostart: '%s'\n", autostartString);
+   else
+      log_cb(RETRO_LOG_INFO, "No image for autostart\n");
 
    /* If flip list is empty, get current tape or floppy image name and add to the list */
    if (dc->count == 0)
@@ -1820,6 +1878,18 @@ static bool log_resource_set = false;
 static void update_variables(void);
 extern int ui_init_finalize(void);
 
+/* Sound state for new content */
+static void content_sound_reset(void)
+{
+   /* Update resources from environment just like on fresh start of core */
+   sound_volume_counter_reset();
+
+   /* Mute floppy startup sound when not using floppies */
+   if ((dc_get_image_type(full_path) != DC_IMAGE_TYPE_FLOPPY)
+    && (!string_is_empty(dc->files[dc->index]) && dc_get_image_type(dc->files[dc->index]) != DC_IMAGE_TYPE_FLOPPY))
+      sound_drive_mute = true;
+}
+
 void reload_restart(void)
 {
    /* Clear request */
@@ -1831,13 +1901,7 @@ void reload_restart(void)
    /* Cleanup after previous content and reset resources */
    initcmdline_cleanup();
 
-   /* Update resources from environment just like on fresh start of core */
-   sound_volume_counter_reset();
-
-   /* Mute floppy startup sound when not using floppies */
-   if ((dc_get_image_type(full_path) != DC_IMAGE_TYPE_FLOPPY)
-    && (!string_is_empty(dc->files[dc->index]) && dc_get_image_type(dc->files[dc->index]) != DC_IMAGE_TYPE_FLOPPY))
-      sound_drive_mute = true;
+   content_sound_reset();
 
    /* Reset file path tag model force */
    request_model_prev = -1;
@@ -1851,6 +1915,7 @@ void reload_restart(void)
 
    /* Some resources are not set until we call this */
    log_resource_set = true;
+   ui_init_options();
    ui_init_finalize();
 
    /* And process command line */
@@ -1908,6 +1973,97 @@ long retro_ticks(void)
    return perf_cb.get_time_usec();
 }
 
+/* Startup timing, logs the time since the previous phase, NULL starts over */
+static long startup_time_begin = 0;
+static long startup_time_phase = 0;
+
+void retro_startup_phase(const char *phase)
+{
+   long now = retro_ticks();
+
+   if (!phase)
+      startup_time_begin = now;
+   else if (perf_cb.get_time_usec)
+      log_cb(RETRO_LOG_INFO, "Startup %s: %ld.%03ld ms\n", phase,
+            (now - startup_time_phase) / 1000, (now - startup_time_phase) % 1000);
+   startup_time_phase = now;
+}
+
+/* Profiler and trace output goes next to the saves, named after the content */
+static void retro_output_path(char *path, size_t size, const char *extension)
+{
+   char name[RETRO_PATH_MAX];
+
+   if (string_is_empty(full_path))
+      snprintf(name, sizeof(name), "%s", machine_get_name());
+   else
+   {
+      snprintf(name, sizeof(name), "%s", path_basename(full_path));
+      path_remove_extension(name);
+   }
+   snprintf(path, size, "%s%s%s.%s", retro_save_directory, FSDEV_DIR_SEP_STR, name, extension);
+}
+
+static void retro_profiler_save(void)
+{
+   char path[RETRO_PATH_MAX];
+   unsigned long samples = 0;
+
+   if (!profiler_samples())
+      return;
+
+   retro_output_path(path, sizeof(path), "folded");
+   if ((samples = profiler_save(path)))
+      log_cb(RETRO_LOG_INFO, "Profile of %lu samples written to '%s'\n", samples, path);
+   else
+      log_cb(RETRO_LOG_WARN, "Cannot write profile '%s'\n", path);
+}
+
+/* Applies the profiler options on the running machine */
+void retro_profiler_update(void)
+{
+   profiler_set((enum profiler_mode)opt_profiler, opt_profiler_interval);
+   if (opt_profiler == PROFILER_DISABLED)
+      retro_profiler_save();
+}
+
+#ifdef RETRO_TRACE
+static void retro_trace_close(void)
+{
+   uint64_t records = 0;
+
+   if (string_is_empty(trace_path))
+      return;
+
+   if ((records = trace_stop()))
+      log_cb(RETRO_LOG_INFO, "Trace of %llu instructions written to '%s'\n",
+            (unsigned long long)records, trace_path);
+   else
+      log_cb(RETRO_LOG_WARN, "Cannot write trace '%s'\n", trace_path);
+   trace_path[0] = '\0';
+}
+
+/* Opens, retargets or closes the trace on the running machine */
+void retro_trace_update(void)
+{
+   if (!opt_trace)
+      retro_trace_close();
+   else if (!string_is_empty(trace_path))
+      trace_set_cpus(opt_trace);
+   else
+   {
+      retro_output_path(trace_path, sizeof(trace_path), "trace.gz");
+      if (trace_start(trace_path, opt_trace))
+         log_cb(RETRO_LOG_INFO, "Tracing to '%s'\n", trace_path);
+      else
+      {
+         log_cb(RETRO_LOG_WARN, "Cannot write trace '%s'\n", trace_path);
+         trace_path[0] = '\0';
+      }
+   }
+}
+#endif
+
 unsigned int vice_led_state[RETRO_LED_NUM] = {0};
 static unsigned int retro_led_state[RETRO_LED_NUM] = {0};
 static void retro_led_interface(void)
@@ -2002,6 +2158,50 @@ bool is_audio_playing_while_autoloadwarping(void)
    return (audio_is_playing && !retro_warpmode && !(opt_autoloadwarp & AUTOLOADWARP_MUTE));
 }
 
+static unsigned int warp_frame_max(void)
+{
+   if (!vsync_get_warp_mode())
+      return 1;
+
+#if !defined(__X64SC__) && !defined(__XSCPU64__)
+   /* Slow cores will cripple warp speed severily if smoothness is the target,
+    * therefore limit the batch to what fits in a quarter of a frame, based on
+    * the cost of the previous batch. Unknown cost starts with a single frame. */
+   if (warp_frame_cost < 0)
+      return 1;
+   if (warp_frame_cost > 0)
+      return MIN(retro_refresh, (retro_refresh_ms / 4) / warp_frame_cost + 1);
+#endif
+   return retro_refresh;
+}
+
+/* Called at the vsync of each frame, before the skip decision for the next
+ * one. Only the last frame of a batch gets presented, therefore the next
+ * frame is rendered only if it ends the batch, or starts a batch of a single
+ * frame. Warp turned off or audio playing ends the batch after the next
+ * frame, which is rendered for that */
+void retro_warp_frame_end(void)
+{
+   if (!warp_batch.active)
+      return;
+
+   warp_batch.count++;
+
+   if (warp_batch.count >= warp_batch.max)
+   {
+      warp_frame_cost = vsync_get_warp_mode()
+            ? (retro_ticks() - warp_batch.start) / warp_batch.count : -1;
+      warp_batch.next_max = warp_frame_max();
+      vsync_set_warp_render_next_frame(warp_batch.next_max == 1);
+      return;
+   }
+
+   if (!vsync_get_warp_mode() || is_audio_playing_while_autoloadwarping())
+      warp_batch.max = warp_batch.count + 1;
+
+   vsync_set_warp_render_next_frame(warp_batch.count + 1 == warp_batch.max);
+}
+
 static void retro_set_paths(void)
 {
    const char *system_dir = NULL;
@@ -2492,6 +2692,71 @@ static void retro_set_core_options()
          },
          "enabled"
       },
+      {
+         "vice_boot_cache",
+         "System > Boot Cache",
+         "Boot Cache",
+         "Start content on a machine image already booted to 'READY.', which is created on first use of each model, ROM and drive setup in 'system/vice/bootcache'. The 8 most recent images are kept. Core restart required.",
+         NULL,
+         "system",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+      {
+         "vice_profiler",
+         "System > Profiler",
+         "Profiler",
+         "Sample where the emulated CPUs spend their time. The call stacks are written for flame graph tools to 'saves/[content].folded' when disabled or when the content is closed.",
+         NULL,
+         "system",
+         {
+            { "disabled", NULL },
+            { "maincpu", "Main CPU" },
+            { "drives", "Main and Drive CPUs" },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+      {
+         "vice_profiler_interval",
+         "System > Profiler Interval",
+         "Profiler Interval",
+         "Cycles between samples. The prime numbers keep clear of the raster timing.",
+         NULL,
+         "system",
+         {
+            { "97", "97 cycles" },
+            { "499", "499 cycles" },
+            { "997", "997 cycles" },
+            { "4999", "4999 cycles" },
+            { "19997", "19997 cycles" },
+            { NULL, NULL },
+         },
+         "997"
+      },
+#ifdef RETRO_TRACE
+      {
+         "vice_trace",
+         "System > Execution Trace",
+         "Execution Trace",
+         "Record every executed instruction with the registers to 'saves/[content].trace.gz', written when disabled or when the content is closed. 'vice_trace' prints the trace or compares two of them.",
+         NULL,
+         "system",
+         {
+            { "disabled", NULL },
+            { "maincpu", "Main CPU" },
+            { "drive8", "Drive 8 CPU" },
+            { "maincpu_drive8", "Main and Drive 8 CPUs" },
+            { "all", "Main and Drive CPUs" },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+#endif
 #if !defined(__X64DTV__)
       {
          "vice_reset",
@@ -2588,6 +2853,20 @@ static void retro_set_core_options()
          },
          "enabled"
       },
+      {
+         "vice_drive_adaptive_rotation",
+         "Media > Adaptive Drive Rotation",
+         "Adaptive Drive Rotation",
+         "Speeds up 'True Drive Emulation' with G64 images and written disks by using the simple disk model while the drive DOS reads standard tracks. Copy protections and custom loaders always get the full disk model.",
+         NULL,
+         "media",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
       {
          "vice_virtual_device_traps",
          "Media > Virtual Device Traps",
@@ -2602,6 +2881,20 @@ static void retro_set_core_options()
          },
          "disabled"
       },
+      {
+         "vice_datasette_accelerate",
+         "Media > Datasette Acceleration",
+         "Datasette Acceleration",
+         "Decodes TAP blocks loaded by the Kernal straight from the image instead of playing the tape, and shortens CBM and Turbo Tape pilot tones. Other tape formats play as recorded.\n'Virtual Device Traps' required for Kernal blocks!",
+         NULL,
+         "media",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
       {
          "vice_floppy_write_protection",
          "Media > Floppy Write Protection",
@@ -3225,6 +3518,22 @@ static void retro_set_core_options()
          },
          "disabled"
       },
+#ifdef RETRO_PERF_COUNTERS
+      {
+         "vice_statusbar_perf",
+         "OSD > Statusbar Performance",
+         "Statusbar Performance",
+         "Show the share of frame time per emulated subsystem instead of the joyports: main CPU, video chip, sound, drives, alarms, canvas refresh and overlays, followed by the average frame time.",
+         NULL,
+         "osd",
+         {
+            { "disabled", NULL },
+            { "enabled", NULL },
+            { NULL, NULL },
+         },
+         "disabled"
+      },
+#endif
       {
          "vice_joyport_pointer_color",
          "OSD > Light Pen/Gun Pointer Color",
@@ -4815,10 +5124,21 @@ static void retro_set_inputs(void)
          retro_devices[i] = RETRO_DEVICE_JOYPAD;
 }
 
+static int options_display_state = -1;
 void retro_set_options_display(void)
 {
    struct retro_core_option_display option_display;
    bool manual_crop = true;
+   int state = (crop_id == CROP_MANUAL)
+             | (libretro_supports_option_categories << 1)
+             | (opt_mapping_options_display << 2)
+             | (opt_audio_options_display << 3)
+             | (opt_video_options_display << 4);
+
+   /* Visibility only depends on these, skip the calls when unchanged */
+   if (state == options_display_state)
+      return;
+   options_display_state = state;
 
    option_display.visible = (crop_id == CROP_MANUAL);
    manual_crop = option_display.visible;
@@ -5002,6 +5322,10 @@ void retro_set_options_display(void)
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_statusbar_messages";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+#ifdef RETRO_PERF_COUNTERS
+   option_display.key = "vice_statusbar_perf";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+#endif
    option_display.key = "vice_joyport_pointer_color";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = "vice_gfx_colors";
@@ -5106,7 +5430,7 @@ void retro_set_options_display(void)
 #endif
 }
 
-static bool updating_variables = false;
+bool updating_variables = false;
 bool retro_update_display(void)
 {
    if (updating_variables)
@@ -5142,25 +5466,78 @@ void retro_set_environment(retro_environment_t cb)
    struct retro_vfs_interface_info vfs_iface_info;
    vfs_iface_info.required_interface_version = 1;
    vfs_iface_info.iface                      = NULL;
-   if (environ_cb(RETRO_ENVIRONMENT_GET_VFS_INTERFACE, &vfs_iface_info))
-      filestream_vfs_init(&vfs_iface_info);
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_VFS_INTERFACE, &vfs_iface_info))
+      vfs_iface_info.iface = NULL;
+   vfs_init(&vfs_iface_info);
+
+   /* Plain images can be loaded by the frontend and read from memory,
+    * everything that needs the path or is compressed is loaded here */
+   static const struct retro_system_content_info_override content_overrides[] = {
+      {
+#if defined(__XVIC__)
+         "d64|d71|d80|d81|d82|g64|g41|x64|t64|tap|prg|p00|crt|bin|d2m|d4m|20|40|60|a0|b0|rom",
+#else
+         "d64|d71|d80|d81|d82|g64|g41|x64|t64|tap|prg|p00|crt|bin|d2m|d4m|tcrt",
+#endif
+         false, /* need_fullpath */
+         true   /* persistent_data */
+      },
+      { NULL, false, false }
+   };
+   environ_cb(RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE, (void*)content_overrides);
 #endif
 }
 
-int log_resources_set_int(const char *name, int value)
+/* Unchanged values are not set again, since many setters reinitialize
+ * something (SID, drives, palette) whether or not the value changed */
+static bool resources_int_unchanged(const char *name, int value)
+{
+   int current = 0;
+   return !resources_get_int(name, &current) && current == value;
+}
+
+static bool resources_string_unchanged(const char *name, const char *value)
+{
+   const char *current = NULL;
+   return !resources_get_string(name, &current) && current && value && !strcmp(current, value);
+}
+
+static int silent_resources_set_int(const char *name, int value)
+{
+   if (resources_int_unchanged(name, value))
+      return 0;
+   return resources_set_int(name, value);
+}
+
+/* Sets even an unchanged value, for setters that reload something */
+int log_resources_force_int(const char *name, int value)
 {
    if (log_resource_set)
       log_cb(RETRO_LOG_INFO, "Set resource: %s => %d\n", name, value);
    return resources_set_int(name, value);
 }
 
-int log_resources_set_string(const char *name, const char *value)
+int log_resources_force_string(const char *name, const char *value)
 {
    if (log_resource_set)
       log_cb(RETRO_LOG_INFO, "Set resource: %s => \"%s\"\n", name, value);
    return resources_set_string(name, value);
 }
 
+int log_resources_set_int(const char *name, int value)
+{
+   if (resources_int_unchanged(name, value))
+      return 0;
+   return log_resources_force_int(name, value);
+}
+
+int log_resources_set_string(const char *name, const char *value)
+{
+   if (resources_string_unchanged(name, value))
+      return 0;
+   return log_resources_force_string(name, value);
+}
+
 void set_variable(const char* key, const char* value)
 {
    struct retro_variable var = {0};
@@ -5263,20 +5640,20 @@ static void update_variables(void)
       /* Silently restore drive sounds when autoloadwarp is disabled and DSE is enabled */
       if (retro_ui_finalized && vice_opt.DriveSoundEmulation && vice_opt.DriveTrueEmulation &&
           (!(opt_autoloadwarp & AUTOLOADWARP_DISK) && !(opt_autoloadwarp & AUTOLOADWARP_MUTE)))
-         resources_set_int("DriveSoundEmulationVolume", vice_opt.DriveSoundEmulation);
+         silent_resources_set_int("DriveSoundEmulationVolume", vice_opt.DriveSoundEmulation);
 
 #if !defined(__XSCPU64__) && !defined(__X64DTV__)
       /* Silently restore tape sounds when autoloadwarp is disabled */
       if (retro_ui_finalized && vice_opt.DatasetteSound &&
           (!(opt_autoloadwarp & AUTOLOADWARP_TAPE) && !(opt_autoloadwarp & AUTOLOADWARP_MUTE)))
-         resources_set_int("DatasetteSound", vice_opt.DatasetteSound);
+         silent_resources_set_int("DatasetteSound", vice_opt.DatasetteSound);
 #endif
 
 #if defined(__X64__) || defined(__X64SC__) || defined(__X64DTV__) || defined(__X128__) || defined(__XSCPU64__) || defined(__XCBM5x0__) || defined(__XVIC__) || defined(__XPLUS4__)
       /* Silently restore audio leak when autoloadwarp is disabled */
       if (retro_ui_finalized && vice_opt.AudioLeak &&
           (!opt_autoloadwarp || opt_autoloadwarp & AUTOLOADWARP_MUTE))
-         resources_set_int(AUDIOLEAK_RESOURCE, vice_opt.AudioLeak);
+         silent_resources_set_int(AUDIOLEAK_RESOURCE, vice_opt.AudioLeak);
 #endif
    }
 
@@ -5351,6 +5728,18 @@ static void update_variables(void)
       else                                vice_opt.VirtualDevices = 1;
    }
 
+   var.key = "vice_datasette_accelerate";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      int val = !strcmp(var.value, "enabled");
+
+      if (retro_ui_finalized && vice_opt.DatasetteAccelerate != val)
+         log_resources_set_int("DatasetteAccelerate", val);
+
+      vice_opt.DatasetteAccelerate = val;
+   }
+
    var.key = "vice_warp_boost";
    var.value = NULL;
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -5376,7 +5765,7 @@ static void update_variables(void)
 
       /* Silently restore sounds when TDE and DSE is enabled */
       if (retro_ui_finalized && vice_opt.DriveSoundEmulation && vice_opt.DriveTrueEmulation)
-         resources_set_int("DriveSoundEmulationVolume", vice_opt.DriveSoundEmulation);
+         silent_resources_set_int("DriveSoundEmulationVolume", vice_opt.DriveSoundEmulation);
 
       /* Forcefully enable Virtual Device Traps if TDE is disabled,
        * otherwise floppy access does not work at all */
@@ -5388,6 +5777,18 @@ static void update_variables(void)
       }
    }
 
+   var.key = "vice_drive_adaptive_rotation";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      int val = !strcmp(var.value, "enabled");
+
+      if (retro_ui_finalized && vice_opt.DriveAdaptiveRotation != val)
+         log_resources_set_int("DriveAdaptiveRotation", val);
+
+      vice_opt.DriveAdaptiveRotation = val;
+   }
+
    /* Tapecart needs TDE */
    if (!vice_opt.DriveTrueEmulation && (
          (!string_is_empty(full_path) && strendswith(full_path, "tcrt")) ||
@@ -5436,7 +5837,7 @@ static void update_variables(void)
       if (retro_ui_finalized && vice_opt.DriveSoundEmulation &&
             (!vice_opt.DriveTrueEmulation ||
             (opt_autoloadwarp & AUTOLOADWARP_DISK && !(opt_autoloadwarp & AUTOLOADWARP_MUTE))))
-         resources_set_int("DriveSoundEmulationVolume", 0);
+         silent_resources_set_int("DriveSoundEmulationVolume", 0);
    }
 
 #if !defined(__XSCPU64__) && !defined(__X64DTV__)
@@ -5460,7 +5861,7 @@ static void update_variables(void)
       /* Silently mute sounds with autoloadwarping */
       if (retro_ui_finalized && vice_opt.DatasetteSound &&
             (opt_autoloadwarp & AUTOLOADWARP_TAPE && !(opt_autoloadwarp & AUTOLOADWARP_MUTE)))
-         resources_set_int("DatasetteSound", 0);
+         silent_resources_set_int("DatasetteSound", 0);
    }
 #endif
 
@@ -5483,7 +5884,7 @@ static void update_variables(void)
       /* Silently mute leak with autoloadwarping */
       if (retro_ui_finalized && vice_opt.AudioLeak &&
             (opt_autoloadwarp && !(opt_autoloadwarp & AUTOLOADWARP_MUTE)))
-         resources_set_int(AUDIOLEAK_RESOURCE, 0);
+         silent_resources_set_int(AUDIOLEAK_RESOURCE, 0);
    }
 #endif
 
@@ -6708,6 +7109,16 @@ static void update_variables(void)
          opt_statusbar |= STATUSBAR_MESSAGES;
    }
 
+#ifdef RETRO_PERF_COUNTERS
+   var.key = "vice_statusbar_perf";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         opt_statusbar |= STATUSBAR_PERF;
+   }
+#endif
+
    var.key = "vice_mapping_options_display";
    var.value = NULL;
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -6744,6 +7155,47 @@ static void update_variables(void)
          request_reload_restart = (opt_read_vicerc != opt_read_vicerc_prev) ? true : request_reload_restart;
    }
 
+   var.key = "vice_boot_cache";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "disabled")) opt_boot_cache = 0;
+      else                                opt_boot_cache = 1;
+   }
+
+   var.key = "vice_profiler";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "disabled"))     opt_profiler = PROFILER_DISABLED;
+      else if (!strcmp(var.value, "maincpu")) opt_profiler = PROFILER_MAINCPU;
+      else if (!strcmp(var.value, "drives"))  opt_profiler = PROFILER_DRIVES;
+   }
+
+   var.key = "vice_profiler_interval";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      opt_profiler_interval = atoi(var.value);
+
+   if (retro_ui_finalized)
+      retro_profiler_update();
+
+#ifdef RETRO_TRACE
+   var.key = "vice_trace";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "disabled"))            opt_trace = 0;
+      else if (!strcmp(var.value, "maincpu"))        opt_trace = 1 << TRACE_CPU_MAIN;
+      else if (!strcmp(var.value, "drive8"))         opt_trace = 1 << TRACE_CPU_DRIVE8;
+      else if (!strcmp(var.value, "maincpu_drive8")) opt_trace = (1 << TRACE_CPU_MAIN) | (1 << TRACE_CPU_DRIVE8);
+      else if (!strcmp(var.value, "all"))            opt_trace = (1 << TRACE_CPU_MAIN) | TRACE_CPU_DRIVES;
+   }
+
+   if (retro_ui_finalized)
+      retro_trace_update();
+#endif
+
 #if defined(__XSCPU64__)
    var.key = "vice_supercpu_speed_switch";
    var.value = NULL;
@@ -7472,10 +7924,14 @@ void retro_init(void)
 
    if (!environ_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb))
       perf_cb.get_time_usec = NULL;
+#ifdef RETRO_PERF_COUNTERS
+   retro_perf_init(perf_cb.get_time_usec ? &perf_cb : NULL);
+#endif
 
    retro_set_paths();
 
    /* Clean ZIP temp */
+   vfs_unmount_all();
    if (!string_is_empty(retro_temp_directory) && path_is_directory(retro_temp_directory))
       remove_recurse(retro_temp_directory);
 
@@ -7556,6 +8012,9 @@ void retro_deinit(void)
    machine_shutdown();
 #endif
 
+   /* Stop disk image writer */
+   disk_image_shutdown();
+
    /* Clean Disc Control context */
    if (dc)
       dc_free(dc);
@@ -7564,10 +8023,13 @@ void retro_deinit(void)
    free_vice_carts();
 
    /* Clean ZIP temp */
+   vfs_unmount_all();
    if (!string_is_empty(retro_temp_directory) && path_is_directory(retro_temp_directory))
       remove_recurse(retro_temp_directory);
 
    /* Free buffers uses by libretro-graph */
+   libretro_graph_layer_free(&vkbd_layer);
+   libretro_graph_layer_free(&statusbar_layer);
    libretro_graph_free();
 
    /* Free audio buffer */
@@ -7577,6 +8039,7 @@ void retro_deinit(void)
    libretro_supports_bitmasks = false;
    libretro_supports_ff_override = false;
    libretro_supports_option_categories = false;
+   options_display_state = -1;
    pix_bytes_initialized = false;
    cur_port_locked = false;
    opt_aspect_ratio_locked = false;
@@ -7984,6 +8447,23 @@ void retro_audio_queue(const int16_t *data, int32_t samples)
 #endif
 }
 
+/* Model to start with, the file path tag one when automatic */
+int emu_model_startup(void)
+{
+   int model = vice_opt.Model;
+
+#if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__XVIC__)
+   if (opt_model_auto && request_model_auto_set > -1)
+   {
+      model = request_model_auto_set;
+      opt_model_auto_locked = true;
+   }
+#endif
+
+   request_model_prev = model;
+   return model;
+}
+
 void emu_model_set(int model)
 {
 #if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__XVIC__)
@@ -8030,56 +8510,6 @@ void retro_run(void)
 
    if (retro_ui_finalized)
    {
-#if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__) || defined(__XVIC__)
-      /* Set automatic model when requested */
-      if (opt_model_auto && !opt_model_auto_locked && request_model_auto_set > -1)
-      {
-         if (request_model_prev != request_model_auto_set)
-         {
-#if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__)
-            switch (request_model_auto_set)
-            {
-               case C64MODEL_C64_PAL:
-               case C64MODEL_C64C_PAL:
-                  if (vice_opt.Model == C64MODEL_C64_NTSC || vice_opt.Model == C64MODEL_C64_PAL)
-                     request_model_auto_set = C64MODEL_C64_PAL;
-                  else if (vice_opt.Model == C64MODEL_C64C_NTSC || vice_opt.Model == C64MODEL_C64C_PAL)
-                     request_model_auto_set = C64MODEL_C64C_PAL;
-                  break;
-               case C64MODEL_C64_NTSC:
-               case C64MODEL_C64C_NTSC:
-                  if (vice_opt.Model == C64MODEL_C64_NTSC || vice_opt.Model == C64MODEL_C64_PAL)
-                     request_model_auto_set = C64MODEL_C64_NTSC;
-                  else if (vice_opt.Model == C64MODEL_C64C_NTSC || vice_opt.Model == C64MODEL_C64C_PAL)
-                     request_model_auto_set = C64MODEL_C64C_NTSC;
-                  break;
-            }
-
-            if (request_model_auto_set == C64MODEL_C64_NTSC)
-               log_cb(RETRO_LOG_INFO, "Forcing C64 NTSC mode\n");
-            else if (request_model_auto_set == C64MODEL_C64C_NTSC)
-               log_cb(RETRO_LOG_INFO, "Forcing C64C NTSC mode\n");
-            else if (request_model_auto_set == C64MODEL_C64_PAL)
-               log_cb(RETRO_LOG_INFO, "Forcing C64 PAL mode\n");
-            else if (request_model_auto_set == C64MODEL_C64C_PAL)
-               log_cb(RETRO_LOG_INFO, "Forcing C64C PAL mode\n");
-            else if (request_model_auto_set == C64MODEL_C64_GS)
-               log_cb(RETRO_LOG_INFO, "Forcing C64GS mode\n");
-            else if (request_model_auto_set == C64MODEL_ULTIMAX)
-               log_cb(RETRO_LOG_INFO, "Forcing ULTIMAX mode\n");
-#elif defined(__XVIC__)
-            if (request_model_auto_set == VIC20MODEL_VIC20_NTSC)
-               log_cb(RETRO_LOG_INFO, "Forcing NTSC mode\n");
-            else if (request_model_auto_set == VIC20MODEL_VIC20_PAL)
-               log_cb(RETRO_LOG_INFO, "Forcing PAL mode\n");
-#endif
-            request_model_set  = request_model_auto_set;
-         }
-
-         opt_model_auto_locked = true;
-      }
-#endif
-
       /* Set model */
       if (request_model_set > -1)
          emu_model_set(request_model_set);
@@ -8167,37 +8597,35 @@ void retro_run(void)
    retro_poll_event();
 
    /* Main loop with Warp Mode maximizing without too much input lag */
-   unsigned int frame_max = vsync_get_warp_mode() ? retro_refresh : 1;
-   unsigned int frame_count = 0;
-   long frame_time = 0;
-   long frame_start = retro_ticks();
    retro_now += 1000000 / retro_refresh;
+   warp_batch.max    = vsync_get_warp_mode() ? warp_batch.next_max : 1;
+   warp_batch.count  = 0;
+   warp_batch.start  = retro_ticks();
+   warp_batch.active = true;
 
-   for (frame_count = 0; frame_count < frame_max; ++frame_count)
+   RETRO_PERF_ENTER(RETRO_PERF_MAINCPU);
+   while (warp_batch.count < warp_batch.max)
    {
-      frame_time = retro_ticks();
-
-#if !defined(__X64SC__) && !defined(__XSCPU64__)
-      /* Slow cores will cripple warp speed severily if smoothness is the target */
-      if (frame_max > 1 && frame_time != 0 && frame_time - frame_start + (frame_time - frame_start) > (retro_refresh_ms / 2))
-         break;
-#endif
-
-      if (frame_max > 1 && (!vsync_get_warp_mode() || is_audio_playing_while_autoloadwarping()))
-         break;
-
       while (retro_renderloop)
          maincpu_mainloop();
       retro_renderloop = 1;
    }
+   RETRO_PERF_LEAVE();
+   warp_batch.active = false;
 
    /* LED interface */
    if (led_state_cb)
       retro_led_interface();
 
+   RETRO_PERF_ENTER(RETRO_PERF_OVERLAY);
+
    /* Virtual keyboard */
    if (retro_vkbd)
+   {
+      libretro_graph_layer_begin(&vkbd_layer);
       print_vkbd();
+      libretro_graph_layer_end(&vkbd_layer);
+   }
 
    /* Statusbar message timer */
    if (statusbar_message_timer > 0)
@@ -8205,7 +8633,16 @@ void retro_run(void)
 
    /* Forced statusbar messages */
    if ((!retro_statusbar && opt_statusbar & STATUSBAR_MESSAGES && statusbar_message_timer) || retro_statusbar)
+   {
+      libretro_graph_layer_begin(&statusbar_layer);
       uistatusbar_draw();
+      libretro_graph_layer_end(&statusbar_layer);
+   }
+
+   RETRO_PERF_LEAVE();
+#ifdef RETRO_PERF_COUNTERS
+   retro_perf_frame(retro_ticks() - warp_batch.start);
+#endif
 
    /* Set volume back to maximum after starting with mute, due to ReSID 6581 init pop */
    if (sound_volume_counter > 0)
@@ -8236,8 +8673,38 @@ void retro_run(void)
    }
 }
 
+/* Content loaded by the frontend is mounted in place of the file, and written
+ * to disk on the first write like archive members */
+static void mount_content(const struct retro_game_info *info, char *path, size_t len)
+{
+#ifdef USE_LIBRETRO_VFS
+   const struct retro_game_info_ext *info_ext = NULL;
+   bool persistent = false;
+
+   if (!info->data)
+      return;
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_GAME_INFO_EXT, &info_ext) && info_ext)
+   {
+      persistent = info_ext->persistent_data;
+
+      /* Files inside archives do not exist on their own */
+      if (info_ext->file_in_archive && !string_is_empty(info_ext->archive_file))
+         snprintf(path, len, "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, path_basename(info_ext->archive_file));
+   }
+
+   if (persistent)
+      vfs_file_add_buffer(path, info->data, info->size);
+   else
+      vfs_file_add_data(path, info->data, info->size);
+   log_cb(RETRO_LOG_INFO, "Content from memory: %s (%u bytes)\n", path, (unsigned)info->size);
+#endif
+}
+
 bool retro_load_game(const struct retro_game_info *info)
 {
+   retro_startup_phase(NULL);
+
    /* Pixel format */
    if (!pix_bytes_initialized)
    {
@@ -8278,7 +8745,11 @@ bool retro_load_game(const struct retro_game_info *info)
       local_path = utf8_to_local_string_alloc(info->path);
       if (local_path)
       {
-         process_cmdline(local_path);
+         char content_path[RETRO_PATH_MAX] = {0};
+         snprintf(content_path, sizeof(content_path), "%s", local_path);
+         mount_content(info, content_path, sizeof(content_path));
+
+         process_cmdline(content_path);
          free(local_path);
          local_path = NULL;
       }
@@ -8289,6 +8760,9 @@ bool retro_load_game(const struct retro_game_info *info)
       /* Empty cmdline processing required for VIC-20 core option cartridges on startup */
       process_cmdline("");
 
+   model_auto_resolve();
+   retro_startup_phase("content");
+
 #if defined(__XPET__) || defined(__XCBM2__) || defined(__XVIC__)
    /* Joyport limit has to apply always */
    cur_port = 1;
@@ -8297,8 +8771,17 @@ bool retro_load_game(const struct retro_game_info *info)
 
    if (runstate == RUNSTATE_FIRST_START)
    {
+      /* Options, model tags and content are resolved by now,
+       * so the machine only needs to be initialized once */
+      log_resource_set = true;
       pre_main();
-      reload_restart();
+      content_sound_reset();
+      update_from_vice();
+      retro_startup_phase("media");
+
+      if (perf_cb.get_time_usec)
+         log_cb(RETRO_LOG_INFO, "Startup total: %ld.%03ld ms\n",
+               (retro_ticks() - startup_time_begin) / 1000, (retro_ticks() - startup_time_begin) % 1000);
    }
    else if (runstate == RUNSTATE_RUNNING)
    {
@@ -8332,6 +8815,16 @@ void retro_unload_game(void)
    file_system_detach_disk_shutdown();
    dc_reset(dc);
 
+   /* Keep the profile and the trace of the closed content */
+   retro_profiler_save();
+#ifdef RETRO_TRACE
+   retro_trace_close();
+#endif
+
+   /* Wait for pending disk image writes */
+   disk_image_flush_all();
+   disk_image_flush_barrier();
+
    free(autostartString);
    autostartString = NULL;
    free(autostartProgram);
@@ -8431,6 +8924,9 @@ static void retro_unserialize_post(void)
    request_restart = false;
    /* Sync Disc Control index for D64 multidisks */
    dc_sync_index();
+   /* Sample from the restored clock on */
+   if (opt_profiler)
+      retro_profiler_update();
 }
 
 size_t retro_serialize_size(void)
@@ -8525,6 +9021,293 @@ bool retro_unserialize(const void *data_, size_t size)
    return false;
 }
 
+/* Boot image cache, the machine state at the end of the autostart delay
+ * after power-on. The power-on state with ROMs is the key, which covers
+ * model, ROM sets, drives, expansions and options kept in snapshots.
+ * The RAM is left out of it, as power-on fills it with random bits, and
+ * the options of the fill pattern stand in for it */
+#define BOOT_CACHE_DIR "bootcache"
+#define BOOT_CACHE_MAX 8
+
+static const char *boot_key_ram_modules[] =
+{
+   "C64MEM", "C128MEM", "VIC20MEM", "PLUS4MEM", "CBM2MEM", "PETMEM"
+};
+
+static const char *boot_key_ram_resources[] =
+{
+   "RAMInitStartValue", "RAMInitValueInvert", "RAMInitValueOffset",
+   "RAMInitPatternInvert", "RAMInitPatternInvertValue",
+   "RAMInitStartRandom", "RAMInitRepeatRandom", "RAMInitRandomChance"
+};
+
+typedef struct boot_image
+{
+   uint8_t *data;
+   size_t size;
+   int save_roms;
+   bool success;
+} boot_image_t;
+
+static int boot_trap_happened = 0;
+
+static uint8_t *boot_snapshot_write(int save_roms, size_t *size)
+{
+   snapshot_stream_t *stream = NULL;
+   uint8_t *data = NULL;
+   long len      = 0;
+
+   /* Size first, the memory stream does not grow */
+   if (!(stream = snapshot_memory_write_fopen(NULL, 0)))
+      return NULL;
+   if (machine_write_snapshot_to_stream(stream, save_roms, 0, 0) >= 0)
+   {
+      snapshot_fseek(stream, 0, SEEK_END);
+      len = snapshot_ftell(stream);
+   }
+   snapshot_fclose(stream);
+
+   if (len <= 0 || !(data = (uint8_t *)malloc(len)))
+      return NULL;
+
+   if (!(stream = snapshot_memory_write_fopen(data, len)))
+   {
+      free(data);
+      return NULL;
+   }
+   if (machine_write_snapshot_to_stream(stream, save_roms, 0, 0) < 0)
+   {
+      free(data);
+      data = NULL;
+   }
+   snapshot_fclose(stream);
+
+   *size = len;
+   return data;
+}
+
+static uint32_t boot_key_crc(const uint8_t *data, size_t size)
+{
+   snapshot_stream_t *stream = NULL;
+   snapshot_t *snapshot      = NULL;
+   uint8_t *key              = NULL;
+   size_t key_len            = 0;
+   size_t pos                = 0;
+   uint32_t crc              = 0;
+   uint8_t major, minor;
+   unsigned i;
+   int value;
+
+   if (!(stream = snapshot_memory_read_fopen(data, size)))
+      return 0;
+   if (!(snapshot = snapshot_open_from_stream(stream, &major, &minor, machine_get_name())))
+   {
+      snapshot_fclose(stream);
+      return 0;
+   }
+
+   /* Header as is, then every module but the RAM */
+   pos = snapshot_ftell(stream);
+   key = (uint8_t *)malloc(size + sizeof(boot_key_ram_resources) / sizeof(boot_key_ram_resources[0]) * sizeof(value));
+   memcpy(key, data, pos);
+   key_len = pos;
+
+   while (pos + SNAPSHOT_MODULE_NAME_LEN + 6 <= size)
+   {
+      const uint8_t *module = data + pos;
+      uint32_t module_size  = module[SNAPSHOT_MODULE_NAME_LEN + 2]
+                            | (module[SNAPSHOT_MODULE_NAME_LEN + 3] << 8)
+                            | (module[SNAPSHOT_MODULE_NAME_LEN + 4] << 16)
+                            | ((uint32_t)module[SNAPSHOT_MODULE_NAME_LEN + 5] << 24);
+
+      if (module_size < SNAPSHOT_MODULE_NAME_LEN + 6 || module_size > size - pos)
+         break;
+
+      for (i = 0; i < sizeof(boot_key_ram_modules) / sizeof(boot_key_ram_modules[0]); i++)
+         if (!strncmp((const char *)module, boot_key_ram_modules[i], SNAPSHOT_MODULE_NAME_LEN))
+            break;
+      if (i == sizeof(boot_key_ram_modules) / sizeof(boot_key_ram_modules[0]))
+      {
+         memcpy(key + key_len, module, module_size);
+         key_len += module_size;
+      }
+      pos += module_size;
+   }
+
+   for (i = 0; i < sizeof(boot_key_ram_resources) / sizeof(boot_key_ram_resources[0]); i++)
+   {
+      value = 0;
+      resources_get_int(boot_key_ram_resources[i], &value);
+      memcpy(key + key_len, &value, sizeof(value));
+      key_len += sizeof(value);
+   }
+
+   crc = crc32_buf((const char *)key, (unsigned int)key_len);
+   free(key);
+   snapshot_free(snapshot);
+   snapshot_fclose(stream);
+   return crc;
+}
+
+/* Keeps the newest BOOT_CACHE_MAX images in dir, which ends with a separator */
+static void boot_cache_prune(const char *dir)
+{
+   char oldest[RETRO_PATH_MAX];
+   char path[RETRO_PATH_MAX];
+   struct dirent *dirp;
+   int64_t oldest_mtime, mtime;
+   DIR *cache_dir;
+   int count;
+
+   do
+   {
+      count        = 0;
+      oldest[0]    = '\0';
+      oldest_mtime = 0;
+
+      if (!(cache_dir = opendir(dir)))
+         return;
+      while ((dirp = readdir(cache_dir)) != NULL)
+      {
+         if (!strendswith(dirp->d_name, ".vsf"))
+            continue;
+
+         snprintf(path, sizeof(path), "%s%s", dir, dirp->d_name);
+         if (archdep_file_mtime(path, &mtime) < 0)
+            continue;
+         if (!count++ || mtime < oldest_mtime)
+         {
+            snprintf(oldest, sizeof(oldest), "%s", path);
+            oldest_mtime = mtime;
+         }
+      }
+      closedir(cache_dir);
+
+      if (count > BOOT_CACHE_MAX)
+      {
+         log_cb(RETRO_LOG_INFO, "Boot image '%s' pruned\n", oldest);
+         filestream_delete(oldest);
+      }
+   } while (count > BOOT_CACHE_MAX);
+}
+
+static void boot_save_trap(uint16_t addr, void *data)
+{
+   boot_image_t *image = (boot_image_t *)data;
+
+   image->data    = boot_snapshot_write(image->save_roms, &image->size);
+   image->success = image->data != NULL;
+   boot_trap_happened = 1;
+}
+
+static void boot_load_trap(uint16_t addr, void *data)
+{
+   boot_image_t *image = (boot_image_t *)data;
+   snapshot_stream_t *stream = snapshot_memory_read_fopen(image->data, image->size);
+
+   image->success = stream && machine_read_snapshot_from_stream(stream, 0) >= 0;
+   if (stream)
+      snapshot_fclose(stream);
+   boot_trap_happened = 1;
+}
+
+static void boot_trap_run(void (*trap)(uint16_t, void *), boot_image_t *image)
+{
+   boot_trap_happened = 0;
+   interrupt_maincpu_trigger_trap(trap, (void *)image);
+   while (!boot_trap_happened)
+      maincpu_mainloop();
+}
+
+/* Runs from power-on to where autostart would begin, or restores the same
+ * state from the cache, so that autostart can skip the reset */
+void retro_boot_cache(void)
+{
+   boot_image_t key   = {0};
+   boot_image_t image = {0};
+   char path[RETRO_PATH_MAX];
+   void *data         = NULL;
+   int64_t size       = 0;
+   CLOCK boot_clk     = 0;
+   int warp           = 0;
+   int i;
+
+   if (!opt_boot_cache)
+      return;
+
+   /* Cartridges reset the machine when attached */
+   for (i = 0; i < PARAMCOUNT; i++)
+      if (strstr(XARGV[i], "-cart") && XARGV[i][0] == '-')
+         return;
+
+   /* The first instruction also takes the power-on reset, which
+    * would undo a state loaded in the same trap */
+   key.save_roms = 1;
+   boot_trap_run(boot_save_trap, &key);
+   if (!key.success)
+      return;
+
+   snprintf(path, sizeof(path), "%s%s%s%s%s_%08x%08x.vsf",
+         retro_system_data_directory, FSDEV_DIR_SEP_STR, BOOT_CACHE_DIR, FSDEV_DIR_SEP_STR,
+         machine_get_name(), (unsigned)key.size, (unsigned)boot_key_crc(key.data, key.size));
+   free(key.data);
+
+   if (path_is_valid(path) && filestream_read_file(path, &data, &size) && size > 0)
+   {
+      image.data = (uint8_t *)data;
+      image.size = (size_t)size;
+      boot_trap_run(boot_load_trap, &image);
+      free(data);
+
+      if (image.success)
+      {
+         log_cb(RETRO_LOG_INFO, "Boot image restored from '%s'\n", path);
+         autostart_set_booted(1);
+         return;
+      }
+
+      /* Partially restored, back to a regular boot */
+      log_cb(RETRO_LOG_WARN, "Cannot restore boot image '%s'\n", path);
+      filestream_delete(path);
+      machine_trigger_reset(MACHINE_RESET_MODE_HARD);
+      return;
+   }
+   free(data);
+
+   /* Boot without rendering, and drop the audio meanwhile */
+   boot_clk = autostart_get_initial_delay();
+   resources_get_int("WarpMode", &warp);
+   resources_set_int("WarpMode", 1);
+   vsync_set_warp_render_next_frame(0);
+   while (maincpu_clk < boot_clk)
+      maincpu_mainloop();
+   vsync_set_warp_render_next_frame(-1);
+   resources_set_int("WarpMode", warp);
+   retro_renderloop = 1;
+   output_audio_buffer.size = 0;
+   autostart_set_booted(1);
+
+   image.save_roms = 0;
+   boot_trap_run(boot_save_trap, &image);
+   if (image.success)
+   {
+      char dir[RETRO_PATH_MAX];
+
+      snprintf(dir, sizeof(dir), "%s", path);
+      path_basedir(dir);
+      path_mkdir(dir);
+
+      if (filestream_write_file(path, image.data, image.size))
+      {
+         log_cb(RETRO_LOG_INFO, "Boot image cached to '%s'\n", path);
+         boot_cache_prune(dir);
+      }
+      else
+         log_cb(RETRO_LOG_WARN, "Cannot write boot image '%s'\n", path);
+   }
+   free(image.data);
+}
+
 void *retro_get_memory_data(unsigned id)
 {
    if (id == RETRO_MEMORY_SYSTEM_RAM)
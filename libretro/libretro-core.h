@@ -43,6 +43,9 @@ typedef uint8_t uint8;
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
 
 /* Screen */
 #if defined(__X128__)
@@ -121,6 +124,7 @@ extern unsigned short int pix_bytes;
 #define STATUSBAR_BASIC    0x04
 #define STATUSBAR_MINIMAL  0x08
 #define STATUSBAR_MESSAGES 0x10
+#define STATUSBAR_PERF     0x20
 
 /* Autoloadwarp */
 #define AUTOLOADWARP_DISK 0x01
@@ -146,6 +150,7 @@ extern unsigned int retro_region;
 extern int request_model_set;
 
 extern unsigned int retro_warpmode;
+extern bool updating_variables;
 extern bool audio_playing(void);
 extern unsigned int crop_id;
 extern int crop_id_prev;
@@ -222,7 +227,14 @@ enum
 
 /* Functions */
 extern long retro_ticks(void);
+extern void retro_warp_frame_end(void);
+extern void retro_startup_phase(const char *phase);
+extern void retro_boot_cache(void);
+extern void retro_profiler_update(void);
+extern void retro_trace_update(void);
 extern void reload_restart(void);
+extern int emu_model_startup(void);
+extern int ui_init_options(void);
 extern void emu_reset(int type);
 extern int RGBc(int r, int g, int b);
 extern void display_retro_message(const char *message);
@@ -262,7 +274,9 @@ struct vice_core_options
    int VirtualDevices;
    int DriveTrueEmulation;
    int DriveSoundEmulation;
+   int DriveAdaptiveRotation;
    int DatasetteSound;
+   int DatasetteAccelerate;
    int AudioLeak;
    int SoundSampleRate;
    int SidEngine;
@@ -18,6 +18,7 @@
 
 #include "libretro-dc.h"
 #include "libretro-core.h"
+#include "libretro-vfs.h"
 
 #include "archdep.h"
 #include "attach.h"
@@ -440,48 +441,34 @@ bool dc_replace_file(dc_storage* dc, int index, const char* filename)
          snprintf(nib_input, sizeof(nib_input), "%s", full_path_replace);
          snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_basename);
          path_mkdir(retro_temp_directory);
-         nib_convert(nib_input, nib_output);
+         nib_convert(nib_input, nib_output, false);
          snprintf(full_path_replace, sizeof(full_path_replace), "%s", nib_output);
       }
 
       /* ZIP */
       if (strendswith(full_path_replace, "zip") || strendswith(full_path_replace, "7z"))
       {
-         path_mkdir(retro_temp_directory);
          if (strendswith(full_path_replace, "zip"))
-            zip_uncompress(full_path_replace, retro_temp_directory, NULL);
+            zip_mount(full_path_replace, retro_temp_directory, NULL);
          else if (strendswith(full_path_replace, "7z"))
-            sevenzip_uncompress(full_path_replace, retro_temp_directory, NULL);
+            sevenzip_mount(full_path_replace, retro_temp_directory, NULL);
 
          /* Default to directory mode */
          snprintf(full_path_replace, sizeof(full_path_replace), "%s", retro_temp_directory);
 
-         FILE *zip_m3u;
          zip_m3u_t zip_m3u_list = {0};
          snprintf(zip_m3u_list.path, sizeof(zip_m3u_list.path), "%s%s%s.m3u",
                retro_temp_directory, FSDEV_DIR_SEP_STR, utf8_to_local_string_alloc(zip_basename));
 
-         DIR *zip_dir;
-         struct dirent *zip_dirp;
-
          /* Convert all NIBs to G64 */
-         zip_dir = opendir(retro_temp_directory);
-         while ((zip_dirp = readdir(zip_dir)) != NULL)
-         {
-            if (dc_get_image_type(zip_dirp->d_name) == DC_IMAGE_TYPE_NIBBLER)
-            {
-               snprintf(nib_input, sizeof(nib_input), "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_dirp->d_name);
-               snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, path_remove_extension(zip_dirp->d_name));
-               nib_convert(nib_input, nib_output);
-            }
-         }
-         closedir(zip_dir);
+         nib_convert_dir(retro_temp_directory, NULL);
 
          m3u_scan_recurse(retro_temp_directory, &zip_m3u_list);
 
          switch (zip_m3u_list.mode)
          {
             case 0: /* Extracted path */
+               vfs_materialize_all();
                dc_reset(dc);
                return true;
                break;
@@ -493,11 +480,7 @@ bool dc_replace_file(dc_storage* dc, int index, const char* filename)
                }
                else
                {
-                  zip_m3u = fopen(zip_m3u_list.path, "w");
-                  qsort(zip_m3u_list.list, zip_m3u_list.num, RETRO_PATH_MAX, qstrcmp);
-                  for (int l = 0; l < zip_m3u_list.num; l++)
-                     fprintf(zip_m3u, "%s\n", zip_m3u_list.list[l]);
-                  fclose(zip_m3u);
+                  m3u_mount_list(&zip_m3u_list);
                   snprintf(full_path_replace, sizeof(full_path_replace), "%s", zip_m3u_list.path);
                   log_cb(RETRO_LOG_INFO, "->M3U: %s\n", zip_m3u_list.path);
                }
@@ -947,7 +930,7 @@ void dc_parse_list(dc_storage* dc, const char* list_file, bool is_vfl, const cha
             snprintf(nib_input, sizeof(nib_input), "%s", file_path);
             snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_basename);
             path_mkdir(retro_temp_directory);
-            nib_convert(nib_input, nib_output);
+            nib_convert(nib_input, nib_output, true);
             snprintf(file_path, sizeof(file_path), "%s", nib_output);
          }
 
@@ -956,11 +939,10 @@ void dc_parse_list(dc_storage* dc, const char* list_file, bool is_vfl, const cha
          {
             char lastfile[RETRO_PATH_MAX] = {0};
 
-            path_mkdir(retro_temp_directory);
             if (strendswith(file_path, "zip"))
-               zip_uncompress(file_path, retro_temp_directory, lastfile);
+               zip_mount(file_path, retro_temp_directory, lastfile);
             else if (strendswith(file_path, "7z"))
-               sevenzip_uncompress(file_path, retro_temp_directory, lastfile);
+               sevenzip_mount(file_path, retro_temp_directory, lastfile);
 
             /* Convert all NIBs to G64 */
             if (!string_is_empty(browsed_file))
@@ -971,29 +953,14 @@ void dc_parse_list(dc_storage* dc, const char* list_file, bool is_vfl, const cha
                   /* Reuse lastfile */
                   snprintf(lastfile, sizeof(lastfile), "%s", browsed_file);
                   snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, path_remove_extension(lastfile));
-                  nib_convert(nib_input, nib_output);
+                  path_mkdir(retro_temp_directory);
+                  nib_convert(nib_input, nib_output, true);
                   snprintf(browsed_file, sizeof(browsed_file), "%s", path_basename(nib_output));
                }
                snprintf(lastfile, sizeof(lastfile), "%s", browsed_file);
             }
             else
-            {
-               DIR *zip_dir = NULL;
-               struct dirent *zip_dirp;
-
-               zip_dir = opendir(retro_temp_directory);
-               while ((zip_dirp = readdir(zip_dir)) != NULL)
-               {
-                  if (dc_get_image_type(zip_dirp->d_name) == DC_IMAGE_TYPE_NIBBLER)
-                  {
-                     snprintf(nib_input, sizeof(nib_input), "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, zip_dirp->d_name);
-                     snprintf(nib_output, sizeof(nib_output), "%s%s%s.g64", retro_temp_directory, FSDEV_DIR_SEP_STR, path_remove_extension(zip_dirp->d_name));
-                     nib_convert(nib_input, nib_output);
-                     snprintf(lastfile, sizeof(lastfile), "%s", path_basename(nib_output));
-                  }
-               }
-               closedir(zip_dir);
-            }
+               nib_convert_dir(retro_temp_directory, lastfile);
 
             snprintf(file_path, RETRO_PATH_MAX, "%s%s%s", retro_temp_directory, FSDEV_DIR_SEP_STR, lastfile);
          }
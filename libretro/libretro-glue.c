@@ -1,7 +1,13 @@
 #include "libretro-core.h"
 #include "encodings/utf.h"
 #include "streams/file_stream.h"
+#include "libretro-vfs.h"
 
+#ifdef HAVE_THREADS
+#include "rthreads/rthreads.h"
+#endif
+
+extern char retro_save_directory[RETRO_PATH_MAX];
 extern char retro_temp_directory[RETRO_PATH_MAX];
 extern retro_log_printf_t log_cb;
 
@@ -62,13 +68,15 @@ void remove_recurse(const char *path)
       archdep_rmdir(path);
 }
 
-void m3u_scan_recurse(const char *path, zip_m3u_t *list)
+static void m3u_scan_dir(const char *path, zip_m3u_t *list)
 {
    DIR *zip_dir;
    struct dirent *zip_dirp;
    char *zip_lastfile = {0};
 
    zip_dir = opendir(path);
+   if (zip_dir == NULL)
+      return;
 
    while ((zip_dirp = readdir(zip_dir)) != NULL)
    {
@@ -80,7 +88,7 @@ void m3u_scan_recurse(const char *path, zip_m3u_t *list)
       path_join(zip_fullpath, retro_temp_directory, zip_dirp->d_name);
       if (path_is_directory(zip_fullpath))
       {
-         m3u_scan_recurse(zip_fullpath, list);
+         m3u_scan_dir(zip_fullpath, list);
          continue;
       }
 
@@ -108,6 +116,95 @@ void m3u_scan_recurse(const char *path, zip_m3u_t *list)
    zip_lastfile = NULL;
 }
 
+/* Files written to disk, such as converted NIBs, are found by the directory
+ * scan, and archive members still in memory by going through the mounts */
+void m3u_scan_recurse(const char *path, zip_m3u_t *list)
+{
+   size_t len = strlen(path);
+   unsigned i;
+
+   m3u_scan_dir(path, list);
+
+   for (i = 0; i < vfs_file_count() && list->num < DC_MAX_SIZE; i++)
+   {
+      const char *file = vfs_file_path(i);
+
+      if (!file || strncmp(file, path, len) || file[len] != FSDEV_DIR_SEP_CHR
+       || !vfs_file_stat(file, NULL) || strendswith(file, ".m3u"))
+         continue;
+
+      /* Multi file mode, generate playlist */
+      if (dc_get_image_type(file) == DC_IMAGE_TYPE_FLOPPY
+       || dc_get_image_type(file) == DC_IMAGE_TYPE_TAPE
+       || dc_get_image_type(file) == DC_IMAGE_TYPE_MEM
+      )
+      {
+         const char *name = file + len + 1;
+
+         /* Relative to the root, full path in subdirectories */
+         if (strchr(name, FSDEV_DIR_SEP_CHR))
+            name = file;
+
+         list->mode = 1;
+         list->num++;
+         snprintf(list->list[list->num-1], RETRO_PATH_MAX, "%s", name);
+      }
+   }
+}
+
+/* Generated playlist is kept in memory next to the archive contents */
+void m3u_mount_list(zip_m3u_t *list)
+{
+   char *m3u;
+   size_t len = 0;
+   int l;
+
+   qsort(list->list, list->num, RETRO_PATH_MAX, qstrcmp);
+
+   m3u = (char *)malloc(list->num * RETRO_PATH_MAX + 1);
+   if (!m3u)
+      return;
+
+   for (l = 0; l < list->num; l++)
+      len += sprintf(m3u + len, "%s\n", list->list[l]);
+
+   vfs_file_add_data(list->path, m3u, len);
+#ifndef USE_LIBRETRO_VFS
+   vfs_file_materialize(list->path);
+#endif
+   free(m3u);
+}
+
+/* Converts the NIBs mounted directly below `path' to G64 next to them in
+ * the background, `lastfile' receives the name of the last one */
+void nib_convert_dir(const char *path, char *lastfile)
+{
+   size_t len = strlen(path);
+   unsigned i;
+
+   for (i = 0; i < vfs_file_count(); i++)
+   {
+      const char *file = vfs_file_path(i);
+      char nib_input[RETRO_PATH_MAX];
+      char nib_output[RETRO_PATH_MAX];
+
+      if (!file || strncmp(file, path, len) || file[len] != FSDEV_DIR_SEP_CHR
+       || strchr(file + len + 1, FSDEV_DIR_SEP_CHR)
+       || dc_get_image_type(file) != DC_IMAGE_TYPE_NIBBLER)
+         continue;
+
+      snprintf(nib_input, sizeof(nib_input), "%s", file);
+      snprintf(nib_output, sizeof(nib_output), "%s", file);
+      path_remove_extension(nib_output);
+      strlcat(nib_output, ".g64", sizeof(nib_output));
+
+      path_mkdir(path);
+      nib_convert(nib_input, nib_output, true);
+      if (lastfile)
+         snprintf(lastfile, RETRO_PATH_MAX, "%s", path_basename(nib_output));
+   }
+}
+
 void path_join(char* out, const char* basedir, const char* filename)
 {
    snprintf(out, RETRO_PATH_MAX, "%s%s%s", basedir, FSDEV_DIR_SEP_STR, filename);
@@ -207,15 +304,78 @@ char *first_file_in_dir(char *path)
 }
 
 /* zlib */
-void zip_uncompress(char *in, char *out, char *lastfile)
+typedef struct zip_archive_t
+{
+   unzFile uf;
+   unz_file_pos *pos;
+} zip_archive_t;
+
+static bool zip_load(void *handle, unsigned index, uint8_t **data, size_t *size)
+{
+   zip_archive_t *zip = (zip_archive_t *)handle;
+   unz_file_info file_info;
+   uint8_t *buf;
+   size_t done = 0;
+   int err;
+
+   if (unzGoToFilePos(zip->uf, &zip->pos[index]) != UNZ_OK
+    || unzGetCurrentFileInfo(zip->uf, &file_info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
+      return false;
+
+   err = unzOpenCurrentFilePassword(zip->uf, NULL);
+   if (err != UNZ_OK)
+   {
+      log_cb(RETRO_LOG_ERROR, "Unzip: Error %d with zipfile in unzOpenCurrentFilePassword\n", err);
+      return false;
+   }
+
+   buf = (uint8_t *)malloc(file_info.uncompressed_size ? file_info.uncompressed_size : 1);
+   if (buf == NULL)
+   {
+      log_cb(RETRO_LOG_ERROR, "Unzip: Error allocating memory\n");
+      unzCloseCurrentFile(zip->uf);
+      return false;
+   }
+
+   while (done < file_info.uncompressed_size)
+   {
+      err = unzReadCurrentFile(zip->uf, buf + done, file_info.uncompressed_size - done);
+      if (err <= 0)
+         break;
+      done += err;
+   }
+
+   if (err < 0 || done < file_info.uncompressed_size || unzCloseCurrentFile(zip->uf) != UNZ_OK)
+   {
+      log_cb(RETRO_LOG_ERROR, "Unzip: Error %d with zipfile in unzReadCurrentFile\n", err);
+      free(buf);
+      return false;
+   }
+
+   *data = buf;
+   *size = done;
+   return true;
+}
+
+static void zip_close(void *handle)
+{
+   zip_archive_t *zip = (zip_archive_t *)handle;
+
+   unzClose(zip->uf);
+   free(zip->pos);
+   free(zip);
+}
+
+/* Mounts the archive members below `out', they are uncompressed when opened */
+void zip_mount(char *in, char *out, char *lastfile)
 {
    uLong i;
    unz_global_info gi;
 
    unzFile uf           = NULL;
    char *in_local       = NULL;
-   const char* password = NULL;
-   int size_buf         = 8192;
+   zip_archive_t *zip   = NULL;
+   vfs_archive_t *archive;
    int err;
 
    in_local             = utf8_to_local_string_alloc(in);
@@ -224,7 +384,28 @@ void zip_uncompress(char *in, char *out, char *lastfile)
    free(in_local);
    in_local = NULL;
 
+   if (uf == NULL)
+   {
+      log_cb(RETRO_LOG_ERROR, "Unzip: Error opening %s\n", in);
+      return;
+   }
+
    err = unzGetGlobalInfo (uf, &gi);
+   zip = (zip_archive_t *)calloc(1, sizeof(zip_archive_t));
+   if (zip)
+      zip->pos = (unz_file_pos *)calloc(gi.number_entry ? gi.number_entry : 1, sizeof(unz_file_pos));
+   if (err != UNZ_OK || zip == NULL || zip->pos == NULL)
+   {
+      log_cb(RETRO_LOG_ERROR, "Unzip: Error allocating memory\n");
+      if (zip)
+         free(zip->pos);
+      free(zip);
+      unzClose(uf);
+      return;
+   }
+
+   zip->uf = uf;
+   archive = vfs_archive_add(zip, zip_load, zip_close);
 
    for (i = 0; i < gi.number_entry; i++)
    {
@@ -233,20 +414,12 @@ void zip_uncompress(char *in, char *out, char *lastfile)
       char* filename_withoutpath;
       char* p;
       unz_file_info file_info;
-      FILE *fout = NULL;
-      void* buf;
 
       filename_inzip[0]    = '\0';
       filename_withpath[0] = '\0';
 
-      buf = (void*)malloc(size_buf);
-      if (buf == NULL)
-      {
-         log_cb(RETRO_LOG_ERROR, "Unzip: Error allocating memory\n");
-         return;
-      }
-
       err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+      unzGetFilePos(uf, &zip->pos[i]);
       snprintf(filename_withpath, sizeof(filename_withpath), "%s%s%s", out, FSDEV_DIR_SEP_STR, filename_inzip);
       if ((dc_get_image_type(filename_inzip) == DC_IMAGE_TYPE_FLOPPY ||
            dc_get_image_type(filename_inzip) == DC_IMAGE_TYPE_TAPE) && lastfile != NULL)
@@ -260,75 +433,26 @@ void zip_uncompress(char *in, char *out, char *lastfile)
          p++;
       }
 
-      if ((*filename_withoutpath) == '\0')
+      /* Directories exist implicitly */
+      if ((*filename_withoutpath) != '\0' && !path_is_valid(filename_withpath))
       {
-         log_cb(RETRO_LOG_INFO, "Mkdir: %s\n", filename_withpath);
-         path_mkdir(filename_withpath);
-      }
-      else if (!path_is_valid(filename_withpath))
-      {
-         char* write_filename;
-         unsigned skip = 0;
-         unsigned x    = 0;
+         char* mount_filename;
+         unsigned x = 0;
 
-         write_filename = local_to_utf8_string_alloc(filename_withpath);
+         mount_filename = local_to_utf8_string_alloc(filename_withpath);
 
          /* Replace non-ascii chars with underscore */
          for (x = 128; x < 256; x++)
-            string_replace_all_chars(write_filename, x, '_');
-
-         err = unzOpenCurrentFilePassword(uf, password);
-         if (err != UNZ_OK)
-            log_cb(RETRO_LOG_ERROR, "Unzip: Error %d with zipfile in unzOpenCurrentFilePassword: %s\n", err, write_filename);
-
-         if ((skip == 0) && (err == UNZ_OK))
-         {
-            fout = fopen(write_filename, "wb");
-            if (fout == NULL)
-               log_cb(RETRO_LOG_ERROR, "Unzip: Error opening %s\n", write_filename);
-         }
-
-         if (fout != NULL)
-         {
-            log_cb(RETRO_LOG_INFO, "Unzip: %s\n", write_filename);
-
-            do
-            {
-               err = unzReadCurrentFile(uf, buf, size_buf);
-               if (err < 0)
-               {
-                  log_cb(RETRO_LOG_ERROR, "Unzip: Error %d with zipfile in unzReadCurrentFile\n", err);
-                  break;
-               }
-               if (err > 0)
-               {
-                  if (!fwrite(buf, err, 1, fout))
-                  {
-                     log_cb(RETRO_LOG_ERROR, "Unzip: Error writing extracted file %s\n", write_filename);
-                     err = UNZ_ERRNO;
-                     break;
-                  }
-               }
-            }
-            while (err > 0);
-            if (fout)
-               fclose(fout);
-         }
+            string_replace_all_chars(mount_filename, x, '_');
 
-         free(write_filename);
-         write_filename = NULL;
-
-         if (err == UNZ_OK)
-         {
-            err = unzCloseCurrentFile(uf);
-            if (err != UNZ_OK)
-               log_cb(RETRO_LOG_ERROR, "Unzip: Error %d with zipfile in unzCloseCurrentFile\n", err);
-         }
+         if (archive && vfs_file_add(mount_filename, file_info.uncompressed_size, archive, i))
+            log_cb(RETRO_LOG_INFO, "Unzip: %s\n", mount_filename);
          else
-            unzCloseCurrentFile(uf);
-      }
+            log_cb(RETRO_LOG_ERROR, "Unzip: Error mounting %s\n", mount_filename);
 
-      free(buf);
+         free(mount_filename);
+         mount_filename = NULL;
+      }
 
       if ((i + 1) < gi.number_entry)
       {
@@ -341,12 +465,13 @@ void zip_uncompress(char *in, char *out, char *lastfile)
       }
    }
 
-   if (uf)
-   {
-      unzCloseCurrentFile(uf);
-      unzClose(uf);
-      uf = NULL;
-   }
+   if (archive == NULL)
+      zip_close(zip);
+
+#ifndef USE_LIBRETRO_VFS
+   /* Streams only see members written to disk */
+   vfs_materialize_all();
+#endif
 }
 
 /* 7zip */
@@ -355,16 +480,13 @@ void zip_uncompress(char *in, char *out, char *lastfile)
 struct sevenzip_context_t
 {
    uint8_t *output;
+   size_t output_size;
    CFileInStream archiveStream;
    CLookToRead2 lookStream;
    ISzAlloc allocImp;
    ISzAlloc allocTempImp;
    CSzArEx db;
-   size_t temp_size;
    uint32_t block_index;
-   uint32_t parse_index;
-   uint32_t decompress_index;
-   uint32_t packIndex;
 };
 
 static void *sevenzip_stream_alloc_impl(ISzAllocPtr p, size_t size)
@@ -390,28 +512,76 @@ static void *sevenzip_stream_alloc_tmp_impl(ISzAllocPtr p, size_t size)
    return malloc(size);
 }
 
-void sevenzip_uncompress(char *in, char *out, char *lastfile)
+/* Solid blocks are kept uncompressed in the context,
+ * so members of the same block are only copied out */
+static bool sevenzip_load(void *handle, unsigned index, uint8_t **data, size_t *size)
 {
-   CFileInStream archiveStream;
-   CLookToRead2 lookStream;
-   ISzAlloc allocImp;
-   ISzAlloc allocTempImp;
-   CSzArEx db;
-   uint8_t *output      = 0;
-   int64_t outsize      = -1;
+   struct sevenzip_context_t *ctx = (struct sevenzip_context_t *)handle;
+   size_t offset                  = 0;
+   size_t outSizeProcessed        = 0;
+   SRes res;
+
+   /* C LZMA SDK does not support chunked extraction - see here:
+    * sourceforge.net/p/sevenzip/discussion/45798/thread/6fb59aaf/
+    * */
+   res = SzArEx_Extract(&ctx->db, &ctx->lookStream.vt, index, &ctx->block_index,
+         &ctx->output, &ctx->output_size, &offset, &outSizeProcessed,
+         &ctx->allocImp, &ctx->allocTempImp);
+
+   if (res != SZ_OK)
+   {
+      if (res == SZ_ERROR_UNSUPPORTED)
+         log_cb(RETRO_LOG_ERROR, "Un7ip: Decoder doesn't support this archive\n");
+      else if (res == SZ_ERROR_MEM)
+         log_cb(RETRO_LOG_ERROR, "Un7ip: Can not allocate memory\n");
+      else if (res == SZ_ERROR_CRC)
+         log_cb(RETRO_LOG_ERROR, "Un7ip: CRC error\n");
+      return false;
+   }
+
+   *data = (uint8_t *)malloc(outSizeProcessed ? outSizeProcessed : 1);
+   if (*data == NULL)
+      return false;
+
+   memcpy(*data, ctx->output + offset, outSizeProcessed);
+   *size = outSizeProcessed;
+   return true;
+}
+
+static void sevenzip_close(void *handle)
+{
+   struct sevenzip_context_t *ctx = (struct sevenzip_context_t *)handle;
+
+   IAlloc_Free(&ctx->allocImp, ctx->output);
+   SzArEx_Free(&ctx->db, &ctx->allocImp);
+   File_Close(&ctx->archiveStream.file);
+   free(ctx->lookStream.buf);
+   free(ctx);
+}
+
+/* Mounts the archive members below `out', they are uncompressed when opened */
+void sevenzip_mount(char *in, char *out, char *lastfile)
+{
+   struct sevenzip_context_t *ctx;
+   vfs_archive_t *archive = NULL;
+
+   ctx = (struct sevenzip_context_t *)calloc(1, sizeof(struct sevenzip_context_t));
+   if (!ctx)
+      return;
 
    /*These are the allocation routines.
     * Currently using the non-standard 7zip choices. */
-   allocImp.Alloc       = sevenzip_stream_alloc_impl;
-   allocImp.Free        = sevenzip_stream_free_impl;
-   allocTempImp.Alloc   = sevenzip_stream_alloc_tmp_impl;
-   allocTempImp.Free    = sevenzip_stream_free_impl;
+   ctx->allocImp.Alloc       = sevenzip_stream_alloc_impl;
+   ctx->allocImp.Free        = sevenzip_stream_free_impl;
+   ctx->allocTempImp.Alloc   = sevenzip_stream_alloc_tmp_impl;
+   ctx->allocTempImp.Free    = sevenzip_stream_free_impl;
+   ctx->block_index          = 0xFFFFFFFF;
 
-   lookStream.bufSize   = SEVENZIP_LOOKTOREAD_BUF_SIZE * sizeof(Byte);
-   lookStream.buf       = (Byte*)malloc(lookStream.bufSize);
+   ctx->lookStream.bufSize   = SEVENZIP_LOOKTOREAD_BUF_SIZE * sizeof(Byte);
+   ctx->lookStream.buf       = (Byte*)malloc(ctx->lookStream.bufSize);
 
-   if (!lookStream.buf)
-      lookStream.bufSize = 0;
+   if (!ctx->lookStream.buf)
+      ctx->lookStream.bufSize = 0;
 
 #if defined(_WIN32) && defined(USE_WINDOWS_FILE) && !defined(LEGACY_WIN32)
    if (!string_is_empty(in))
@@ -421,9 +591,11 @@ void sevenzip_uncompress(char *in, char *out, char *lastfile)
       if (pathW)
       {
          /* Could not open 7zip archive? */
-         if (InFile_OpenW(&archiveStream.file, pathW))
+         if (InFile_OpenW(&ctx->archiveStream.file, pathW))
          {
             free(pathW);
+            free(ctx->lookStream.buf);
+            free(ctx);
             return;
          }
 
@@ -432,39 +604,37 @@ void sevenzip_uncompress(char *in, char *out, char *lastfile)
    }
 #else
    /* Could not open 7zip archive? */
-   if (InFile_Open(&archiveStream.file, in))
+   if (InFile_Open(&ctx->archiveStream.file, in))
+   {
+      free(ctx->lookStream.buf);
+      free(ctx);
       return;
+   }
 #endif
 
-   FileInStream_CreateVTable(&archiveStream);
-   LookToRead2_CreateVTable(&lookStream, false);
-   lookStream.realStream = &archiveStream.vt;
-   LookToRead2_Init(&lookStream);
+   FileInStream_CreateVTable(&ctx->archiveStream);
+   LookToRead2_CreateVTable(&ctx->lookStream, false);
+   ctx->lookStream.realStream = &ctx->archiveStream.vt;
+   LookToRead2_Init(&ctx->lookStream);
    CrcGenerateTable();
 
-   memset(&db, 0, sizeof(db));
+   SzArEx_Init(&ctx->db);
 
-   SzArEx_Init(&db);
+   if (SzArEx_Open(&ctx->db, &ctx->lookStream.vt, &ctx->allocImp, &ctx->allocTempImp) == SZ_OK)
+      archive = vfs_archive_add(ctx, sevenzip_load, sevenzip_close);
 
-   if (SzArEx_Open(&db, &lookStream.vt, &allocImp, &allocTempImp) == SZ_OK)
+   if (archive)
    {
       uint32_t i;
       uint16_t *temp       = NULL;
       size_t temp_size     = 0;
-      uint32_t block_index = 0xFFFFFFFF;
-      SRes res             = SZ_OK;
-      size_t output_size   = 0;
 
-      for (i = 0; i < db.NumFiles; i++)
+      for (i = 0; i < ctx->db.NumFiles; i++)
       {
-         size_t j;
          size_t len;
          char infile[RETRO_PATH_MAX];
-         size_t offset                = 0;
-         size_t outSizeProcessed      = 0;
-         unsigned x;
 
-         len = SzArEx_GetFileNameUtf16(&db, i, NULL);
+         len = SzArEx_GetFileNameUtf16(&ctx->db, i, NULL);
 
          if (len > temp_size)
          {
@@ -475,94 +645,45 @@ void sevenzip_uncompress(char *in, char *out, char *lastfile)
 
             if (temp == 0)
             {
-               res = SZ_ERROR_MEM;
+               log_cb(RETRO_LOG_ERROR, "Un7ip: Can not allocate memory\n");
                break;
             }
          }
 
-         SzArEx_GetFileNameUtf16(&db, i, temp);
-         res       = SZ_ERROR_FAIL;
+         SzArEx_GetFileNameUtf16(&ctx->db, i, temp);
          infile[0] = '\0';
 
-         if (!temp)
+         if (!temp || !utf16_to_char_string(temp, infile, sizeof(infile)))
             break;
 
-         res = utf16_to_char_string(temp, infile, sizeof(infile))
-               ? SZ_OK : SZ_ERROR_FAIL;
-
-         /* C LZMA SDK does not support chunked extraction - see here:
-          * sourceforge.net/p/sevenzip/discussion/45798/thread/6fb59aaf/
-          * */
-         res = SzArEx_Extract(&db, &lookStream.vt, i, &block_index,
-               &output, &output_size, &offset, &outSizeProcessed,
-               &allocImp, &allocTempImp);
-
-         if (res != SZ_OK)
-            break; /* This goes to the error section. */
-
-         outsize = (int64_t)outSizeProcessed;
-
          char output_path[RETRO_PATH_MAX] = {0};
          snprintf(output_path, RETRO_PATH_MAX, "%s%s%s", out, FSDEV_DIR_SEP_STR, infile);
          if (dc_get_image_type(output_path) == DC_IMAGE_TYPE_FLOPPY && lastfile != NULL)
             snprintf(lastfile, RETRO_PATH_MAX, "%s", path_basename(output_path));
 
-#if 0
-         /* Replace non-ascii chars with underscore */
-         for (x = 128; x < 256; x++)
-            string_replace_all_chars(output_path, x, '_');
-#endif
-
-         for (j = 0; output_path[j] != 0; j++)
-         {
-            if (output_path[j] == '/')
-            {
-               output_path[j] = 0;
-               path_mkdir((const char *)output_path);
-               output_path[j] = FSDEV_DIR_SEP_CHR;
-            }
-         }
-
-         const void *ptr = (const void*)(output + offset);
-
-         if (path_is_valid(output_path))
-            continue;
-         else if (SzArEx_IsDir(&db, i))
-         {
-            path_mkdir((const char *)temp);
-            log_cb(RETRO_LOG_INFO, "Mkdir: %s\n", output_path);
+         /* Directories exist implicitly */
+         if (path_is_valid(output_path) || SzArEx_IsDir(&ctx->db, i))
             continue;
-         }
 
-         if (filestream_write_file(output_path, ptr, outsize))
-         {
-            res = SZ_OK;
+         if (vfs_file_add(output_path, SzArEx_GetFileSize(&ctx->db, i), archive, i))
             log_cb(RETRO_LOG_INFO, "Un7ip: %s\n", output_path);
-         }
          else
-         {
-            res = SZ_ERROR_FAIL;
-            log_cb(RETRO_LOG_ERROR, "Un7ip: Error writing extracted file %s\n", output_path);
-         }
+            log_cb(RETRO_LOG_ERROR, "Un7ip: Error mounting %s\n", output_path);
       }
 
       if (temp)
          free(temp);
-      IAlloc_Free(&allocImp, output);
-
-      if (res == SZ_ERROR_UNSUPPORTED)
-         log_cb(RETRO_LOG_ERROR, "Un7ip: Decoder doesn't support this archive\n");
-      else if (res == SZ_ERROR_MEM)
-         log_cb(RETRO_LOG_ERROR, "Un7ip: Can not allocate memory\n");
-      else if (res == SZ_ERROR_CRC)
-         log_cb(RETRO_LOG_ERROR, "Un7ip: CRC error\n");
    }
+   else
+      sevenzip_close(ctx);
 
-   SzArEx_Free(&db, &allocImp);
-   File_Close(&archiveStream.file);
+#ifndef USE_LIBRETRO_VFS
+   /* Streams only see members written to disk */
+   vfs_materialize_all();
+#endif
 }
 #else
-void sevenzip_uncompress(char *in, char *out, char *lastfile)
+void sevenzip_mount(char *in, char *out, char *lastfile)
 {
 }
 #endif
@@ -581,7 +702,6 @@ typedef unsigned char __u_char;
 #define printf(format, ...) log_cb(RETRO_LOG_INFO, format, __VA_ARGS__)
 char log_output[512] = {0};
 
-BYTE compressed_buffer[(MAX_HALFTRACKS_1541 + 2) * NIB_TRACK_LENGTH];
 BYTE file_buffer[(MAX_HALFTRACKS_1541 + 2) * NIB_TRACK_LENGTH];
 BYTE track_buffer[(MAX_HALFTRACKS_1541 + 2) * NIB_TRACK_LENGTH];
 BYTE track_density[MAX_HALFTRACKS_1541 + 2];
@@ -624,28 +744,18 @@ int backwards=0;
 bool skip_compress_halftrack = true;
 unsigned int skip_compress_halftrack_density = 2;
 
-int write_dword(FILE * fd, unsigned int * buf, int num)
+static int write_dword_mem(BYTE *out, unsigned int * buf, int num)
 {
 	int i;
-	BYTE *tmpbuf;
-
-	tmpbuf = malloc(num);
 
 	for (i = 0; i < (num / 4); i++)
 	{
-		tmpbuf[i * 4] = buf[i] & 0xff;
-		tmpbuf[i * 4 + 1] = (buf[i] >> 8) & 0xff;
-		tmpbuf[i * 4 + 2] = (buf[i] >> 16) & 0xff;
-		tmpbuf[i * 4 + 3] = (buf[i] >> 24) & 0xff;
-	}
-
-	if (fwrite(tmpbuf, num, 1, fd) < 1)
-	{
-		free(tmpbuf);
-		return -1;
+		out[i * 4] = buf[i] & 0xff;
+		out[i * 4 + 1] = (buf[i] >> 8) & 0xff;
+		out[i * 4 + 2] = (buf[i] >> 16) & 0xff;
+		out[i * 4 + 3] = (buf[i] >> 24) & 0xff;
 	}
-	free(tmpbuf);
-	return 0;
+	return num;
 }
 
 int compare_extension(unsigned char * filename, unsigned char * extension)
@@ -666,33 +776,6 @@ int compare_extension(unsigned char * filename, unsigned char * extension)
 		return (0);
 }
 
-int load_file(char *filename, BYTE *file_buffer)
-{
-	int size;
-	FILE *fpin;
-
-	if (verbose) printf("Loading \"%s\"...\n", filename);
-
-	if ((fpin = fopen(filename, "rb")) == NULL)
-	{
-		printf("Couldn't open input file %s!\n", filename);
-		return 0;
-	}
-
-	fseek(fpin, 0, SEEK_END);
-	size = ftell(fpin);
-	rewind(fpin);
-
-	if (fread(file_buffer, size, 1, fpin) != 1) {
-		printf("%s", "unable to read file\n");
-		return 0;
-	}
-
-	if (verbose) printf("Successfully loaded %d bytes.\n", size);
-	fclose(fpin);
-	return size;
-}
-
 int read_nib(BYTE *file_buffer, int file_buffer_size, BYTE *track_buffer, BYTE *track_density, size_t *track_length)
 {
 	int track, t_index=0, h_index=0;
@@ -762,7 +845,10 @@ int align_tracks(BYTE *track_buffer, BYTE *track_density, size_t *track_length,
 	return 1;
 }
 
-int write_g64(char *filename, BYTE *track_buffer, BYTE *track_density, size_t *track_length)
+/* Largest G64 written below, with every halftrack stored */
+#define G64_SIZE_MAX (0xc + (MAX_TRACKS_1541 * 16) + (MAX_HALFTRACKS_1541 * (7928 + 2)))
+
+static int write_g64_mem(BYTE *g64, size_t *g64_size, BYTE *track_buffer, BYTE *track_density, size_t *track_length)
 {
 	/* writes contents of buffers into G64 file, with header and density information */
 
@@ -781,23 +867,12 @@ int write_g64(char *filename, BYTE *track_buffer, BYTE *track_density, size_t *t
 	size_t track_len, badgcr;
 	/*size_t skewbytes=0; */
 	int index=0, track, added_sync=0, addsyncloops;
-	FILE * fpout;
+	size_t pos = 0;
 	BYTE buffer[NIB_TRACK_LENGTH];
 	size_t raw_track_size[4] = { 6250, 6666, 7142, 7692 };
 	/*char errorstring[0x1000]; */
 
-#if 0
-	printf("%s", "Writing G64 file...\n");
-#else
-	log_cb(RETRO_LOG_INFO, "->G64: %s\n", filename);
-#endif
-
-	fpout = fopen(filename, "wb");
-	if (fpout == NULL)
-	{
-		printf("Cannot open G64 image %s.\n", filename);
-		return 0;
-	}
+	if (verbose) printf("%s", "Writing G64 file...\n");
 
 	/* determine max track size (VICE still can't handle) */
 #if 0
@@ -817,11 +892,8 @@ int write_g64(char *filename, BYTE *track_buffer, BYTE *track_density, size_t *t
 	header[10] = (BYTE) (G64_TRACK_MAXLEN % 256);	/* Size of each stored track */
 	header[11] = (BYTE) (G64_TRACK_MAXLEN / 256);
 
-	if (fwrite(header, sizeof(header), 1, fpout) != 1)
-	{
-		printf("%s", "Cannot write G64 header.\n");
-		return 0;
-	}
+	memcpy(g64 + pos, header, sizeof(header));
+	pos += sizeof(header);
 
 	/* Create track and speed tables */
 	for (track = 0; track < MAX_HALFTRACKS_1541; track +=track_inc)
@@ -834,17 +906,8 @@ int write_g64(char *filename, BYTE *track_buffer, BYTE *track_density, size_t *t
 	}
 
 	/* write headers */
-	if (write_dword(fpout, gcr_track_p, sizeof(gcr_track_p)) < 0)
-	{
-		printf("%s", "Cannot write track header.\n");
-		return 0;
-	}
-
-	if (write_dword(fpout, gcr_speed_p, sizeof(gcr_speed_p)) < 0)
-	{
-		printf("%s", "Cannot write speed header.\n");
-		return 0;
-	}
+	pos += write_dword_mem(g64 + pos, gcr_track_p, sizeof(gcr_track_p));
+	pos += write_dword_mem(g64 + pos, gcr_speed_p, sizeof(gcr_speed_p));
 
 	/* shuffle raw GCR between formats */
 	for (track = 2; track <= MAX_HALFTRACKS_1541+1; track +=track_inc)
@@ -938,13 +1001,10 @@ int write_g64(char *filename, BYTE *track_buffer, BYTE *track_density, size_t *t
 
 		if (verbose) printf("%s\n", log_output);
 
-		if (fwrite(gcr_track, (G64_TRACK_MAXLEN + 2), 1, fpout) != 1)
-		{
-			printf("%s", "Cannot write G64 track data.\n");
-			return 0;
-		}
+		memcpy(g64 + pos, gcr_track, (G64_TRACK_MAXLEN + 2));
+		pos += G64_TRACK_MAXLEN + 2;
 	}
-	fclose(fpout);
+	*g64_size = pos;
 	if (verbose) printf("%s", "Successfully saved G64 file\n");
 	return 1;
 }
@@ -1014,9 +1074,10 @@ size_t compress_halftrack(int halftrack, BYTE *track_buffer, BYTE density, size_
 	return length;
 }
 
-int nib_convert(char *in, char *out)
+/* Converts NIB or NBZ data to a malloc'ed G64. Not reentrant, the
+ * converter works on the global buffers above */
+static int nib_convert_data(BYTE *data, size_t size, int nbz, BYTE **g64, size_t *g64_size)
 {
-	char inname[256], outname[256];
 	int t;
 
 	start_track = 1 * 2;
@@ -1039,37 +1100,378 @@ int nib_convert(char *in, char *out)
 		track_length[t] = NIB_TRACK_LENGTH; /* I do not recall why this was done, but left at MAX */
 
 	/* clear heap buffers */
-	memset(compressed_buffer, 0x00, sizeof(compressed_buffer));
 	memset(file_buffer, 0x00, sizeof(file_buffer));
 	memset(track_buffer, 0x00, sizeof(track_buffer));
 
-	snprintf(inname, sizeof(inname), "%s", local_to_utf8_string_alloc(in));
-	snprintf(outname, sizeof(outname), "%s", local_to_utf8_string_alloc(out));
+	if (size > sizeof(file_buffer)) return 0;
 
 	/* convert */
-	if (compare_extension((unsigned char *)inname, (unsigned char *)"NIB"))
+	if (nbz)
 	{
-		if(!(file_buffer_size = load_file(inname, file_buffer))) return 0;
-		if(!(read_nib(file_buffer, file_buffer_size, track_buffer, track_density, track_length))) return 0;
-		if( (compare_extension((unsigned char *)outname, (unsigned char *)"G64")) || (compare_extension((unsigned char *)outname, (unsigned char *)"D64")) )
-			align_tracks(track_buffer, track_density, track_length, track_alignment);
-		search_fat_tracks(track_buffer, track_density, track_length);
+		if(!(file_buffer_size = LZ_Uncompress(data, file_buffer, size))) return 0;
 	}
-	else if (compare_extension((unsigned char *)inname, (unsigned char *)"NBZ"))
+	else
 	{
-		if(!(file_buffer_size = load_file(inname, compressed_buffer))) return 0;
-		if(!(file_buffer_size = LZ_Uncompress(compressed_buffer, file_buffer, file_buffer_size))) return 0;
-		if(!(read_nib(file_buffer, file_buffer_size, track_buffer, track_density, track_length))) return 0;
-		if( (compare_extension((unsigned char *)outname, (unsigned char *)"G64")) || (compare_extension((unsigned char *)outname, (unsigned char *)"D64")) )
-			align_tracks(track_buffer, track_density, track_length, track_alignment);
-		search_fat_tracks(track_buffer, track_density, track_length);
+		memcpy(file_buffer, data, size);
+		file_buffer_size = size;
 	}
+	if(!(read_nib(file_buffer, file_buffer_size, track_buffer, track_density, track_length))) return 0;
+	align_tracks(track_buffer, track_density, track_length, track_alignment);
+	search_fat_tracks(track_buffer, track_density, track_length);
 
-	if (compare_extension((unsigned char *)outname, (unsigned char *)"G64"))
+	if(skip_halftracks) track_inc = 2;
+	if(!(*g64 = (BYTE *)malloc(G64_SIZE_MAX))) return 0;
+	if(!(write_g64_mem(*g64, g64_size, track_buffer, track_density, track_length)))
 	{
-		if(skip_halftracks) track_inc = 2;
-		if(!(write_g64(outname, track_buffer, track_density, track_length))) return 0;
+		free(*g64);
+		*g64 = NULL;
+		return 0;
 	}
 
 	return 1;
 }
+
+/* Conversions are kept in the save directory by content hash, and the
+ * ones of disks not inserted yet are mounted as placeholders that the
+ * worker thread fills in. The revision seeds the hash, so bump it when
+ * the converter output changes */
+#define NIB_CACHE_DIR      "nib2g64"
+#define NIB_CACHE_REVISION 1
+
+enum nib_job_state
+{
+   NIB_JOB_QUEUED = 0,
+   NIB_JOB_RUNNING,
+   NIB_JOB_DONE
+};
+
+typedef struct nib_job
+{
+   BYTE *data;
+   size_t size;
+   int nbz;
+   BYTE *g64;
+   size_t g64_size;
+   bool wanted;
+   enum nib_job_state state;
+   char cache_path[RETRO_PATH_MAX];
+} nib_job_t;
+
+static struct
+{
+   nib_job_t **jobs;
+   unsigned num;
+   unsigned max;
+   vfs_archive_t *archive;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;             /* signalled when jobs are queued, wanted or done */
+   bool quit;
+   bool failed;
+#endif
+} nib_worker;
+
+static void nib_job_convert(nib_job_t *job)
+{
+   if (!nib_convert_data(job->data, job->size, job->nbz, &job->g64, &job->g64_size))
+      job->g64 = NULL;
+   free(job->data);
+   job->data = NULL;
+}
+
+static void nib_cache_write(const nib_job_t *job)
+{
+   char dir[RETRO_PATH_MAX];
+
+   snprintf(dir, sizeof(dir), "%s", job->cache_path);
+   path_basedir(dir);
+   path_mkdir(dir);
+
+   if (!filestream_write_file(job->cache_path, job->g64, job->g64_size))
+      log_cb(RETRO_LOG_WARN, "Cannot write G64 cache '%s'\n", job->cache_path);
+}
+
+#ifdef HAVE_THREADS
+static void nib_worker_thread(void *arg)
+{
+   slock_lock(nib_worker.lock);
+   while (!nib_worker.quit)
+   {
+      nib_job_t *job = NULL;
+      unsigned i;
+
+      /* Disks being inserted first, otherwise in queue order */
+      for (i = 0; i < nib_worker.num; i++)
+      {
+         nib_job_t *next = nib_worker.jobs[i];
+
+         if (!next || next->state != NIB_JOB_QUEUED)
+            continue;
+         if (!job || next->wanted)
+            job = next;
+         if (job->wanted)
+            break;
+      }
+
+      if (!job)
+      {
+         scond_wait(nib_worker.cond, nib_worker.lock);
+         continue;
+      }
+
+      job->state = NIB_JOB_RUNNING;
+      slock_unlock(nib_worker.lock);
+
+      nib_job_convert(job);
+
+      slock_lock(nib_worker.lock);
+      job->state = NIB_JOB_DONE;
+      scond_broadcast(nib_worker.cond);
+   }
+   slock_unlock(nib_worker.lock);
+}
+
+static void nib_worker_start(void)
+{
+   if (nib_worker.thread || nib_worker.failed)
+      return;
+
+   nib_worker.lock = slock_new();
+   nib_worker.cond = scond_new();
+   nib_worker.quit = false;
+   if (nib_worker.lock && nib_worker.cond)
+      nib_worker.thread = sthread_create(nib_worker_thread, NULL);
+
+   if (!nib_worker.thread)
+   {
+      log_cb(RETRO_LOG_WARN, "Cannot start NIB conversion thread\n");
+      nib_worker.failed = true;
+      if (nib_worker.lock)
+         slock_free(nib_worker.lock);
+      if (nib_worker.cond)
+         scond_free(nib_worker.cond);
+      nib_worker.lock = NULL;
+      nib_worker.cond = NULL;
+   }
+}
+#endif
+
+/* Converts the job right away, or waits for the worker to do it */
+static void nib_job_finish(nib_job_t *job)
+{
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+   {
+      slock_lock(nib_worker.lock);
+      job->wanted = true;
+      scond_broadcast(nib_worker.cond);
+      while (job->state != NIB_JOB_DONE)
+         scond_wait(nib_worker.cond, nib_worker.lock);
+      slock_unlock(nib_worker.lock);
+      return;
+   }
+#endif
+   if (job->state == NIB_JOB_QUEUED)
+   {
+      nib_job_convert(job);
+      job->state = NIB_JOB_DONE;
+   }
+}
+
+/* Placeholder opened, the converted G64 is handed over to the mount */
+static bool nib_job_load(void *handle, unsigned index, uint8_t **data, size_t *size)
+{
+   nib_job_t *job = nib_worker.jobs[index];
+
+   if (!job)
+      return false;
+
+   nib_job_finish(job);
+   if (!job->g64)
+      return false;
+
+   nib_cache_write(job);
+   *data    = job->g64;
+   *size    = job->g64_size;
+   job->g64 = NULL;
+   return true;
+}
+
+/* Unmounted, conversions still queued are dropped and finished ones
+ * not opened yet go to the cache */
+static void nib_jobs_close(void *handle)
+{
+   unsigned i;
+
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+   {
+      slock_lock(nib_worker.lock);
+      nib_worker.quit = true;
+      scond_broadcast(nib_worker.cond);
+      slock_unlock(nib_worker.lock);
+
+      sthread_join(nib_worker.thread);
+      slock_free(nib_worker.lock);
+      scond_free(nib_worker.cond);
+      nib_worker.thread = NULL;
+      nib_worker.lock   = NULL;
+      nib_worker.cond   = NULL;
+   }
+#endif
+
+   for (i = 0; i < nib_worker.num; i++)
+   {
+      nib_job_t *job = nib_worker.jobs[i];
+
+      if (!job)
+         continue;
+      if (job->state == NIB_JOB_DONE && job->g64)
+         nib_cache_write(job);
+      free(job->data);
+      free(job->g64);
+      free(job);
+   }
+   free(nib_worker.jobs);
+   nib_worker.jobs    = NULL;
+   nib_worker.num     = 0;
+   nib_worker.max     = 0;
+   nib_worker.archive = NULL;
+}
+
+static int nib_job_add(nib_job_t *job)
+{
+   int index = -1;
+
+   if (!nib_worker.archive)
+      nib_worker.archive = vfs_archive_add(NULL, nib_job_load, nib_jobs_close);
+   if (!nib_worker.archive)
+      return -1;
+
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+      slock_lock(nib_worker.lock);
+#endif
+   if (nib_worker.num == nib_worker.max)
+   {
+      unsigned max    = nib_worker.max ? nib_worker.max * 2 : 16;
+      nib_job_t **p   = (nib_job_t **)realloc(nib_worker.jobs, max * sizeof(nib_job_t *));
+
+      if (p)
+      {
+         nib_worker.jobs = p;
+         nib_worker.max  = max;
+      }
+   }
+   if (nib_worker.num < nib_worker.max)
+   {
+      index = nib_worker.num++;
+      nib_worker.jobs[index] = job;
+   }
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+   {
+      scond_broadcast(nib_worker.cond);
+      slock_unlock(nib_worker.lock);
+   }
+#endif
+   return index;
+}
+
+static void nib_mount(const char *out, const void *g64, size_t size)
+{
+   vfs_file_add_data(out, g64, size);
+#ifndef USE_LIBRETRO_VFS
+   /* Streams only see files written to disk */
+   vfs_file_materialize(out);
+#endif
+}
+
+/* Converts NIB `in' to G64 `out' in memory, unless the cache has it.
+ * In the background `out' is mounted before conversion, and opening it
+ * waits for the worker */
+bool nib_convert(const char *in, const char *out, bool background)
+{
+   void *data       = NULL;
+   void *g64        = NULL;
+   int64_t size     = 0;
+   int64_t g64_size = 0;
+   nib_job_t *job   = NULL;
+   int index        = -1;
+   bool ret         = false;
+
+   if (!filestream_read_file(in, &data, &size) || size <= 0)
+   {
+      log_cb(RETRO_LOG_ERROR, "Cannot read NIB '%s'\n", in);
+      free(data);
+      return false;
+   }
+
+   job = (nib_job_t *)calloc(1, sizeof(nib_job_t));
+   if (!job)
+   {
+      free(data);
+      return false;
+   }
+   job->data = (BYTE *)data;
+   job->size = (size_t)size;
+   job->nbz  = compare_extension((unsigned char *)in, (unsigned char *)"NBZ");
+   snprintf(job->cache_path, sizeof(job->cache_path), "%s%s%s%s%08x%08x.g64",
+         retro_save_directory, FSDEV_DIR_SEP_STR, NIB_CACHE_DIR, FSDEV_DIR_SEP_STR,
+         (unsigned)job->size, (unsigned)crc32(NIB_CACHE_REVISION, job->data, job->size));
+
+   if (path_is_valid(job->cache_path) && filestream_read_file(job->cache_path, &g64, &g64_size) && g64_size > 0)
+   {
+      log_cb(RETRO_LOG_INFO, "->G64: %s (cached)\n", out);
+      nib_mount(out, g64, (size_t)g64_size);
+      free(g64);
+      free(job->data);
+      free(job);
+      return true;
+   }
+   free(g64);
+
+   index = nib_job_add(job);
+   if (index < 0)
+   {
+      free(job->data);
+      free(job);
+      return false;
+   }
+
+#ifdef USE_LIBRETRO_VFS
+   if (background)
+   {
+      log_cb(RETRO_LOG_INFO, "->G64: %s (queued)\n", out);
+#ifdef HAVE_THREADS
+      nib_worker_start();
+#endif
+      return vfs_file_add(out, G64_SIZE_MAX, nib_worker.archive, index);
+   }
+#endif
+
+   log_cb(RETRO_LOG_INFO, "->G64: %s\n", out);
+   nib_job_finish(job);
+   if (job->g64)
+   {
+      nib_cache_write(job);
+      nib_mount(out, job->g64, job->g64_size);
+      ret = true;
+   }
+
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+      slock_lock(nib_worker.lock);
+#endif
+   nib_worker.jobs[index] = NULL;
+#ifdef HAVE_THREADS
+   if (nib_worker.thread)
+      slock_unlock(nib_worker.lock);
+#endif
+
+   free(job->g64);
+   free(job);
+   return ret;
+}
+
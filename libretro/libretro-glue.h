@@ -5,7 +5,7 @@
 /* zlib */
 #include "deps/libz/zlib.h"
 #include "deps/libz/unzip.h"
-void zip_uncompress(char *in, char *out, char *lastfile);
+void zip_mount(char *in, char *out, char *lastfile);
 
 /* 7z */
 #include "deps/7zip/7z.h"
@@ -13,15 +13,17 @@ void zip_uncompress(char *in, char *out, char *lastfile);
 #include "deps/7zip/7zCrc.h"
 #include "deps/7zip/7zFile.h"
 #include "deps/7zip/7zTypes.h"
-void sevenzip_uncompress(char *in, char *out, char *lastfile);
+void sevenzip_mount(char *in, char *out, char *lastfile);
 
 /* NIBTOOLS */
-int nib_convert(char *in, char *out);
+bool nib_convert(const char *in, const char *out, bool background);
+void nib_convert_dir(const char *path, char *lastfile);
 
 /* Misc */
 int qstrcmp(const void *a, const void *b);
 void remove_recurse(const char *path);
 void m3u_scan_recurse(const char *path, zip_m3u_t *list);
+void m3u_mount_list(zip_m3u_t *list);
 
 /* String helpers functions */
 char* trimwhitespace(char *str);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include <math.h>
 
 #include "libretro-core.h"
@@ -17,6 +18,29 @@ static uint32_t *linesurf32 = NULL;
 static int linesurf32_w     = 0;
 static int linesurf32_h     = 0;
 
+/* Layer currently recording the draw calls instead of drawing them */
+static libretro_graph_layer_t *graph_layer = NULL;
+
+typedef enum {
+   GRAPH_OP_FBOX = 0,
+   GRAPH_OP_BOX,
+   GRAPH_OP_HLINE,
+   GRAPH_OP_VLINE,
+   GRAPH_OP_TEXT
+} libretro_graph_op_t;
+
+typedef struct {
+   int op;
+   int x, y, dx, dy;
+   int width, height;
+   uint32_t fg, bg;
+   int alpha, draw_bg;
+   int scalex, scaley;
+   int max, len;
+} libretro_graph_cmd_t;
+
+static void graph_layer_record(libretro_graph_cmd_t *cmd, const unsigned char *string);
+
 int RGBc(int r, int g, int b)
 {
    if (pix_bytes == 4)
@@ -63,6 +87,13 @@ int RGBc(int r, int g, int b)
 
 void draw_fbox(int x, int y, int dx, int dy, uint32_t color, libretro_graph_alpha_t alpha)
 {
+   if (graph_layer)
+   {
+      libretro_graph_cmd_t cmd = {GRAPH_OP_FBOX, x, y, dx, dy, 0, 0, color, 0, alpha};
+      graph_layer_record(&cmd, NULL);
+      return;
+   }
+
    if (pix_bytes == 4)
       draw_fbox_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color, alpha);
    else
@@ -190,6 +221,13 @@ void draw_fbox_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, uint32_t co
 
 void draw_box(int x, int y, int dx, int dy, int width, int height, uint32_t color, libretro_graph_alpha_t alpha)
 {
+   if (graph_layer)
+   {
+      libretro_graph_cmd_t cmd = {GRAPH_OP_BOX, x, y, dx, dy, width, height, color, 0, alpha};
+      graph_layer_record(&cmd, NULL);
+      return;
+   }
+
    if (pix_bytes == 4)
       draw_box_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, width, height, color, alpha);
    else
@@ -568,6 +606,13 @@ void draw_box_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, int width, i
 
 void draw_hline(int x, int y, int dx, int dy, uint32_t color)
 {
+   if (graph_layer)
+   {
+      libretro_graph_cmd_t cmd = {GRAPH_OP_HLINE, x, y, dx, dy, 0, 0, color};
+      graph_layer_record(&cmd, NULL);
+      return;
+   }
+
    if (pix_bytes == 4)
       draw_hline_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color);
    else
@@ -606,6 +651,13 @@ void draw_hline_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, uint32_t c
 
 void draw_vline(int x, int y, int dx, int dy, uint32_t color)
 {
+   if (graph_layer)
+   {
+      libretro_graph_cmd_t cmd = {GRAPH_OP_VLINE, x, y, dx, dy, 0, 0, color};
+      graph_layer_record(&cmd, NULL);
+      return;
+   }
+
    if (pix_bytes == 4)
       draw_vline_bmp32((uint32_t *)retro_bmp, x, y, dx, dy, color);
    else
@@ -1226,6 +1278,14 @@ void draw_text(uint16_t x, uint16_t y,
       uint32_t fgcol, uint32_t bgcol, libretro_graph_alpha_t alpha, libretro_graph_bg_t draw_bg,
       uint8_t scalex, uint8_t scaley, uint16_t max, const unsigned char *string)
 {
+   if (graph_layer)
+   {
+      libretro_graph_cmd_t cmd = {GRAPH_OP_TEXT, x, y, 0, 0, 0, 0, fgcol, bgcol, alpha, draw_bg, scalex, scaley, max};
+      if (string)
+         graph_layer_record(&cmd, string);
+      return;
+   }
+
    if (pix_bytes == 4)
       draw_text_bmp32((uint32_t *)retro_bmp, x, y, fgcol, bgcol, alpha, draw_bg, scalex, scaley, max, string);
    else
@@ -1376,8 +1436,324 @@ void draw_text_bmp32(uint32_t *buffer, uint16_t x, uint16_t y,
 #endif
 }
 
+/* Overlay layers: the draw calls of an overlay are recorded between
+ * libretro_graph_layer_begin() and libretro_graph_layer_end(), and only
+ * rasterized when they differ from the previous frame. Rasterizing over
+ * black and over white gives the premultiplied overlay color and the
+ * remaining weight of the underlying pixel, which is then blended onto
+ * retro_bmp with a single pass per frame. */
+#define GRAPH_LAYER_BUFFER_SIZE (RETRO_BMP_SIZE * sizeof(unsigned short int))
+#define GRAPH_LAYER_KEEP_SHIFT  7
+#define GRAPH_LAYER_KEEP_ALL    (1 << GRAPH_LAYER_KEEP_SHIFT)
+#define GRAPH_LAYER_KEEP_HALF   (1 << (GRAPH_LAYER_KEEP_SHIFT - 1))
+
+static void *graph_layer_white = NULL;
+
+/* Area a draw call may touch, with room for text outlines and shadows */
+static void graph_layer_bounds(libretro_graph_layer_t *layer,
+      const libretro_graph_cmd_t *cmd, const unsigned char *string)
+{
+   int x0 = cmd->x, y0 = cmd->y, x1, y1;
+   int lines = 1;
+   int i;
+
+   switch (cmd->op)
+   {
+      case GRAPH_OP_BOX:
+         x1 = cmd->x + cmd->dx + cmd->width;
+         y1 = cmd->y + cmd->dy + cmd->height;
+         break;
+      case GRAPH_OP_HLINE:
+         x1 = cmd->x + cmd->dx;
+         y1 = cmd->y + 1;
+         break;
+      case GRAPH_OP_VLINE:
+         x1 = cmd->x + 1;
+         y1 = cmd->y + cmd->dy;
+         break;
+      case GRAPH_OP_TEXT:
+         for (i = 0; i < cmd->len; i++)
+            if (string[i] == '\1')
+               lines++;
+         x0 = cmd->x - 2 * cmd->scalex;
+         y0 = cmd->y - 2 * cmd->scaley;
+         x1 = cmd->x + (cmd->len + 2) * 6 * cmd->scalex;
+         y1 = cmd->y + (lines + 2) * 6 * cmd->scaley;
+         break;
+      case GRAPH_OP_FBOX:
+      default:
+         x1 = cmd->x + cmd->dx;
+         y1 = cmd->y + cmd->dy;
+         break;
+   }
+
+   layer->box_x_min = MIN(layer->box_x_min, x0);
+   layer->box_y_min = MIN(layer->box_y_min, y0);
+   layer->box_x_max = MAX(layer->box_x_max, x1);
+   layer->box_y_max = MAX(layer->box_y_max, y1);
+}
+
+static void graph_layer_record(libretro_graph_cmd_t *cmd, const unsigned char *string)
+{
+   libretro_graph_layer_t *layer = graph_layer;
+   size_t size;
+
+   cmd->len = 0;
+   if (string)
+      for (; cmd->len < cmd->max && string[cmd->len]; cmd->len++) {}
+
+   graph_layer_bounds(layer, cmd, string);
+
+   size = layer->list_len + sizeof(*cmd) + cmd->len + 1;
+   if (size > layer->list_size)
+   {
+      layer->list_size = size * 2;
+      layer->list      = (uint8_t *)realloc(layer->list, layer->list_size);
+   }
+
+   memcpy(layer->list + layer->list_len, cmd, sizeof(*cmd));
+   layer->list_len += sizeof(*cmd);
+   if (string)
+      memcpy(layer->list + layer->list_len, string, cmd->len);
+   layer->list[layer->list_len + cmd->len] = '\0';
+   layer->list_len += cmd->len + 1;
+}
+
+static void graph_layer_replay(const libretro_graph_layer_t *layer, const uint8_t *list, size_t list_len, void *buffer)
+{
+   libretro_graph_cmd_t cmd;
+   size_t pos = 0;
+   int y;
+
+   for (y = layer->box_y_min; y < layer->box_y_max; y++)
+      memset(graphed + (y * layer->width) + layer->box_x_min, 0,
+            (layer->box_x_max - layer->box_x_min) * sizeof(graphed[0]));
+
+   while (pos < list_len)
+   {
+      const unsigned char *string;
+
+      memcpy(&cmd, list + pos, sizeof(cmd));
+      pos   += sizeof(cmd);
+      string = list + pos;
+      pos   += cmd.len + 1;
+
+      switch (cmd.op)
+      {
+         case GRAPH_OP_FBOX:
+            if (pix_bytes == 4)
+               draw_fbox_bmp32((uint32_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg, cmd.alpha);
+            else
+               draw_fbox_bmp16((uint16_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg, cmd.alpha);
+            break;
+         case GRAPH_OP_BOX:
+            if (pix_bytes == 4)
+               draw_box_bmp32((uint32_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.width, cmd.height, cmd.fg, cmd.alpha);
+            else
+               draw_box_bmp16((uint16_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.width, cmd.height, cmd.fg, cmd.alpha);
+            break;
+         case GRAPH_OP_HLINE:
+            if (pix_bytes == 4)
+               draw_hline_bmp32((uint32_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg);
+            else
+               draw_hline_bmp16((uint16_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg);
+            break;
+         case GRAPH_OP_VLINE:
+            if (pix_bytes == 4)
+               draw_vline_bmp32((uint32_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg);
+            else
+               draw_vline_bmp16((uint16_t *)buffer, cmd.x, cmd.y, cmd.dx, cmd.dy, cmd.fg);
+            break;
+         case GRAPH_OP_TEXT:
+            if (pix_bytes == 4)
+               draw_text_bmp32((uint32_t *)buffer, cmd.x, cmd.y, cmd.fg, cmd.bg, cmd.alpha, cmd.draw_bg,
+                     cmd.scalex, cmd.scaley, cmd.max, string);
+            else
+               draw_text_bmp16((uint16_t *)buffer, cmd.x, cmd.y, cmd.fg, cmd.bg, cmd.alpha, cmd.draw_bg,
+                     cmd.scalex, cmd.scaley, cmd.max, string);
+            break;
+      }
+   }
+}
+
+static void graph_layer_render(libretro_graph_layer_t *layer)
+{
+   int x, y;
+   unsigned i;
+
+   if (!layer->color)
+      layer->color = malloc(GRAPH_LAYER_BUFFER_SIZE);
+   if (!layer->keep)
+      layer->keep  = (uint8_t *)malloc(RETRO_BMP_SIZE);
+   if (!graph_layer_white)
+      graph_layer_white = malloc(GRAPH_LAYER_BUFFER_SIZE);
+
+   layer->x_min = layer->width;
+   layer->x_max = 0;
+   layer->y_min = layer->height;
+   layer->y_max = 0;
+
+   /* Only the area of the draw calls is cleared, replayed and scanned,
+    * the rest of the buffers is never blitted */
+   layer->box_x_min = MAX(layer->box_x_min, 0);
+   layer->box_y_min = MAX(layer->box_y_min, 0);
+   layer->box_x_max = MIN(layer->box_x_max, layer->width);
+   layer->box_y_max = MIN(layer->box_y_max, layer->height);
+   if (layer->box_x_min >= layer->box_x_max || layer->box_y_min >= layer->box_y_max)
+      return;
+
+   for (y = layer->box_y_min; y < layer->box_y_max; y++)
+   {
+      unsigned offset = (y * layer->width) + layer->box_x_min;
+      unsigned count  = layer->box_x_max - layer->box_x_min;
+
+      if (pix_bytes == 4)
+      {
+         uint32_t *white = (uint32_t *)graph_layer_white + offset;
+         memset((uint32_t *)layer->color + offset, 0, count * 4);
+         for (i = 0; i < count; i++)
+            white[i] = 0xFFFFFF;
+      }
+      else
+      {
+         memset((uint16_t *)layer->color + offset, 0, count * 2);
+         memset((uint16_t *)graph_layer_white + offset, 0xFF, count * 2);
+      }
+   }
+
+   graph_layer_replay(layer, layer->list, layer->list_len, layer->color);
+   graph_layer_replay(layer, layer->list, layer->list_len, graph_layer_white);
+
+   for (y = layer->box_y_min; y < layer->box_y_max; y++)
+   {
+      for (x = layer->box_x_min, i = (y * layer->width) + x; x < layer->box_x_max; x++, i++)
+      {
+         unsigned color, black, white, keep;
+
+         /* Weight from the green channel, the widest one in RGB565 */
+         if (pix_bytes == 4)
+         {
+            color = ((uint32_t *)layer->color)[i];
+            black = (color >> 8) & 0xFF;
+            white = (((uint32_t *)graph_layer_white)[i] >> 8) & 0xFF;
+            keep  = (white > black) ? ((white - black) * GRAPH_LAYER_KEEP_ALL + 127) / 255 : 0;
+         }
+         else
+         {
+            color = ((uint16_t *)layer->color)[i];
+            black = (color >> 5) & 0x3F;
+            white = (((uint16_t *)graph_layer_white)[i] >> 5) & 0x3F;
+            keep  = (white > black) ? ((white - black) * GRAPH_LAYER_KEEP_ALL + 31) / 63 : 0;
+         }
+
+         layer->keep[i] = keep;
+         /* Untouched by the overlay */
+         if (keep == GRAPH_LAYER_KEEP_ALL && !color)
+            continue;
+
+         if (x < layer->x_min)
+            layer->x_min = x;
+         if (x >= layer->x_max)
+            layer->x_max = x + 1;
+         if (y < layer->y_min)
+            layer->y_min = y;
+         layer->y_max = y + 1;
+      }
+   }
+}
+
+static void graph_layer_blit(const libretro_graph_layer_t *layer)
+{
+   unsigned x;
+   int y;
+
+   for (y = layer->y_min; y < layer->y_max; y++)
+   {
+      unsigned offset = (y * layer->width) + layer->x_min;
+      unsigned count  = layer->x_max - layer->x_min;
+      const uint8_t *keep = layer->keep + offset;
+
+      if (pix_bytes == 4)
+      {
+         const uint32_t *src = (const uint32_t *)layer->color + offset;
+         uint32_t *dst       = (uint32_t *)retro_bmp + offset;
+
+         for (x = 0; x < count; x++)
+         {
+            unsigned r = ((src[x] >> 16) & 0xFF) + ((((dst[x] >> 16) & 0xFF) * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            unsigned g = ((src[x] >>  8) & 0xFF) + ((((dst[x] >>  8) & 0xFF) * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            unsigned b = ( src[x]        & 0xFF) + ((( dst[x]        & 0xFF) * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            dst[x] = (MIN(r, 0xFF) << 16) | (MIN(g, 0xFF) << 8) | MIN(b, 0xFF);
+         }
+      }
+      else
+      {
+         const uint16_t *src = (const uint16_t *)layer->color + offset;
+         uint16_t *dst       = (uint16_t *)retro_bmp + offset;
+
+         for (x = 0; x < count; x++)
+         {
+            unsigned r = ( src[x] >> 11)         + ((( dst[x] >> 11)         * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            unsigned g = ((src[x] >>  5) & 0x3F) + ((((dst[x] >>  5) & 0x3F) * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            unsigned b = ( src[x]        & 0x1F) + ((( dst[x]        & 0x1F) * keep[x] + GRAPH_LAYER_KEEP_HALF) >> GRAPH_LAYER_KEEP_SHIFT);
+            dst[x] = (MIN(r, 0x1F) << 11) | (MIN(g, 0x3F) << 5) | MIN(b, 0x1F);
+         }
+      }
+   }
+}
+
+void libretro_graph_layer_begin(libretro_graph_layer_t *layer)
+{
+   layer->list_len  = 0;
+   layer->box_x_min = INT_MAX;
+   layer->box_y_min = INT_MAX;
+   layer->box_x_max = INT_MIN;
+   layer->box_y_max = INT_MIN;
+   graph_layer      = layer;
+}
+
+void libretro_graph_layer_end(libretro_graph_layer_t *layer)
+{
+   graph_layer = NULL;
+
+   if (layer->width != retrow || layer->height != retroh || layer->depth != pix_bytes ||
+       layer->list_len != layer->list_prev_len ||
+       (layer->list_len && memcmp(layer->list, layer->list_prev, layer->list_len)))
+   {
+      uint8_t *list_prev    = layer->list_prev;
+      size_t list_prev_size = layer->list_prev_size;
+
+      layer->width  = retrow;
+      layer->height = retroh;
+      layer->depth  = pix_bytes;
+      graph_layer_render(layer);
+
+      /* Keep the rendered calls for comparing the next frame */
+      layer->list_prev      = layer->list;
+      layer->list_prev_size = layer->list_size;
+      layer->list_prev_len  = layer->list_len;
+      layer->list           = list_prev;
+      layer->list_size      = list_prev_size;
+   }
+
+   graph_layer_blit(layer);
+}
+
+void libretro_graph_layer_free(libretro_graph_layer_t *layer)
+{
+   free(layer->list);
+   free(layer->list_prev);
+   free(layer->color);
+   free(layer->keep);
+   memset(layer, 0, sizeof(*layer));
+}
+
 void libretro_graph_free(void)
 {
+   if (graph_layer_white)
+      free(graph_layer_white);
+   graph_layer_white = NULL;
+
    if (linesurf16)
       free(linesurf16);
    linesurf16 = NULL;
@@ -70,6 +70,25 @@ typedef enum {
    GRAPH_BG_OUTLINE
 } libretro_graph_bg_t;
 
+/* Cached overlay, rendered from the draw calls made between begin and end */
+typedef struct {
+   uint8_t *list;
+   size_t list_len;
+   size_t list_size;
+   uint8_t *list_prev;
+   size_t list_prev_len;
+   size_t list_prev_size;
+   void *color;
+   uint8_t *keep;
+   int width, height, depth;
+   int x_min, x_max, y_min, y_max;              /* Pixels touched, blitted */
+   int box_x_min, box_x_max, box_y_min, box_y_max; /* Bounds of the calls */
+} libretro_graph_layer_t;
+
+void libretro_graph_layer_begin(libretro_graph_layer_t *layer);
+void libretro_graph_layer_end(libretro_graph_layer_t *layer);
+void libretro_graph_layer_free(libretro_graph_layer_t *layer);
+
 void draw_fbox(int x, int y, int dx, int dy, uint32_t color, libretro_graph_alpha_t alpha);
 void draw_fbox_bmp16(uint16_t *buffer, int x, int y, int dx, int dy, uint16_t color, libretro_graph_alpha_t alpha);
 void draw_fbox_bmp32(uint32_t *buffer, int x, int y, int dx, int dy, uint32_t color, libretro_graph_alpha_t alpha);
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "libretro-perf.h"
+
+/* Frames averaged by the statusbar page */
+#define PERF_WINDOW 50
+/* Deeper nesting is counted to the section at the limit */
+#define PERF_DEPTH  16
+
+static const char *const perf_names[RETRO_PERF_NUM] = {
+   "CPU", "VID", "SND", "DRV", "ALM", "CNV", "OSD"
+};
+
+static struct retro_perf_counter perf_counters[RETRO_PERF_NUM] = {
+   { "vice_maincpu" },
+   { "vice_video_chip" },
+   { "vice_sound" },
+   { "vice_drive" },
+   { "vice_alarm" },
+   { "vice_canvas_refresh" },
+   { "vice_overlay" },
+};
+
+static retro_perf_get_counter_t perf_get_counter;
+static retro_perf_get_time_usec_t perf_get_time_usec;
+
+static struct
+{
+   enum retro_perf_id stack[PERF_DEPTH];
+   unsigned depth;
+   retro_perf_tick_t last;
+   retro_perf_tick_t ticks[RETRO_PERF_NUM];
+   uint64_t calls[RETRO_PERF_NUM];
+} perf_frame;
+
+static struct
+{
+   retro_perf_tick_t ticks[RETRO_PERF_NUM];
+   long usec;
+   unsigned frames;
+   char text[80];
+} perf_window;
+
+static retro_perf_tick_t perf_ticks(void)
+{
+   if (perf_get_counter)
+      return perf_get_counter();
+   if (perf_get_time_usec)
+      return (retro_perf_tick_t)perf_get_time_usec();
+   return 0;
+}
+
+void retro_perf_init(const struct retro_perf_callback *cb)
+{
+   unsigned i;
+
+   memset(&perf_frame, 0, sizeof(perf_frame));
+   memset(&perf_window, 0, sizeof(perf_window));
+
+   perf_get_counter   = cb ? cb->get_perf_counter : NULL;
+   perf_get_time_usec = cb ? cb->get_time_usec : NULL;
+
+   for (i = 0; i < RETRO_PERF_NUM; i++)
+   {
+      perf_counters[i].total    = 0;
+      perf_counters[i].call_cnt = 0;
+      if (cb && cb->perf_register && !perf_counters[i].registered)
+         cb->perf_register(&perf_counters[i]);
+   }
+}
+
+/* Charges the time since the previous section change to the innermost one */
+static void perf_charge(retro_perf_tick_t now)
+{
+   unsigned top = (perf_frame.depth < PERF_DEPTH) ? perf_frame.depth : PERF_DEPTH;
+
+   if (top)
+      perf_frame.ticks[perf_frame.stack[top - 1]] += now - perf_frame.last;
+   perf_frame.last = now;
+}
+
+void retro_perf_enter(enum retro_perf_id id)
+{
+   perf_charge(perf_ticks());
+
+   if (perf_frame.depth < PERF_DEPTH)
+      perf_frame.stack[perf_frame.depth] = id;
+   perf_frame.depth++;
+   perf_frame.calls[id]++;
+}
+
+void retro_perf_leave(void)
+{
+   if (!perf_frame.depth)
+      return;
+
+   perf_charge(perf_ticks());
+   perf_frame.depth--;
+}
+
+/* Frame done, `usec' being the time it took */
+void retro_perf_frame(long usec)
+{
+   retro_perf_tick_t total = 0;
+   unsigned i;
+
+   for (i = 0; i < RETRO_PERF_NUM; i++)
+   {
+      perf_counters[i].total    += perf_frame.ticks[i];
+      perf_counters[i].call_cnt += perf_frame.calls[i];
+      perf_window.ticks[i]      += perf_frame.ticks[i];
+      perf_frame.ticks[i]        = 0;
+      perf_frame.calls[i]        = 0;
+   }
+   perf_window.usec += usec;
+
+   if (++perf_window.frames < PERF_WINDOW)
+      return;
+
+   for (i = 0; i < RETRO_PERF_NUM; i++)
+      total += perf_window.ticks[i];
+
+   /* Share of the frame per section, and the average frame time */
+   if (total)
+   {
+      size_t len = 0;
+
+      for (i = 0; i < RETRO_PERF_NUM && len < sizeof(perf_window.text); i++)
+         len += snprintf(perf_window.text + len, sizeof(perf_window.text) - len, "%s%3u ",
+               perf_names[i], (unsigned)(perf_window.ticks[i] * 100 / total));
+      if (len < sizeof(perf_window.text))
+         snprintf(perf_window.text + len, sizeof(perf_window.text) - len, "%5ldus",
+               perf_window.usec / PERF_WINDOW);
+   }
+
+   memset(&perf_window.ticks, 0, sizeof(perf_window.ticks));
+   perf_window.usec   = 0;
+   perf_window.frames = 0;
+}
+
+void retro_perf_statusbar(char *text, size_t size)
+{
+   snprintf(text, size, "%s", perf_window.text[0] ? perf_window.text : "Measuring...");
+}
@@ -0,0 +1,38 @@
+#ifndef LIBRETRO_PERF_H
+#define LIBRETRO_PERF_H
+
+#include "libretro.h"
+
+/* Frame time per subsystem, built in with PERF_COUNTERS=1. Sections nest,
+ * and time is charged to the innermost one only, so that the counters of
+ * a frame add up to the emulation time of the frame. The main CPU counter
+ * therefore is everything not covered by the others. Ticks come from the
+ * frontend perf interface, usually CPU cycles. */
+
+enum retro_perf_id
+{
+   RETRO_PERF_MAINCPU = 0,
+   RETRO_PERF_VIDEO,          /* VIC-II cycles or raster lines */
+   RETRO_PERF_SOUND,          /* sound_run_sound() and the SID engines */
+   RETRO_PERF_DRIVE,          /* drive_cpu_execute_all() */
+   RETRO_PERF_ALARM,          /* alarm_context_dispatch() callbacks */
+   RETRO_PERF_CANVAS,         /* video_canvas_refresh() */
+   RETRO_PERF_OVERLAY,        /* Statusbar and virtual keyboard */
+   RETRO_PERF_NUM
+};
+
+#ifdef RETRO_PERF_COUNTERS
+void retro_perf_init(const struct retro_perf_callback *cb);
+void retro_perf_enter(enum retro_perf_id id);
+void retro_perf_leave(void);
+void retro_perf_frame(long usec);
+void retro_perf_statusbar(char *text, size_t size);
+
+#define RETRO_PERF_ENTER(id) retro_perf_enter(id)
+#define RETRO_PERF_LEAVE()   retro_perf_leave()
+#else
+#define RETRO_PERF_ENTER(id)
+#define RETRO_PERF_LEAVE()
+#endif
+
+#endif /* LIBRETRO_PERF_H */
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "streams/file_stream.h"
+
+#include "libretro-profiler.h"
+
+#include "vice.h"
+#include "alarm.h"
+#include "drive.h"
+#include "drivemem.h"
+#include "drivetypes.h"
+#include "interrupt.h"
+#include "maincpu.h"
+#include "mem.h"
+#include "mos6510.h"
+#include "r65c02.h"
+
+/* Deeper call chains keep the innermost frames */
+#define PROFILER_DEPTH 32
+/* Room for the root and the frames of a stack, "drive11" and "rom:ffd2;" */
+#define PROFILER_STACK_LEN (8 + (PROFILER_DEPTH + 1) * 9)
+
+typedef uint8_t (*profiler_peek_t)(int bank, uint16_t addr, void *context);
+
+typedef struct profiler_entry
+{
+   uint32_t hash;
+   char *stack;
+   unsigned long count;
+} profiler_entry_t;
+
+static struct
+{
+   enum profiler_mode mode;
+   unsigned interval;
+   alarm_t *alarm;
+   int ram_bank;
+   profiler_entry_t *entries;
+   unsigned size;
+   unsigned used;
+   unsigned long samples;
+} profiler = {PROFILER_DISABLED, 0, NULL, -1, NULL, 0, 0, 0};
+
+static uint32_t profiler_hash(const char *s)
+{
+   uint32_t hash = 2166136261u;
+
+   while (*s)
+      hash = (hash ^ (uint8_t)*s++) * 16777619u;
+   return hash;
+}
+
+static void profiler_count(const char *stack)
+{
+   uint32_t hash = profiler_hash(stack);
+   unsigned i;
+
+   /* Open addressing, kept at most half full */
+   if ((profiler.used + 1) * 2 > profiler.size)
+   {
+      profiler_entry_t *old = profiler.entries;
+      unsigned old_size     = profiler.size;
+      unsigned size         = old_size ? old_size * 2 : 1024;
+      profiler_entry_t *entries = (profiler_entry_t *)calloc(size, sizeof(profiler_entry_t));
+
+      if (!entries)
+         return;
+
+      for (i = 0; i < old_size; i++)
+      {
+         unsigned j;
+
+         if (!old[i].stack)
+            continue;
+         for (j = old[i].hash & (size - 1); entries[j].stack; j = (j + 1) & (size - 1));
+         entries[j] = old[i];
+      }
+      free(old);
+      profiler.entries = entries;
+      profiler.size    = size;
+   }
+
+   for (i = hash & (profiler.size - 1); profiler.entries[i].stack; i = (i + 1) & (profiler.size - 1))
+   {
+      if (profiler.entries[i].hash == hash && !strcmp(profiler.entries[i].stack, stack))
+      {
+         profiler.entries[i].count++;
+         profiler.samples++;
+         return;
+      }
+   }
+
+   if (!(profiler.entries[i].stack = strdup(stack)))
+      return;
+   profiler.entries[i].hash  = hash;
+   profiler.entries[i].count = 1;
+   profiler.used++;
+   profiler.samples++;
+}
+
+/* RAM or not, by the code bytes as the CPU sees them. Banked out RAM with
+ * the same bytes as the ROM above counts as RAM, which runs the same code */
+static const char *profiler_bank(uint16_t addr)
+{
+   unsigned i;
+
+   if (profiler.ram_bank < 0)
+      return NULL;
+
+   for (i = 0; i < 3; i++)
+      if (mem_bank_peek(0, (uint16_t)(addr + i), NULL) != mem_bank_peek(profiler.ram_bank, (uint16_t)(addr + i), NULL))
+         return "rom";
+   return "ram";
+}
+
+static size_t profiler_frame(char *s, size_t size, int banked, uint16_t addr)
+{
+   const char *bank = banked ? profiler_bank(addr) : NULL;
+
+   if (bank)
+      return snprintf(s, size, ";%s:%04x", bank, addr);
+   return snprintf(s, size, ";%04x", addr);
+}
+
+/* The call chain is every stacked address that points after a JSR,
+ * outermost first. Interrupt frames and pushed data may pass for one
+ * now and then, as in any stack walk without frame information */
+static void profiler_sample(const char *root, int banked, uint16_t pc, uint8_t sp,
+      profiler_peek_t peek, void *context)
+{
+   char stack[PROFILER_STACK_LEN];
+   uint16_t frames[PROFILER_DEPTH];
+   unsigned depth = 0;
+   unsigned i     = sp + 1;
+   size_t len     = 0;
+
+   while (i < 0xff)
+   {
+      uint16_t ret = peek(0, (uint16_t)(0x100 + i), context)
+                  | (peek(0, (uint16_t)(0x100 + i + 1), context) << 8);
+
+      if (peek(0, (uint16_t)(ret - 2), context) != 0x20)
+      {
+         i++;
+         continue;
+      }
+
+      /* Keep the innermost frames, the walk starts from them */
+      if (depth < PROFILER_DEPTH)
+         frames[depth++] = peek(0, (uint16_t)(ret - 1), context)
+                        | (peek(0, ret, context) << 8);
+      i += 2;
+   }
+
+   len = snprintf(stack, sizeof(stack), "%s", root);
+   while (depth)
+      len += profiler_frame(stack + len, sizeof(stack) - len, banked, frames[--depth]);
+   profiler_frame(stack + len, sizeof(stack) - len, banked, pc);
+
+   profiler_count(stack);
+}
+
+/* The registers of the main CPU are exported for traps only */
+static void profiler_trap(uint16_t addr, void *data)
+{
+   profiler_sample("maincpu", 1, addr, (uint8_t)maincpu_get_sp(), mem_bank_peek, NULL);
+}
+
+/* Drive registers live in the context. A drive runs behind the main CPU
+ * until the next sync, which shifts the samples but does not bias them */
+static void profiler_sample_drives(void)
+{
+   char root[8];
+   unsigned dnr;
+
+   for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++)
+   {
+      diskunit_context_t *unit = diskunit_context[dnr];
+      uint16_t pc;
+      uint8_t sp;
+
+      if (!unit || !unit->enable)
+         continue;
+
+      if (unit->type == DRIVE_TYPE_2000 || unit->type == DRIVE_TYPE_4000 ||
+          unit->type == DRIVE_TYPE_CMDHD)
+      {
+         pc = (uint16_t)R65C02_REGS_GET_PC(&unit->cpu->cpu_R65C02_regs);
+         sp = (uint8_t)R65C02_REGS_GET_SP(&unit->cpu->cpu_R65C02_regs);
+      }
+      else
+      {
+         pc = (uint16_t)MOS6510_REGS_GET_PC(&unit->cpu->cpu_regs);
+         sp = (uint8_t)MOS6510_REGS_GET_SP(&unit->cpu->cpu_regs);
+      }
+
+      snprintf(root, sizeof(root), "drive%u", dnr + 8);
+      profiler_sample(root, 0, pc, sp, drivemem_bank_peek, unit);
+   }
+}
+
+static void profiler_alarm(CLOCK offset, void *data)
+{
+   alarm_set(profiler.alarm, maincpu_clk + profiler.interval - offset);
+
+   /* The PC of the next instruction, unless another trap is pending,
+    * which would be replaced otherwise */
+   if (!(maincpu_int_status->global_pending_int & IK_TRAP))
+      interrupt_maincpu_trigger_trap(profiler_trap, NULL);
+
+   if (profiler.mode == PROFILER_DRIVES)
+      profiler_sample_drives();
+}
+
+/* Starts, stops or retimes sampling. Samples are kept until cleared */
+void profiler_set(enum profiler_mode mode, unsigned interval)
+{
+   profiler.mode     = mode;
+   profiler.interval = interval ? interval : 1;
+
+   if (mode == PROFILER_DISABLED)
+   {
+      if (profiler.alarm)
+         alarm_destroy(profiler.alarm);
+      profiler.alarm = NULL;
+      return;
+   }
+
+   if (!profiler.alarm)
+   {
+      profiler.ram_bank = mem_bank_from_name("ram");
+      profiler.alarm    = alarm_new(maincpu_alarm_context, "Profiler", profiler_alarm, NULL);
+   }
+   alarm_set(profiler.alarm, maincpu_clk + profiler.interval);
+}
+
+unsigned long profiler_samples(void)
+{
+   return profiler.samples;
+}
+
+/* Writes the collapsed stacks and clears them. Returns the samples written */
+unsigned long profiler_save(const char *path)
+{
+   unsigned long samples = profiler.samples;
+   RFILE *file = NULL;
+   unsigned i;
+
+   if (!samples)
+      return 0;
+
+   if (!(file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE)))
+      return 0;
+
+   for (i = 0; i < profiler.size; i++)
+      if (profiler.entries[i].stack)
+         filestream_printf(file, "%s %lu\n", profiler.entries[i].stack, profiler.entries[i].count);
+   filestream_close(file);
+
+   profiler_clear();
+   return samples;
+}
+
+void profiler_clear(void)
+{
+   unsigned i;
+
+   for (i = 0; i < profiler.size; i++)
+      free(profiler.entries[i].stack);
+   free(profiler.entries);
+
+   profiler.entries = NULL;
+   profiler.size    = 0;
+   profiler.used    = 0;
+   profiler.samples = 0;
+}
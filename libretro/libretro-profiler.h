@@ -0,0 +1,23 @@
+#ifndef LIBRETRO_PROFILER_H
+#define LIBRETRO_PROFILER_H
+
+/* Sampling profiler for the 6502 family CPUs. An alarm of the main CPU
+ * takes a sample every `interval' cycles: the PC and the call chain, as
+ * found from the JSR return addresses on the stack. Nothing is scheduled
+ * while disabled. Samples are written as collapsed stacks, one line of
+ * "maincpu;ram:c000;rom:ffd2;rom:f1ca 12" per distinct stack, which is
+ * what flame graph tools such as flamegraph.pl and speedscope read. */
+
+enum profiler_mode
+{
+   PROFILER_DISABLED = 0,
+   PROFILER_MAINCPU,          /* Main CPU only */
+   PROFILER_DRIVES            /* Main CPU and the drive CPUs */
+};
+
+extern void profiler_set(enum profiler_mode mode, unsigned interval);
+extern unsigned long profiler_samples(void);
+extern unsigned long profiler_save(const char *path);
+extern void profiler_clear(void);
+
+#endif /* LIBRETRO_PROFILER_H */
@@ -0,0 +1,103 @@
+#ifndef LIBRETRO_TRACE_OPS_H
+#define LIBRETRO_TRACE_OPS_H
+
+/* Addressing modes of the 6502 family opcodes, for the execution trace
+ * recorder and the vice_trace decoder. NMOS undocumented opcodes are
+ * included, the R65C02 table follows the Rockwell parts of the drives. */
+
+enum trace_mode
+{
+   TRACE_IMP = 0,             /* Implied or accumulator */
+   TRACE_IMM,                 /* #$nn */
+   TRACE_ZP,                  /* $nn */
+   TRACE_ZPX,                 /* $nn,X */
+   TRACE_ZPY,                 /* $nn,Y */
+   TRACE_ABS,                 /* $nnnn */
+   TRACE_ABX,                 /* $nnnn,X */
+   TRACE_ABY,                 /* $nnnn,Y */
+   TRACE_IZX,                 /* ($nn,X) */
+   TRACE_IZY,                 /* ($nn),Y */
+   TRACE_IND,                 /* ($nnnn) */
+   TRACE_REL,                 /* Branch */
+   TRACE_IZP,                 /* ($nn), R65C02 */
+   TRACE_IAX,                 /* ($nnnn,X), R65C02 */
+   TRACE_ZPR,                 /* $nn,branch, R65C02 BBR/BBS */
+   TRACE_MODES
+};
+
+/* Instruction size by addressing mode */
+static const uint8_t trace_mode_size[TRACE_MODES] = {
+   1, 2, 2, 2, 2, 3, 3, 3, 2, 2, 3, 2, 2, 3, 3
+};
+
+static const uint8_t trace_modes_6502[256] = {
+   /* $00 */ TRACE_IMP, TRACE_IZX, TRACE_IMP, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $08 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $10 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $18 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX,
+   /* $20 */ TRACE_ABS, TRACE_IZX, TRACE_IMP, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $28 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $30 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $38 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX,
+   /* $40 */ TRACE_IMP, TRACE_IZX, TRACE_IMP, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $48 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $50 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $58 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX,
+   /* $60 */ TRACE_IMP, TRACE_IZX, TRACE_IMP, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $68 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_IND, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $70 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $78 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX,
+   /* $80 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $88 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $90 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPY, TRACE_ZPY,
+   /* $98 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABY, TRACE_ABY,
+   /* $a0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $a8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $b0 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPY, TRACE_ZPY,
+   /* $b8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABY, TRACE_ABY,
+   /* $c0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $c8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $d0 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $d8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX,
+   /* $e0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IZX, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $e8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMM, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ABS,
+   /* $f0 */ TRACE_REL, TRACE_IZY, TRACE_IMP, TRACE_IZY, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX,
+   /* $f8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_ABY, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ABX
+};
+
+static const uint8_t trace_modes_65c02[256] = {
+   /* $00 */ TRACE_IMP, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $08 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $10 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZP,  TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $18 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $20 */ TRACE_ABS, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $28 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $30 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $38 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABX, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $40 */ TRACE_IMP, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $48 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $50 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $58 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $60 */ TRACE_IMP, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $68 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_IND, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $70 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $78 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_IAX, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $80 */ TRACE_REL, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $88 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $90 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPY, TRACE_ZP,
+   /* $98 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $a0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $a8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $b0 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPY, TRACE_ZP,
+   /* $b8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABX, TRACE_ABX, TRACE_ABY, TRACE_ZPR,
+   /* $c0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $c8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $d0 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $d8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABX, TRACE_ABX, TRACE_ZPR,
+   /* $e0 */ TRACE_IMM, TRACE_IZX, TRACE_IMM, TRACE_IMP, TRACE_ZP,  TRACE_ZP,  TRACE_ZP,  TRACE_ZP,
+   /* $e8 */ TRACE_IMP, TRACE_IMM, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABS, TRACE_ABS, TRACE_ZPR,
+   /* $f0 */ TRACE_REL, TRACE_IZY, TRACE_IZP, TRACE_IMP, TRACE_ZPX, TRACE_ZPX, TRACE_ZPX, TRACE_ZP,
+   /* $f8 */ TRACE_IMP, TRACE_ABY, TRACE_IMP, TRACE_IMP, TRACE_ABS, TRACE_ABX, TRACE_ABX, TRACE_ZPR
+};
+
+#endif /* LIBRETRO_TRACE_OPS_H */
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "streams/file_stream.h"
+#ifdef HAVE_THREADS
+#include "rthreads/rthreads.h"
+#endif
+
+#include "libretro-trace.h"
+#include "libretro-trace-ops.h"
+
+#include "vice.h"
+#include "drive.h"
+#include "drivemem.h"
+#include "mem.h"
+
+/* Records per chunk, and the chunks in the ring. The emulation waits for
+ * the worker when all of them are full, a trace with gaps being useless
+ * for finding where two runs part */
+#define TRACE_CHUNK_RECORDS 32768
+#define TRACE_CHUNKS        8
+#define TRACE_OUT_SIZE      65536
+
+unsigned int trace_cpus = 0;
+
+static struct
+{
+   trace_record_t *records;   /* TRACE_CHUNKS chunks of TRACE_CHUNK_RECORDS */
+   unsigned counts[TRACE_CHUNKS];
+   unsigned head;             /* Chunk being filled, by the emulation only */
+   unsigned fill;             /* Records in the head chunk */
+   unsigned tail;             /* Next chunk to compress, by the worker only */
+   unsigned full;             /* Chunks handed over and not yet compressed */
+   uint64_t written;
+   RFILE *file;
+   z_stream zs;
+   uint8_t *out;
+   bool failed;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;             /* signalled when chunks are handed over or done */
+   bool quit;
+#endif
+} trace;
+
+/* Compresses to the file. `flush' is Z_NO_FLUSH or Z_FINISH */
+static void trace_deflate(const void *data, size_t size, int flush)
+{
+   trace.zs.next_in  = (Bytef *)data;
+   trace.zs.avail_in = (uInt)size;
+
+   do
+   {
+      size_t have;
+
+      trace.zs.next_out  = trace.out;
+      trace.zs.avail_out = TRACE_OUT_SIZE;
+      if (deflate(&trace.zs, flush) == Z_STREAM_ERROR)
+      {
+         trace.failed = true;
+         return;
+      }
+
+      have = TRACE_OUT_SIZE - trace.zs.avail_out;
+      if (have && !trace.failed && filestream_write(trace.file, trace.out, have) != (int64_t)have)
+         trace.failed = true;
+   } while (trace.zs.avail_out == 0);
+}
+
+static void trace_compress(unsigned chunk, unsigned count)
+{
+   trace_deflate(trace.records + chunk * TRACE_CHUNK_RECORDS, count * sizeof(trace_record_t), Z_NO_FLUSH);
+   trace.written += count;
+}
+
+#ifdef HAVE_THREADS
+static void trace_worker_thread(void *arg)
+{
+   slock_lock(trace.lock);
+   for (;;)
+   {
+      unsigned tail = trace.tail;
+
+      if (!trace.full)
+      {
+         if (trace.quit)
+            break;
+         scond_wait(trace.cond, trace.lock);
+         continue;
+      }
+
+      slock_unlock(trace.lock);
+      trace_compress(tail, trace.counts[tail]);
+      slock_lock(trace.lock);
+
+      trace.tail = (tail + 1) % TRACE_CHUNKS;
+      trace.full--;
+      scond_broadcast(trace.cond);
+   }
+   slock_unlock(trace.lock);
+}
+
+static void trace_worker_start(void)
+{
+   trace.lock = slock_new();
+   trace.cond = scond_new();
+   trace.quit = false;
+   if (trace.lock && trace.cond)
+      trace.thread = sthread_create(trace_worker_thread, NULL);
+
+   /* Compressed on the emulation thread then */
+   if (!trace.thread)
+   {
+      if (trace.lock)
+         slock_free(trace.lock);
+      if (trace.cond)
+         scond_free(trace.cond);
+      trace.lock = NULL;
+      trace.cond = NULL;
+   }
+}
+
+static void trace_worker_stop(void)
+{
+   if (!trace.thread)
+      return;
+
+   slock_lock(trace.lock);
+   trace.quit = true;
+   scond_broadcast(trace.cond);
+   slock_unlock(trace.lock);
+
+   sthread_join(trace.thread);
+   slock_free(trace.lock);
+   scond_free(trace.cond);
+   trace.thread = NULL;
+   trace.lock   = NULL;
+   trace.cond   = NULL;
+}
+#endif
+
+/* Head chunk done, the next one is filled meanwhile */
+static void trace_hand_over(void)
+{
+#ifdef HAVE_THREADS
+   if (trace.thread)
+   {
+      slock_lock(trace.lock);
+      trace.counts[trace.head] = trace.fill;
+      trace.full++;
+      scond_broadcast(trace.cond);
+      while (trace.full == TRACE_CHUNKS)
+         scond_wait(trace.cond, trace.lock);
+      slock_unlock(trace.lock);
+   }
+   else
+#endif
+      trace_compress(trace.head, trace.fill);
+
+   trace.head = (trace.head + 1) % TRACE_CHUNKS;
+   trace.fill = 0;
+}
+
+static uint8_t trace_peek(unsigned int cpu, uint16_t addr)
+{
+   if (cpu == TRACE_CPU_MAIN)
+      return mem_bank_peek(0, addr, NULL);
+   return drivemem_bank_peek(0, addr, diskunit_context[cpu - TRACE_CPU_DRIVE8]);
+}
+
+static uint16_t trace_peek_word(unsigned int cpu, uint16_t lo, uint16_t hi)
+{
+   return trace_peek(cpu, lo) | (trace_peek(cpu, hi) << 8);
+}
+
+/* Records the instruction at `pc', before it executes. Operands beyond the
+ * instruction size may be stale as fetched, so they are cleared */
+void trace_insn(unsigned int cpu, unsigned int flags, uint32_t clk, uint16_t pc,
+      uint8_t op, uint8_t lo, uint8_t hi,
+      uint8_t a, uint8_t x, uint8_t y, uint8_t sp, uint8_t p)
+{
+   trace_record_t *record = trace.records + trace.head * TRACE_CHUNK_RECORDS + trace.fill;
+   unsigned int mode = (flags & TRACE_FLAG_65C02) ? trace_modes_65c02[op] : trace_modes_6502[op];
+   uint16_t word;
+
+   /* The high byte of JSR is not fetched yet on all cores */
+   if (op == 0x20)
+      hi = trace_peek(cpu, (uint16_t)(pc + 2));
+   if (trace_mode_size[mode] < 3)
+      hi = 0;
+   if (trace_mode_size[mode] < 2)
+      lo = 0;
+   word = lo | (hi << 8);
+
+   flags |= TRACE_FLAG_EA;
+   switch (mode)
+   {
+      case TRACE_ZP:
+      case TRACE_ZPR:
+      case TRACE_ABS:
+         record->ea = word;
+         break;
+      case TRACE_ZPX:
+         record->ea = (uint8_t)(lo + x);
+         break;
+      case TRACE_ZPY:
+         record->ea = (uint8_t)(lo + y);
+         break;
+      case TRACE_ABX:
+         record->ea = (uint16_t)(word + x);
+         break;
+      case TRACE_ABY:
+         record->ea = (uint16_t)(word + y);
+         break;
+      case TRACE_IZX:
+         record->ea = trace_peek_word(cpu, (uint8_t)(lo + x), (uint8_t)(lo + x + 1));
+         break;
+      case TRACE_IZY:
+         record->ea = (uint16_t)(trace_peek_word(cpu, lo, (uint8_t)(lo + 1)) + y);
+         break;
+      case TRACE_IZP:
+         record->ea = trace_peek_word(cpu, lo, (uint8_t)(lo + 1));
+         break;
+      case TRACE_IND:
+         /* The NMOS parts do not carry into the high byte of the pointer */
+         if (flags & TRACE_FLAG_65C02)
+            record->ea = trace_peek_word(cpu, word, (uint16_t)(word + 1));
+         else
+            record->ea = trace_peek_word(cpu, word, (word & 0xff00) | (uint8_t)(lo + 1));
+         break;
+      case TRACE_IAX:
+         record->ea = trace_peek_word(cpu, (uint16_t)(word + x), (uint16_t)(word + x + 1));
+         break;
+      case TRACE_REL:
+         record->ea = (uint16_t)(pc + 2 + (int8_t)lo);
+         break;
+      default:
+         record->ea = 0;
+         flags &= ~TRACE_FLAG_EA;
+         break;
+   }
+
+   record->clk         = clk;
+   record->pc          = pc;
+   record->op[0]       = op;
+   record->op[1]       = lo;
+   record->op[2]       = hi;
+   record->a           = a;
+   record->x           = x;
+   record->y           = y;
+   record->sp          = sp;
+   record->p           = p;
+   record->cpu         = (uint8_t)cpu;
+   record->flags       = (uint8_t)flags;
+   record->reserved[0] = 0;
+   record->reserved[1] = 0;
+
+   if (++trace.fill == TRACE_CHUNK_RECORDS)
+      trace_hand_over();
+}
+
+/* Opens a new trace file, and traces the CPUs in `cpus' from the next
+ * instruction on */
+bool trace_start(const char *path, unsigned int cpus)
+{
+   trace_header_t header;
+
+   trace_stop();
+
+   memset(&trace.zs, 0, sizeof(trace.zs));
+   trace.records = (trace_record_t *)malloc(TRACE_CHUNKS * TRACE_CHUNK_RECORDS * sizeof(trace_record_t));
+   trace.out     = (uint8_t *)malloc(TRACE_OUT_SIZE);
+   trace.file    = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+
+   /* Fastest level, the records compress well anyway. The gzip wrapper
+    * lets zcat and friends read the file too */
+   if (!trace.records || !trace.out || !trace.file
+         || deflateInit2(&trace.zs, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      if (trace.file)
+         filestream_close(trace.file);
+      free(trace.records);
+      free(trace.out);
+      trace.records = NULL;
+      trace.out     = NULL;
+      trace.file    = NULL;
+      return false;
+   }
+
+   memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+   header.version     = TRACE_VERSION;
+   header.record_size = sizeof(trace_record_t);
+   header.order       = TRACE_ORDER;
+   header.reserved    = 0;
+
+   trace.head    = 0;
+   trace.fill    = 0;
+   trace.tail    = 0;
+   trace.full    = 0;
+   trace.written = 0;
+   trace.failed  = false;
+   trace_deflate(&header, sizeof(header), Z_NO_FLUSH);
+
+#ifdef HAVE_THREADS
+   trace_worker_start();
+#endif
+
+   trace_cpus = cpus;
+   return true;
+}
+
+/* Changes the traced CPUs of the open trace */
+void trace_set_cpus(unsigned int cpus)
+{
+   if (trace.file)
+      trace_cpus = cpus;
+}
+
+/* Writes the pending records and closes the trace. Returns the records
+ * written, or 0 if writing failed */
+uint64_t trace_stop(void)
+{
+   uint64_t written;
+
+   trace_cpus = 0;
+   if (!trace.file)
+      return 0;
+
+   if (trace.fill)
+      trace_hand_over();
+#ifdef HAVE_THREADS
+   trace_worker_stop();
+#endif
+
+   trace_deflate(NULL, 0, Z_FINISH);
+   deflateEnd(&trace.zs);
+   filestream_close(trace.file);
+   free(trace.records);
+   free(trace.out);
+
+   written       = trace.failed ? 0 : trace.written;
+   trace.records = NULL;
+   trace.out     = NULL;
+   trace.file    = NULL;
+   return written;
+}
@@ -0,0 +1,81 @@
+#ifndef LIBRETRO_TRACE_H
+#define LIBRETRO_TRACE_H
+
+#include <stdint.h>
+
+/* Execution trace, built in with TRACE=1. Every instruction of the traced
+ * CPUs is recorded before it executes: the clock, the PC, the opcode bytes,
+ * the registers and the effective address. Records are appended to
+ * preallocated chunks without locking, and full chunks are compressed and
+ * written by a worker thread. A trace file is gzip compressed, one
+ * trace_header_t followed by trace_record_t entries in host byte order,
+ * which vice_trace prints or compares. */
+
+#define TRACE_MAGIC   "VTRC"
+#define TRACE_VERSION 1
+#define TRACE_ORDER   0x01020304
+
+enum trace_cpu
+{
+   TRACE_CPU_MAIN = 0,
+   TRACE_CPU_DRIVE8,
+   TRACE_CPU_DRIVE9,
+   TRACE_CPU_DRIVE10,
+   TRACE_CPU_DRIVE11,
+   TRACE_CPU_NUM
+};
+
+#define TRACE_CPU_DRIVES  (((1 << TRACE_CPU_NUM) - 1) & ~(1 << TRACE_CPU_MAIN))
+
+/* Record flags */
+#define TRACE_FLAG_EA     0x01     /* Effective address is valid */
+#define TRACE_FLAG_65C02  0x02     /* R65C02 opcode set */
+
+typedef struct trace_header
+{
+   char magic[4];
+   uint16_t version;
+   uint16_t record_size;
+   uint32_t order;            /* TRACE_ORDER, as the host stores it */
+   uint32_t reserved;
+} trace_header_t;
+
+typedef struct trace_record
+{
+   uint32_t clk;              /* Clock of the CPU, drives count their own */
+   uint16_t pc;
+   uint16_t ea;
+   uint8_t op[3];             /* Opcode and operands, unused bytes zero */
+   uint8_t a;
+   uint8_t x;
+   uint8_t y;
+   uint8_t sp;
+   uint8_t p;
+   uint8_t cpu;               /* enum trace_cpu */
+   uint8_t flags;
+   uint8_t reserved[2];
+} trace_record_t;
+
+#ifdef RETRO_TRACE
+#include <stdbool.h>
+
+/* Mask of the traced CPUs, by enum trace_cpu */
+extern unsigned int trace_cpus;
+
+extern bool trace_start(const char *path, unsigned int cpus);
+extern void trace_set_cpus(unsigned int cpus);
+extern uint64_t trace_stop(void);
+extern void trace_insn(unsigned int cpu, unsigned int flags, uint32_t clk, uint16_t pc,
+      uint8_t op, uint8_t lo, uint8_t hi,
+      uint8_t a, uint8_t x, uint8_t y, uint8_t sp, uint8_t p);
+
+#define RETRO_TRACE_INSN(cpu, flags, clk, pc, op, lo, hi, a, x, y, sp, p) \
+   do { \
+      if (trace_cpus & (1 << (cpu))) \
+         trace_insn(cpu, flags, clk, pc, op, lo, hi, a, x, y, sp, p); \
+   } while (0)
+#else
+#define RETRO_TRACE_INSN(cpu, flags, clk, pc, op, lo, hi, a, x, y, sp, p)
+#endif
+
+#endif /* LIBRETRO_TRACE_H */
@@ -0,0 +1,668 @@
+#include <stdlib.h>
+#include <string.h>
+
+#define VFS_FRONTEND
+#include <vfs/vfs_implementation.h>
+#include <file/file_path.h>
+#include <streams/file_stream.h>
+
+#include "libretro-vfs.h"
+#include "archdep.h"
+
+extern retro_log_printf_t log_cb;
+
+struct vfs_archive
+{
+   void *handle;
+   vfs_archive_load_t load;
+   vfs_archive_close_t close;
+   struct vfs_archive *next;
+};
+
+typedef struct vfs_file
+{
+   char *path;
+   size_t size;
+   uint8_t *data;
+   vfs_archive_t *archive;
+   unsigned index;
+   bool borrowed;
+   bool materialized;
+} vfs_file_t;
+
+/* Open stream, either on the contents of a mounted file or on the
+ * underlying VFS once the file exists on disk */
+typedef struct vfs_handle
+{
+   struct retro_vfs_file_handle *real;
+   vfs_file_t *file;
+   char *path;
+   unsigned mode;
+   unsigned hints;
+   int64_t pos;
+} vfs_handle_t;
+
+static vfs_archive_t *vfs_archives = NULL;
+static vfs_file_t **vfs_files      = NULL;
+static unsigned vfs_files_num      = 0;
+static unsigned vfs_files_max      = 0;
+
+/* Frontend interface, or the libretro-common implementation if the
+ * frontend does not provide one */
+static struct retro_vfs_interface vfs_base =
+{
+   retro_vfs_file_get_path_impl,
+   retro_vfs_file_open_impl,
+   retro_vfs_file_close_impl,
+   retro_vfs_file_size_impl,
+   retro_vfs_file_tell_impl,
+   retro_vfs_file_seek_impl,
+   retro_vfs_file_read_impl,
+   retro_vfs_file_write_impl,
+   retro_vfs_file_flush_impl,
+   retro_vfs_file_remove_impl,
+   retro_vfs_file_rename_impl,
+   retro_vfs_file_truncate_impl,
+   retro_vfs_stat_impl,
+   retro_vfs_mkdir_impl,
+   retro_vfs_opendir_impl,
+   retro_vfs_readdir_impl,
+   retro_vfs_dirent_get_name_impl,
+   retro_vfs_dirent_is_dir_impl,
+   retro_vfs_closedir_impl
+};
+
+#define VFS_IS_SEP(c) ((c) == '/' || (c) == '\\')
+
+static char *vfs_path_normalize(const char *path)
+{
+   char *out = strdup(path);
+   char *p;
+
+   for (p = out; *p; p++)
+      if (VFS_IS_SEP(*p))
+         *p = FSDEV_DIR_SEP_CHR;
+   return out;
+}
+
+/* Compares up to `len' chars, separators are matched regardless of style */
+static bool vfs_path_equal(const char *a, const char *b, size_t len)
+{
+   for (; len; a++, b++, len--)
+   {
+      if (*a != *b && !(VFS_IS_SEP(*a) && VFS_IS_SEP(*b)))
+         return false;
+      if (!*a)
+         break;
+   }
+   return true;
+}
+
+static vfs_file_t *vfs_file_find(const char *path)
+{
+   unsigned i;
+
+   if (!path || !vfs_files_num)
+      return NULL;
+
+   for (i = 0; i < vfs_files_num; i++)
+      if (vfs_files[i]->path && vfs_path_equal(vfs_files[i]->path, path, (size_t)-1))
+         return vfs_files[i];
+   return NULL;
+}
+
+/* Directories only exist as the leading part of mounted file paths */
+static bool vfs_dir_find(const char *path)
+{
+   size_t len = strlen(path);
+   unsigned i;
+
+   while (len && VFS_IS_SEP(path[len - 1]))
+      len--;
+   if (!len)
+      return false;
+
+   for (i = 0; i < vfs_files_num; i++)
+   {
+      const char *file = vfs_files[i]->path;
+      if (file && vfs_path_equal(file, path, len) && file[len] == FSDEV_DIR_SEP_CHR)
+         return true;
+   }
+   return false;
+}
+
+static bool vfs_file_load(vfs_file_t *file)
+{
+   if (file->data || !file->size)
+      return true;
+   if (!file->archive)
+      return false;
+
+   if (!file->archive->load(file->archive->handle, file->index, &file->data, &file->size))
+   {
+      file->data = NULL;
+      return false;
+   }
+   return true;
+}
+
+static void vfs_mkdir_parents(const char *path)
+{
+   char *dir = strdup(path);
+   char *p;
+
+   for (p = dir + 1; *p; p++)
+   {
+      if (*p != FSDEV_DIR_SEP_CHR)
+         continue;
+      *p = '\0';
+      if (!(vfs_base.stat(dir, NULL) & RETRO_VFS_STAT_IS_DIRECTORY))
+         vfs_base.mkdir(dir);
+      *p = FSDEV_DIR_SEP_CHR;
+   }
+   free(dir);
+}
+
+/* Writes the file contents to disk, after which the file is only reached
+ * through the underlying VFS */
+static bool vfs_file_write_out(vfs_file_t *file)
+{
+   struct retro_vfs_file_handle *fp;
+   bool ok = true;
+
+   if (file->materialized)
+      return true;
+   if (!vfs_file_load(file))
+      return false;
+
+   vfs_mkdir_parents(file->path);
+   fp = vfs_base.open(file->path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+   if (!fp)
+      return false;
+
+   if (file->size && vfs_base.write(fp, file->data, file->size) != (int64_t)file->size)
+      ok = false;
+   vfs_base.close(fp);
+
+   if (!ok)
+   {
+      vfs_base.remove(file->path);
+      return false;
+   }
+
+   log_cb(RETRO_LOG_INFO, "VFS: Wrote %s\n", file->path);
+   file->materialized = true;
+   return true;
+}
+
+static bool vfs_handle_write_out(vfs_handle_t *h)
+{
+   if (h->real)
+      return true;
+   if (!vfs_file_write_out(h->file))
+      return false;
+
+   h->real = vfs_base.open(h->path, h->mode | RETRO_VFS_FILE_ACCESS_UPDATE_EXISTING, h->hints);
+   if (!h->real)
+      return false;
+   vfs_base.seek(h->real, h->pos, RETRO_VFS_SEEK_POSITION_START);
+   return true;
+}
+
+/* Interface */
+static const char *vfs_get_path(struct retro_vfs_file_handle *stream)
+{
+   return ((vfs_handle_t *)stream)->path;
+}
+
+static struct retro_vfs_file_handle *vfs_open(const char *path, unsigned mode, unsigned hints)
+{
+   vfs_file_t *file = vfs_file_find(path);
+   vfs_handle_t *h;
+
+   if (file && !file->materialized)
+   {
+      /* Truncating replaces the contents, so skip the decompression */
+      if ((mode & RETRO_VFS_FILE_ACCESS_WRITE) && !(mode & RETRO_VFS_FILE_ACCESS_UPDATE_EXISTING))
+      {
+         vfs_mkdir_parents(path);
+         file->materialized = true;
+         file = NULL;
+      }
+      else if (!vfs_file_load(file))
+         return NULL;
+   }
+   else
+      file = NULL;
+
+   h = (vfs_handle_t *)calloc(1, sizeof(vfs_handle_t));
+   if (!h)
+      return NULL;
+
+   if (!file)
+   {
+      h->real = vfs_base.open(path, mode, hints);
+      if (!h->real)
+      {
+         free(h);
+         return NULL;
+      }
+   }
+
+   h->file  = file;
+   h->path  = strdup(path);
+   h->mode  = mode;
+   h->hints = hints;
+   return (struct retro_vfs_file_handle *)h;
+}
+
+static int vfs_close(struct retro_vfs_file_handle *stream)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+   int ret = 0;
+
+   if (h->real)
+      ret = vfs_base.close(h->real);
+   free(h->path);
+   free(h);
+   return ret;
+}
+
+static int64_t vfs_size(struct retro_vfs_file_handle *stream)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+
+   if (h->real)
+      return vfs_base.size(h->real);
+   return (int64_t)h->file->size;
+}
+
+static int64_t vfs_truncate(struct retro_vfs_file_handle *stream, int64_t length)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+
+   if (!vfs_handle_write_out(h))
+      return -1;
+   return vfs_base.truncate(h->real, length);
+}
+
+static int64_t vfs_tell(struct retro_vfs_file_handle *stream)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+
+   if (h->real)
+      return vfs_base.tell(h->real);
+   return h->pos;
+}
+
+static int64_t vfs_seek(struct retro_vfs_file_handle *stream, int64_t offset, int seek_position)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+   int64_t pos;
+
+   if (h->real)
+      return vfs_base.seek(h->real, offset, seek_position);
+
+   switch (seek_position)
+   {
+      case RETRO_VFS_SEEK_POSITION_CURRENT:
+         pos = h->pos + offset;
+         break;
+      case RETRO_VFS_SEEK_POSITION_END:
+         pos = (int64_t)h->file->size + offset;
+         break;
+      default:
+         pos = offset;
+         break;
+   }
+
+   if (pos < 0)
+      return -1;
+   h->pos = pos;
+   return 0;
+}
+
+static int64_t vfs_read(struct retro_vfs_file_handle *stream, void *s, uint64_t len)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+   uint64_t left;
+
+   if (h->real)
+      return vfs_base.read(h->real, s, len);
+   if (!(h->mode & RETRO_VFS_FILE_ACCESS_READ))
+      return -1;
+
+   left = (h->pos < (int64_t)h->file->size) ? h->file->size - h->pos : 0;
+   if (len > left)
+      len = left;
+
+   if (len)
+      memcpy(s, h->file->data + h->pos, (size_t)len);
+   h->pos += len;
+   return (int64_t)len;
+}
+
+static int64_t vfs_write(struct retro_vfs_file_handle *stream, const void *s, uint64_t len)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+
+   if (!(h->mode & RETRO_VFS_FILE_ACCESS_WRITE) || !vfs_handle_write_out(h))
+      return -1;
+   return vfs_base.write(h->real, s, len);
+}
+
+static int vfs_flush(struct retro_vfs_file_handle *stream)
+{
+   vfs_handle_t *h = (vfs_handle_t *)stream;
+
+   if (h->real)
+      return vfs_base.flush(h->real);
+   return 0;
+}
+
+static int vfs_remove(const char *path)
+{
+   vfs_file_t *file = vfs_file_find(path);
+
+   /* Open streams may still read the contents until unmounting */
+   if (file)
+   {
+      bool materialized = file->materialized;
+
+      free(file->path);
+      file->path = NULL;
+      if (!materialized)
+         return 0;
+   }
+   return vfs_base.remove(path);
+}
+
+static int vfs_rename(const char *old_path, const char *new_path)
+{
+   vfs_file_t *file = vfs_file_find(old_path);
+
+   if (file && !vfs_file_write_out(file))
+      return -1;
+   if (file)
+   {
+      free(file->path);
+      file->path = NULL;
+   }
+   return vfs_base.rename(old_path, new_path);
+}
+
+static int vfs_stat(const char *path, int32_t *size)
+{
+   int ret = vfs_file_stat(path, size);
+
+   if (ret)
+      return ret;
+
+   ret = vfs_base.stat(path, size);
+   if (!ret && vfs_dir_find(path))
+      ret = RETRO_VFS_STAT_IS_VALID | RETRO_VFS_STAT_IS_DIRECTORY;
+   return ret;
+}
+
+static int vfs_mkdir(const char *dir)
+{
+   vfs_mkdir_parents(dir);
+   return vfs_base.mkdir(dir);
+}
+
+static struct retro_vfs_interface vfs_iface =
+{
+   vfs_get_path,
+   vfs_open,
+   vfs_close,
+   vfs_size,
+   vfs_tell,
+   vfs_seek,
+   vfs_read,
+   vfs_write,
+   vfs_flush,
+   vfs_remove,
+   vfs_rename,
+   vfs_truncate,
+   vfs_stat,
+   vfs_mkdir,
+   NULL,
+   NULL,
+   NULL,
+   NULL,
+   NULL
+};
+
+void vfs_init(const struct retro_vfs_interface_info *frontend_info)
+{
+   struct retro_vfs_interface_info info;
+   const struct retro_vfs_interface *frontend = NULL;
+
+   if (frontend_info && frontend_info->iface)
+      frontend = frontend_info->iface;
+
+   /* Same version requirements as file_stream and file_path_io */
+   if (frontend && frontend_info->required_interface_version >= 2)
+   {
+      unsigned version = frontend_info->required_interface_version;
+
+      vfs_base.get_path = frontend->get_path;
+      vfs_base.open     = frontend->open;
+      vfs_base.close    = frontend->close;
+      vfs_base.size     = frontend->size;
+      vfs_base.tell     = frontend->tell;
+      vfs_base.seek     = frontend->seek;
+      vfs_base.read     = frontend->read;
+      vfs_base.write    = frontend->write;
+      vfs_base.flush    = frontend->flush;
+      vfs_base.remove   = frontend->remove;
+      vfs_base.rename   = frontend->rename;
+      vfs_base.truncate = frontend->truncate;
+      if (version >= 3)
+      {
+         vfs_base.stat            = frontend->stat;
+         vfs_base.mkdir           = frontend->mkdir;
+         vfs_base.opendir         = frontend->opendir;
+         vfs_base.readdir         = frontend->readdir;
+         vfs_base.dirent_get_name = frontend->dirent_get_name;
+         vfs_base.dirent_is_dir   = frontend->dirent_is_dir;
+         vfs_base.closedir        = frontend->closedir;
+      }
+   }
+
+   vfs_iface.opendir         = vfs_base.opendir;
+   vfs_iface.readdir         = vfs_base.readdir;
+   vfs_iface.dirent_get_name = vfs_base.dirent_get_name;
+   vfs_iface.dirent_is_dir   = vfs_base.dirent_is_dir;
+   vfs_iface.closedir        = vfs_base.closedir;
+
+   info.required_interface_version = 3;
+   info.iface                      = &vfs_iface;
+   filestream_vfs_init(&info);
+   path_vfs_init(&info);
+}
+
+/* Mounting */
+vfs_archive_t *vfs_archive_add(void *handle, vfs_archive_load_t load, vfs_archive_close_t close)
+{
+   vfs_archive_t *archive = (vfs_archive_t *)calloc(1, sizeof(vfs_archive_t));
+
+   if (!archive)
+      return NULL;
+
+   archive->handle = handle;
+   archive->load   = load;
+   archive->close  = close;
+   archive->next   = vfs_archives;
+   vfs_archives    = archive;
+   return archive;
+}
+
+static vfs_file_t *vfs_file_new(const char *path)
+{
+   char *normalized = vfs_path_normalize(path);
+   vfs_file_t *file = vfs_file_find(normalized);
+
+   /* Remounting the same path hides the previous file */
+   if (file)
+   {
+      free(file->path);
+      file->path = NULL;
+   }
+
+   if (vfs_files_num == vfs_files_max)
+   {
+      unsigned max   = vfs_files_max ? vfs_files_max * 2 : 64;
+      vfs_file_t **p = (vfs_file_t **)realloc(vfs_files, max * sizeof(vfs_file_t *));
+
+      if (!p)
+      {
+         free(normalized);
+         return NULL;
+      }
+      vfs_files     = p;
+      vfs_files_max = max;
+   }
+
+   file = (vfs_file_t *)calloc(1, sizeof(vfs_file_t));
+   if (!file)
+   {
+      free(normalized);
+      return NULL;
+   }
+
+   file->path = normalized;
+   vfs_files[vfs_files_num++] = file;
+   return file;
+}
+
+bool vfs_file_add(const char *path, size_t size, vfs_archive_t *archive, unsigned index)
+{
+   vfs_file_t *file = vfs_file_new(path);
+
+   if (!file)
+      return false;
+
+   file->size    = size;
+   file->archive = archive;
+   file->index   = index;
+   return true;
+}
+
+/* The buffer has to stay valid until unmounting */
+bool vfs_file_add_buffer(const char *path, const void *data, size_t size)
+{
+   vfs_file_t *file = vfs_file_new(path);
+
+   if (!file)
+      return false;
+
+   file->size     = size;
+   file->data     = (uint8_t *)data;
+   file->borrowed = true;
+   return true;
+}
+
+bool vfs_file_add_data(const char *path, const void *data, size_t size)
+{
+   vfs_file_t *file = vfs_file_new(path);
+
+   if (!file)
+      return false;
+
+   file->size = size;
+   if (size)
+   {
+      file->data = (uint8_t *)malloc(size);
+      if (!file->data)
+      {
+         free(file->path);
+         file->path = NULL;
+         return false;
+      }
+      memcpy(file->data, data, size);
+   }
+   return true;
+}
+
+unsigned vfs_file_count(void)
+{
+   return vfs_files_num;
+}
+
+const char *vfs_file_path(unsigned index)
+{
+   if (index >= vfs_files_num)
+      return NULL;
+   return vfs_files[index]->path;
+}
+
+/* Returns RETRO_VFS_STAT_* flags for files that exist in memory only */
+int vfs_file_stat(const char *path, int32_t *size)
+{
+   vfs_file_t *file = vfs_file_find(path);
+
+   if (!file || file->materialized)
+      return 0;
+
+   if (size)
+      *size = (int32_t)file->size;
+   return RETRO_VFS_STAT_IS_VALID;
+}
+
+bool vfs_file_materialize(const char *path)
+{
+   vfs_file_t *file = vfs_file_find(path);
+
+   if (!file)
+      return false;
+   return vfs_file_write_out(file);
+}
+
+/* Moves a writable stream onto the underlying VFS, writing out the mounted
+ * file it reads first. The stream no longer touches the mounts afterwards,
+ * so it can be written from another thread */
+bool vfs_stream_write_out(RFILE *stream)
+{
+   vfs_handle_t *h = (vfs_handle_t *)filestream_get_vfs_handle(stream);
+
+   if (!h || !(h->mode & RETRO_VFS_FILE_ACCESS_WRITE))
+      return false;
+   return vfs_handle_write_out(h);
+}
+
+void vfs_materialize_all(void)
+{
+   unsigned i;
+
+   for (i = 0; i < vfs_files_num; i++)
+      if (vfs_files[i]->path)
+         vfs_file_write_out(vfs_files[i]);
+}
+
+void vfs_unmount_all(void)
+{
+   unsigned i;
+
+   for (i = 0; i < vfs_files_num; i++)
+   {
+      free(vfs_files[i]->path);
+      if (!vfs_files[i]->borrowed)
+         free(vfs_files[i]->data);
+      free(vfs_files[i]);
+   }
+   free(vfs_files);
+   vfs_files     = NULL;
+   vfs_files_num = 0;
+   vfs_files_max = 0;
+
+   while (vfs_archives)
+   {
+      vfs_archive_t *next = vfs_archives->next;
+
+      if (vfs_archives->close)
+         vfs_archives->close(vfs_archives->handle);
+      free(vfs_archives);
+      vfs_archives = next;
+   }
+}
@@ -0,0 +1,38 @@
+#ifndef LIBRETRO_VFS_H
+#define LIBRETRO_VFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libretro.h"
+#include <streams/file_stream.h>
+
+/* Archive contents are mounted in memory below a directory that does not
+ * need to exist, and every file stream the core opens is routed through
+ * here. Members are decompressed on first open, and only written to disk
+ * when something writes to them, such as a save disk. */
+
+typedef struct vfs_archive vfs_archive_t;
+
+/* Decompresses member `index' of the archive into a malloc'ed buffer */
+typedef bool (*vfs_archive_load_t)(void *handle, unsigned index, uint8_t **data, size_t *size);
+typedef void (*vfs_archive_close_t)(void *handle);
+
+void vfs_init(const struct retro_vfs_interface_info *frontend_info);
+
+vfs_archive_t *vfs_archive_add(void *handle, vfs_archive_load_t load, vfs_archive_close_t close);
+bool vfs_file_add(const char *path, size_t size, vfs_archive_t *archive, unsigned index);
+bool vfs_file_add_data(const char *path, const void *data, size_t size);
+bool vfs_file_add_buffer(const char *path, const void *data, size_t size);
+
+unsigned vfs_file_count(void);
+const char *vfs_file_path(unsigned index);
+int vfs_file_stat(const char *path, int32_t *size);
+
+bool vfs_file_materialize(const char *path);
+bool vfs_stream_write_out(RFILE *stream);
+void vfs_materialize_all(void);
+void vfs_unmount_all(void);
+
+#endif /* LIBRETRO_VFS_H */
@@ -0,0 +1,334 @@
+/* Decoder for the execution traces of the VICE libretro cores.
+ *
+ * Prints a trace as text, one instruction per line, or compares two traces
+ * and prints where they part, with the instructions leading up to it. The
+ * traces are written by cores built with TRACE=1, see README.
+ *
+ * Build with `make tracetool`, then for example:
+ *    ./vice_trace game.trace.gz | less
+ *    ./vice_trace -c drive8 -s 1000000 -n 50 game.trace.gz
+ *    ./vice_trace good.trace.gz bad.trace.gz
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "../libretro-trace.h"
+#include "../libretro-trace-ops.h"
+
+#define DEFAULT_CONTEXT    10
+#define MAX_CONTEXT        10000
+
+static const char *const mnemonics_6502[256] = {
+   "BRK",  "ORA",  "JAM",  "SLO",  "NOP",  "ORA",  "ASL",  "SLO",  "PHP",  "ORA",  "ASL",  "ANC",  "NOP",  "ORA",  "ASL",  "SLO",
+   "BPL",  "ORA",  "JAM",  "SLO",  "NOP",  "ORA",  "ASL",  "SLO",  "CLC",  "ORA",  "NOP",  "SLO",  "NOP",  "ORA",  "ASL",  "SLO",
+   "JSR",  "AND",  "JAM",  "RLA",  "BIT",  "AND",  "ROL",  "RLA",  "PLP",  "AND",  "ROL",  "ANC",  "BIT",  "AND",  "ROL",  "RLA",
+   "BMI",  "AND",  "JAM",  "RLA",  "NOP",  "AND",  "ROL",  "RLA",  "SEC",  "AND",  "NOP",  "RLA",  "NOP",  "AND",  "ROL",  "RLA",
+   "RTI",  "EOR",  "JAM",  "SRE",  "NOP",  "EOR",  "LSR",  "SRE",  "PHA",  "EOR",  "LSR",  "ASR",  "JMP",  "EOR",  "LSR",  "SRE",
+   "BVC",  "EOR",  "JAM",  "SRE",  "NOP",  "EOR",  "LSR",  "SRE",  "CLI",  "EOR",  "NOP",  "SRE",  "NOP",  "EOR",  "LSR",  "SRE",
+   "RTS",  "ADC",  "JAM",  "RRA",  "NOP",  "ADC",  "ROR",  "RRA",  "PLA",  "ADC",  "ROR",  "ARR",  "JMP",  "ADC",  "ROR",  "RRA",
+   "BVS",  "ADC",  "JAM",  "RRA",  "NOP",  "ADC",  "ROR",  "RRA",  "SEI",  "ADC",  "NOP",  "RRA",  "NOP",  "ADC",  "ROR",  "RRA",
+   "NOP",  "STA",  "NOP",  "SAX",  "STY",  "STA",  "STX",  "SAX",  "DEY",  "NOP",  "TXA",  "ANE",  "STY",  "STA",  "STX",  "SAX",
+   "BCC",  "STA",  "JAM",  "SHA",  "STY",  "STA",  "STX",  "SAX",  "TYA",  "STA",  "TXS",  "SHS",  "SHY",  "STA",  "SHX",  "SHA",
+   "LDY",  "LDA",  "LDX",  "LAX",  "LDY",  "LDA",  "LDX",  "LAX",  "TAY",  "LDA",  "TAX",  "LXA",  "LDY",  "LDA",  "LDX",  "LAX",
+   "BCS",  "LDA",  "JAM",  "LAX",  "LDY",  "LDA",  "LDX",  "LAX",  "CLV",  "LDA",  "TSX",  "LAS",  "LDY",  "LDA",  "LDX",  "LAX",
+   "CPY",  "CMP",  "NOP",  "DCP",  "CPY",  "CMP",  "DEC",  "DCP",  "INY",  "CMP",  "DEX",  "SBX",  "CPY",  "CMP",  "DEC",  "DCP",
+   "BNE",  "CMP",  "JAM",  "DCP",  "NOP",  "CMP",  "DEC",  "DCP",  "CLD",  "CMP",  "NOP",  "DCP",  "NOP",  "CMP",  "DEC",  "DCP",
+   "CPX",  "SBC",  "NOP",  "ISB",  "CPX",  "SBC",  "INC",  "ISB",  "INX",  "SBC",  "NOP",  "SBC",  "CPX",  "SBC",  "INC",  "ISB",
+   "BEQ",  "SBC",  "JAM",  "ISB",  "NOP",  "SBC",  "INC",  "ISB",  "SED",  "SBC",  "NOP",  "ISB",  "NOP",  "SBC",  "INC",  "ISB"
+};
+
+static const char *const mnemonics_65c02[256] = {
+   "BRK",  "ORA",  "NOP",  "NOP",  "TSB",  "ORA",  "ASL",  "RMB0", "PHP",  "ORA",  "ASL",  "NOP",  "TSB",  "ORA",  "ASL",  "BBR0",
+   "BPL",  "ORA",  "ORA",  "NOP",  "TRB",  "ORA",  "ASL",  "RMB1", "CLC",  "ORA",  "INC",  "NOP",  "TRB",  "ORA",  "ASL",  "BBR1",
+   "JSR",  "AND",  "NOP",  "NOP",  "BIT",  "AND",  "ROL",  "RMB2", "PLP",  "AND",  "ROL",  "NOP",  "BIT",  "AND",  "ROL",  "BBR2",
+   "BMI",  "AND",  "AND",  "NOP",  "BIT",  "AND",  "ROL",  "RMB3", "SEC",  "AND",  "DEC",  "NOP",  "BIT",  "AND",  "ROL",  "BBR3",
+   "RTI",  "EOR",  "NOP",  "NOP",  "NOP",  "EOR",  "LSR",  "RMB4", "PHA",  "EOR",  "LSR",  "NOP",  "JMP",  "EOR",  "LSR",  "BBR4",
+   "BVC",  "EOR",  "EOR",  "NOP",  "NOP",  "EOR",  "LSR",  "RMB5", "CLI",  "EOR",  "PHY",  "NOP",  "NOP",  "EOR",  "LSR",  "BBR5",
+   "RTS",  "ADC",  "NOP",  "NOP",  "STZ",  "ADC",  "ROR",  "RMB6", "PLA",  "ADC",  "ROR",  "NOP",  "JMP",  "ADC",  "ROR",  "BBR6",
+   "BVS",  "ADC",  "ADC",  "NOP",  "STZ",  "ADC",  "ROR",  "RMB7", "SEI",  "ADC",  "PLY",  "NOP",  "JMP",  "ADC",  "ROR",  "BBR7",
+   "BRA",  "STA",  "NOP",  "NOP",  "STY",  "STA",  "STX",  "SMB0", "DEY",  "BIT",  "TXA",  "NOP",  "STY",  "STA",  "STX",  "BBS0",
+   "BCC",  "STA",  "STA",  "NOP",  "STY",  "STA",  "STX",  "SMB1", "TYA",  "STA",  "TXS",  "NOP",  "STZ",  "STA",  "STZ",  "BBS1",
+   "LDY",  "LDA",  "NOP",  "NOP",  "LDY",  "LDA",  "LDX",  "SMB2", "TAY",  "LDA",  "TAX",  "NOP",  "LDY",  "LDA",  "LDX",  "BBS2",
+   "BCS",  "LDA",  "LDA",  "NOP",  "LDY",  "LDA",  "LDX",  "SMB3", "CLV",  "LDA",  "TSX",  "NOP",  "LDY",  "LDA",  "LDX",  "BBS3",
+   "CPY",  "CMP",  "NOP",  "NOP",  "CPY",  "CMP",  "DEC",  "SMB4", "INY",  "CMP",  "DEX",  "NOP",  "CPY",  "CMP",  "DEC",  "BBS4",
+   "BNE",  "CMP",  "CMP",  "NOP",  "NOP",  "CMP",  "DEC",  "SMB5", "CLD",  "CMP",  "PHX",  "NOP",  "NOP",  "CMP",  "DEC",  "BBS5",
+   "CPX",  "SBC",  "NOP",  "NOP",  "CPX",  "SBC",  "INC",  "SMB6", "INX",  "SBC",  "NOP",  "NOP",  "CPX",  "SBC",  "INC",  "BBS6",
+   "BEQ",  "SBC",  "SBC",  "NOP",  "NOP",  "SBC",  "INC",  "SMB7", "SED",  "SBC",  "PLX",  "NOP",  "NOP",  "SBC",  "INC",  "BBS7"
+};
+
+static const char *const cpu_names[TRACE_CPU_NUM] = {
+   "main", "drive8", "drive9", "drive10", "drive11"
+};
+
+typedef struct
+{
+   const char *path;
+   gzFile file;
+   unsigned cpus;             /* Mask of the CPUs read, by enum trace_cpu */
+   uint64_t index;            /* Records read, of the CPUs read */
+} reader_t;
+
+static bool reader_open(reader_t *reader, const char *path, unsigned cpus)
+{
+   trace_header_t header;
+
+   reader->path  = path;
+   reader->cpus  = cpus;
+   reader->index = 0;
+   if (!(reader->file = gzopen(path, "rb")))
+   {
+      fprintf(stderr, "Cannot open '%s'\n", path);
+      return false;
+   }
+   gzbuffer(reader->file, 1 << 18);
+
+   if (gzread(reader->file, &header, sizeof(header)) != sizeof(header)
+         || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)))
+      fprintf(stderr, "'%s' is not a trace\n", path);
+   else if (header.order != TRACE_ORDER)
+      fprintf(stderr, "'%s' is from a host of other byte order\n", path);
+   else if (header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t))
+      fprintf(stderr, "'%s' is trace version %u, not %u\n", path, header.version, TRACE_VERSION);
+   else
+      return true;
+
+   gzclose(reader->file);
+   return false;
+}
+
+/* Next record of the CPUs read. False at the end */
+static bool reader_next(reader_t *reader, trace_record_t *record)
+{
+   for (;;)
+   {
+      int got = gzread(reader->file, record, sizeof(*record));
+
+      if (got != sizeof(*record))
+      {
+         if (got)
+            fprintf(stderr, "'%s' is truncated\n", reader->path);
+         return false;
+      }
+      if (record->cpu < TRACE_CPU_NUM && (reader->cpus & (1 << record->cpu)))
+         break;
+   }
+   reader->index++;
+   return true;
+}
+
+static void format_operand(char *s, size_t size, const trace_record_t *record, unsigned mode)
+{
+   uint8_t lo    = record->op[1];
+   uint16_t word = record->op[1] | (record->op[2] << 8);
+
+   switch (mode)
+   {
+      case TRACE_IMM: snprintf(s, size, "#$%02x", lo); break;
+      case TRACE_ZP:  snprintf(s, size, "$%02x", lo); break;
+      case TRACE_ZPX: snprintf(s, size, "$%02x,X", lo); break;
+      case TRACE_ZPY: snprintf(s, size, "$%02x,Y", lo); break;
+      case TRACE_ABS: snprintf(s, size, "$%04x", word); break;
+      case TRACE_ABX: snprintf(s, size, "$%04x,X", word); break;
+      case TRACE_ABY: snprintf(s, size, "$%04x,Y", word); break;
+      case TRACE_IZX: snprintf(s, size, "($%02x,X)", lo); break;
+      case TRACE_IZY: snprintf(s, size, "($%02x),Y", lo); break;
+      case TRACE_IND: snprintf(s, size, "($%04x)", word); break;
+      case TRACE_REL: snprintf(s, size, "$%04x", (uint16_t)(record->pc + 2 + (int8_t)lo)); break;
+      case TRACE_IZP: snprintf(s, size, "($%02x)", lo); break;
+      case TRACE_IAX: snprintf(s, size, "($%04x,X)", word); break;
+      case TRACE_ZPR:
+         snprintf(s, size, "$%02x,$%04x", lo, (uint16_t)(record->pc + 3 + (int8_t)record->op[2]));
+         break;
+      default: *s = '\0'; break;
+   }
+}
+
+static void print_record(FILE *out, const char *prefix, uint64_t index, const trace_record_t *record)
+{
+   bool c02      = record->flags & TRACE_FLAG_65C02;
+   unsigned mode = c02 ? trace_modes_65c02[record->op[0]] : trace_modes_6502[record->op[0]];
+   unsigned size = trace_mode_size[mode];
+   char bytes[12];
+   char operand[16];
+   char flags[9];
+   unsigned i;
+
+   for (i = 0; i < 3; i++)
+      snprintf(bytes + i * 3, sizeof(bytes) - i * 3, i < size ? "%02x " : "   ", record->op[i]);
+   for (i = 0; i < 8; i++)
+      flags[i] = (record->p & (0x80 >> i)) ? "NV-BDIZC"[i] : '.';
+   flags[8] = '\0';
+   format_operand(operand, sizeof(operand), record, mode);
+
+   fprintf(out, "%s%10llu %-7s %10u  %04x  %s %-5s %-10s a=%02x x=%02x y=%02x sp=%02x %s",
+         prefix, (unsigned long long)index, cpu_names[record->cpu], record->clk, record->pc, bytes,
+         c02 ? mnemonics_65c02[record->op[0]] : mnemonics_6502[record->op[0]], operand,
+         record->a, record->x, record->y, record->sp, flags);
+   if (record->flags & TRACE_FLAG_EA)
+      fprintf(out, "  ea=%04x", record->ea);
+   fputc('\n', out);
+}
+
+static int dump(const char *path, unsigned cpus, uint64_t skip, uint64_t count)
+{
+   trace_record_t record;
+   reader_t reader;
+
+   if (!reader_open(&reader, path, cpus))
+      return 2;
+
+   while ((!count || reader.index < skip + count) && reader_next(&reader, &record))
+      if (reader.index > skip)
+         print_record(stdout, "", reader.index - 1, &record);
+
+   gzclose(reader.file);
+   return 0;
+}
+
+/* Names of the fields that differ, empty if none */
+static void compare_records(const trace_record_t *a, const trace_record_t *b, char *s, size_t size)
+{
+   size_t len = 0;
+
+   *s = '\0';
+#define COMPARE(cond, name) \
+   if ((cond) && len < size) \
+      len += snprintf(s + len, size - len, "%s" name, len ? " " : "")
+   COMPARE(a->cpu != b->cpu, "cpu");
+   COMPARE(a->clk != b->clk, "clk");
+   COMPARE(a->pc != b->pc, "pc");
+   COMPARE(memcmp(a->op, b->op, sizeof(a->op)), "opcode");
+   COMPARE(a->a != b->a, "a");
+   COMPARE(a->x != b->x, "x");
+   COMPARE(a->y != b->y, "y");
+   COMPARE(a->sp != b->sp, "sp");
+   COMPARE(a->p != b->p, "p");
+   COMPARE(a->flags != b->flags || ((a->flags & TRACE_FLAG_EA) && a->ea != b->ea), "ea");
+#undef COMPARE
+}
+
+static int diff(const char *path_a, const char *path_b, unsigned cpus, unsigned context)
+{
+   trace_record_t *history = calloc(context + 1, sizeof(trace_record_t));
+   trace_record_t a, b;
+   reader_t reader_a, reader_b;
+   char fields[64];
+   int result = 1;
+
+   if (!history || !reader_open(&reader_a, path_a, cpus))
+      return 2;
+   if (!reader_open(&reader_b, path_b, cpus))
+   {
+      gzclose(reader_a.file);
+      return 2;
+   }
+
+   for (;;)
+   {
+      bool more_a = reader_next(&reader_a, &a);
+      bool more_b = reader_next(&reader_b, &b);
+      uint64_t index = reader_a.index - more_a;
+      uint64_t first = (index > context) ? index - context : 0;
+      uint64_t i;
+
+      if (!more_a || !more_b)
+      {
+         if (more_a == more_b)
+         {
+            printf("Traces match, %llu records\n", (unsigned long long)index);
+            result = 0;
+         }
+         else
+            printf("'%s' ends after %llu records\n", more_a ? path_b : path_a, (unsigned long long)index);
+         break;
+      }
+
+      compare_records(&a, &b, fields, sizeof(fields));
+      if (!*fields)
+      {
+         history[index % (context + 1)] = a;
+         continue;
+      }
+
+      printf("Traces part at record %llu, in %s\n", (unsigned long long)index, fields);
+      for (i = first; i < index; i++)
+         print_record(stdout, "  ", i, &history[i % (context + 1)]);
+      print_record(stdout, "- ", index, &a);
+      print_record(stdout, "+ ", index, &b);
+      break;
+   }
+
+   gzclose(reader_a.file);
+   gzclose(reader_b.file);
+   free(history);
+   return result;
+}
+
+static void usage(const char *name)
+{
+   fprintf(stderr,
+         "Usage: %s [options] <trace>\n"
+         "       %s [options] <trace> <other trace>\n"
+         "\n"
+         "Prints the instructions of a trace, or where two traces part.\n"
+         "Exits with 1 if the traces differ.\n"
+         "\n"
+         "  -c cpu         Only this CPU: main, drive8-drive11, repeatable\n"
+         "  -s records     Records to skip before printing\n"
+         "  -n records     Records to print\n"
+         "  -C records     Records printed before the parting (default: %u)\n",
+         name, name, DEFAULT_CONTEXT);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned cpus    = 0;
+   unsigned context = DEFAULT_CONTEXT;
+   uint64_t skip    = 0;
+   uint64_t count   = 0;
+   unsigned i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "c:s:n:C:h")) != -1)
+   {
+      switch (opt)
+      {
+         case 'c':
+            for (i = 0; i < TRACE_CPU_NUM && strcmp(optarg, cpu_names[i]); i++);
+            if (i == TRACE_CPU_NUM)
+            {
+               fprintf(stderr, "Unknown CPU '%s'\n", optarg);
+               return 2;
+            }
+            cpus |= 1 << i;
+            break;
+         case 's': skip = strtoull(optarg, NULL, 10); break;
+         case 'n': count = strtoull(optarg, NULL, 10); break;
+         case 'C':
+            context = (unsigned)strtoul(optarg, NULL, 10);
+            if (context > MAX_CONTEXT)
+               context = MAX_CONTEXT;
+            break;
+         default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+      }
+   }
+   if (!cpus)
+      cpus = (1 << TRACE_CPU_NUM) - 1;
+
+   if (argc - optind == 1)
+      return dump(argv[optind], cpus, skip, count);
+   if (argc - optind == 2)
+      return diff(argv[optind], argv[optind + 1], cpus, context);
+
+   usage(argv[0]);
+   return 2;
+}
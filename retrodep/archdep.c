@@ -77,6 +77,7 @@
 #include "arch/shared/archdep_quote_unzip.c"
 
 #include "libretro-core.h"
+#include "libretro-vfs.h"
 extern unsigned int opt_read_vicerc;
 extern char full_path[RETRO_PATH_MAX];
 extern char retro_temp_directory[RETRO_PATH_MAX];
@@ -86,6 +87,15 @@ static char *boot_path = NULL;
 
 static int libretro_stat(const char *path, struct stat *statbuf)
 {
+    int32_t size;
+
+    /* Archive members mounted in memory */
+    if (vfs_file_stat(path, &size)) {
+        memset(statbuf, 0, sizeof(*statbuf));
+        statbuf->st_mode = S_IFREG | 0644;
+        statbuf->st_size = size;
+        return 0;
+    }
 #ifdef USE_LIBRETRO_VFS
     return stat(utf8_to_local_string_alloc(path), statbuf);
 #else
@@ -529,6 +539,8 @@ char *archdep_tmpnam(void)
     return lib_strdup(tmpName);
 #elif __LIBRETRO__
     char tmp_name[RETRO_PATH_MAX];
+    /* The temporary directory is otherwise only created for archive contents */
+    path_mkdir(retro_temp_directory);
     snprintf(tmp_name, sizeof(tmp_name), "%s%s%s%d", retro_temp_directory, FSDEV_DIR_SEP_STR, "vice-tmp-", rand());
     return lib_strdup(tmp_name);
 #else
@@ -665,6 +677,27 @@ int archdep_file_is_chardev(const char *name)
     return 0;
 }
 
+int archdep_file_mtime(const char *path, int64_t *mtime)
+{
+    struct stat statbuf;
+
+    if (libretro_stat(path, &statbuf) != 0) {
+        *mtime = 0;
+        return -1;
+    }
+    *mtime = (int64_t)statbuf.st_mtime;
+    return 0;
+}
+
+int archdep_access(const char *pathname, int mode)
+{
+    /* Mounted archive members are written to disk on the first write */
+    if (vfs_file_stat(pathname, NULL)) {
+        return 0;
+    }
+    return access(pathname, mode);
+}
+
 int archdep_stat(const char *path, size_t *len, unsigned int *isdir)
 {
     struct stat statbuf;
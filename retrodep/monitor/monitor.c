@@ -752,6 +752,11 @@ void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem)
 void monitor_watch_push_store_addr(uint16_t addr, MEMSPACE mem)
 {
 }
+
+bool monitor_watched_page(MEMSPACE mem, unsigned int page, bool store)
+{
+    return FALSE;
+}
 #if 0
 static bool watchpoints_check_loads(MEMSPACE mem, unsigned int lastpc, unsigned int pc)
 {
@@ -1033,6 +1033,13 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
             break;
         }
 
+        /* Padding after the last module of a memory snapshot, such as
+           the zeroes of a buffer bigger than the state, would not advance */
+        if (m->size < SNAPSHOT_MODULE_NAME_LEN + 6) {
+            snapshot_error = SNAPSHOT_MODULE_NOT_FOUND_ERROR;
+            goto fail;
+        }
+
         m->offset += m->size;
         if (snapshot_fseek(s->file, m->offset, SEEK_SET) < 0) {
             snapshot_error = SNAPSHOT_MODULE_NOT_FOUND_ERROR;
@@ -165,8 +165,16 @@ int ui_init_finish(void)
 
 extern int log_resources_set_int(const char *name, int value);
 extern int log_resources_set_string(const char *name, const char* value);
+extern int log_resources_force_int(const char *name, int value);
+extern int log_resources_force_string(const char *name, const char* value);
 
-int ui_init_finalize(void)
+/* Machine is initialized, and the original ROMs have been saved */
+static bool ui_machine_ready = false;
+
+/* Applies the core options to the resources. Runs before the command line
+ * and machine initialization on startup, so that the machine starts with
+ * them, and again whenever content is reloaded */
+int ui_init_options(void)
 {
    /* Dump machine specific defaults for 'vicerc' usage, if not already dumped */
    char resources_dump_path[RETRO_PATH_MAX] = {0};
@@ -296,7 +304,9 @@ int ui_init_finalize(void)
    /* Media */
    log_resources_set_int("AutostartWarp", vice_opt.AutostartWarp);
    log_resources_set_int("DriveTrueEmulation", vice_opt.DriveTrueEmulation);
+   log_resources_set_int("DriveAdaptiveRotation", vice_opt.DriveAdaptiveRotation);
    log_resources_set_int("VirtualDevices", vice_opt.VirtualDevices);
+   log_resources_set_int("DatasetteAccelerate", vice_opt.DatasetteAccelerate);
    log_resources_set_int("AttachDevice8Readonly", vice_opt.AttachDevice8Readonly);
 #if defined(__X64__) || defined(__X64SC__) || defined(__X128__)
    log_resources_set_int("EasyFlashWriteCRT", vice_opt.EasyFlashWriteCRT);
@@ -305,7 +315,8 @@ int ui_init_finalize(void)
    /* ROM */
 #if defined(__XSCPU64__)
    /* Replace kernal always from backup, because kernal loading replaces the embedded variable */
-   memcpy(scpu64rom_scpu64_rom, scpu64rom_scpu64_rom_original, SCPU64_SCPU64_ROM_MAXSIZE);
+   if (ui_machine_ready)
+      memcpy(scpu64rom_scpu64_rom, scpu64rom_scpu64_rom_original, SCPU64_SCPU64_ROM_MAXSIZE);
    switch (opt_supercpu_kernal)
    {
       case 2:
@@ -322,13 +333,17 @@ int ui_init_finalize(void)
 
    /* JiffyDOS */
 #if defined(__X64__) || defined(__X64SC__) || defined(__X128__) || defined(__XSCPU64__)
-   /* Replace kernal always from backup, because kernal loading replaces the embedded variable */
+   /* Replace kernal always from backup, because kernal loading replaces the embedded variable.
+    * The ROM names are set even when unchanged, which loads the ROMs again */
+   if (ui_machine_ready)
+   {
 #if defined(__X64__) || defined(__X64SC__)
-   memcpy(c64memrom_kernal64_rom, c64memrom_kernal64_rom_original, C64_KERNAL_ROM_SIZE);
+      memcpy(c64memrom_kernal64_rom, c64memrom_kernal64_rom_original, C64_KERNAL_ROM_SIZE);
 #elif defined(__X128__)
-   memcpy(c128kernal64_embedded, c128memrom_kernal64_rom_original, C128_KERNAL64_ROM_SIZE);
-   memcpy(kernal_int, c128memrom_kernal128_rom_original, C128_KERNAL_ROM_IMAGE_SIZE);
+      memcpy(c128kernal64_embedded, c128memrom_kernal64_rom_original, C128_KERNAL64_ROM_SIZE);
+      memcpy(kernal_int, c128memrom_kernal128_rom_original, C128_KERNAL_ROM_IMAGE_SIZE);
 #endif
+   }
    char tmp_str[RETRO_PATH_MAX] = {0};
    if (opt_jiffydos)
    {
@@ -336,57 +351,59 @@ int ui_init_finalize(void)
       resources_get_int("Drive8Type", &drive_type);
 
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_1541-II.bin");
-      log_resources_set_string("DosName1541ii", (const char*)tmp_str);
+      log_resources_force_string("DosName1541ii", (const char*)tmp_str);
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_1571_repl310654.bin");
-      log_resources_set_string("DosName1571", (const char*)tmp_str);
+      log_resources_force_string("DosName1571", (const char*)tmp_str);
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_1581.bin");
-      log_resources_set_string("DosName1581", (const char*)tmp_str);
+      log_resources_force_string("DosName1581", (const char*)tmp_str);
 
 #if defined(__X64__) || defined(__X64SC__)
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_C64.bin");
-      log_resources_set_string("KernalName", (const char*)tmp_str);
+      log_resources_force_string("KernalName", (const char*)tmp_str);
 #elif defined(__X128__)
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_C64.bin");
-      log_resources_set_string("Kernal64Name", (const char*)tmp_str);
+      log_resources_force_string("Kernal64Name", (const char*)tmp_str);
       snprintf(tmp_str, sizeof(tmp_str), "%s%c%s", retro_system_data_directory, FSDEV_DIR_SEP_CHR, "JiffyDOS_C128.bin");
-      log_resources_set_string("KernalIntName", (const char*)tmp_str);
+      log_resources_force_string("KernalIntName", (const char*)tmp_str);
 #endif
 
 #if defined(__X64__) || defined(__X64SC__) || defined(__XSCPU64__)
       /* 1541-II ROM will not work unless drive type is set back to whatever it already is ?! */
-      log_resources_set_int("Drive8Type", drive_type);
+      log_resources_force_int("Drive8Type", drive_type);
 #endif
    }
    else
    {
-      log_resources_set_string("DosName1541ii", "d1541II");
-      log_resources_set_string("DosName1571", "dos1571");
-      log_resources_set_string("DosName1581", "dos1581");
+      log_resources_force_string("DosName1541ii", "d1541II");
+      log_resources_force_string("DosName1571", "dos1571");
+      log_resources_force_string("DosName1581", "dos1581");
 #if defined(__X64__) || defined(__X64SC__)
-      log_resources_set_string("KernalName", "kernal");
+      log_resources_force_string("KernalName", "kernal");
 #elif defined(__X128__)
-      log_resources_set_string("Kernal64Name", "kernal64");
-      log_resources_set_string("KernalIntName", "kernal");
+      log_resources_force_string("Kernal64Name", "kernal64");
+      log_resources_force_string("KernalIntName", "kernal");
 #endif
    }
 #endif
 
    /* Model */
+   int model = emu_model_startup();
 #if defined(__XPET__)
-   petmodel_set(vice_opt.Model);
-   keyboard_init();
+   petmodel_set(model);
+   if (ui_machine_ready)
+      keyboard_init();
 #elif defined(__XCBM2__) || defined(__XCBM5x0__)
-   cbm2model_set(vice_opt.Model);
+   cbm2model_set(model);
 #elif defined(__XVIC__)
-   vic20model_set(vice_opt.Model);
+   vic20model_set(model);
 #elif defined(__XPLUS4__)
-   plus4model_set(vice_opt.Model);
+   plus4model_set(model);
 #elif defined(__X128__)
-   c128model_set(vice_opt.Model);
+   c128model_set(model);
 #elif defined(__X64DTV__)
-   dtvmodel_set(vice_opt.Model);
+   dtvmodel_set(model);
 #else
-   c64model_set(vice_opt.Model);
+   c64model_set(model);
 #endif
 
    /* Audio */
@@ -492,7 +509,17 @@ int ui_init_finalize(void)
       log_resources_set_string("CartridgeFile", vice_opt.CartridgeFile);
 #endif
 
+   return 0;
+}
+
+int ui_init_finalize(void)
+{
+   ui_machine_ready   = true;
    retro_ui_finalized = true;
+   retro_profiler_update();
+#ifdef RETRO_TRACE
+   retro_trace_update();
+#endif
    return 0;
 }
 
@@ -45,6 +45,7 @@
 #include "libretro-core.h"
 #include "libretro-graph.h"
 #include "libretro-mapper.h"
+#include "libretro-perf.h"
 
 extern unsigned int mouse_value[2 + 1];
 extern unsigned int vice_led_state[RETRO_LED_NUM];
@@ -694,6 +695,8 @@ void uistatusbar_draw(void)
     unsigned int char_scale_x = 1;
     int x = 0, y = 0;
 
+    int perf_page = 0;
+
     unsigned int color_f, color_b;
     unsigned int color_black, color_white,
             color_red, color_greenb, color_green, color_greend,
@@ -743,8 +746,13 @@ void uistatusbar_draw(void)
         led_width = (char_width * 3) - x_align_offset - 1;
     led_x = retroXS_offset + x + max_width - led_width - 1;
 
+#ifdef RETRO_PERF_COUNTERS
+    /* Frame time counters in place of the joyports, unless there is a message */
+    perf_page = (opt_statusbar & STATUSBAR_PERF) && !statusbar_message_timer;
+#endif
+
     /* Basic mode statusbar background */
-    if (opt_statusbar & STATUSBAR_BASIC && !statusbar_message_timer)
+    if (opt_statusbar & STATUSBAR_BASIC && !statusbar_message_timer && !perf_page)
     {
         bkg_width = led_width;
         bkg_x     = led_x;
@@ -765,6 +773,15 @@ void uistatusbar_draw(void)
         draw_text(bkg_x + char_offset, y, color_f, color_b, GRAPH_ALPHA_100, GRAPH_BG_ALL, char_scale_x, 1, 100, statusbar_text);
         draw_fbox(led_x, bkg_y, led_width, bkg_height, 0, GRAPH_ALPHA_100);
     }
+#ifdef RETRO_PERF_COUNTERS
+    else if (perf_page)
+    {
+        unsigned char perf_text[80];
+
+        retro_perf_statusbar((char *)perf_text, sizeof(perf_text));
+        draw_text(bkg_x + char_offset, y, color_f, color_b, GRAPH_ALPHA_100, GRAPH_BG_ALL, char_scale_x, 1, 100, perf_text);
+    }
+#endif
     else if (!(opt_statusbar & STATUSBAR_BASIC))
     {
         draw_text(bkg_x + (max_width / 2) - (20), y, color_f, color_b, GRAPH_ALPHA_100, GRAPH_BG_ALL, char_scale_x, 1, 10, statusbar_resolution);
@@ -779,7 +796,7 @@ void uistatusbar_draw(void)
         if (c == 0)
             continue;
         
-        if (statusbar_message_timer && i < STATUSBAR_TAPE_POS - 1)
+        if ((statusbar_message_timer || perf_page) && i < STATUSBAR_TAPE_POS - 1)
             continue;
 
         if (!retro_statusbar && statusbar_message_timer && (opt_statusbar & STATUSBAR_MESSAGES))
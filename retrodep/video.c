@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "libretro-core.h"
+#include "libretro-perf.h"
 
 int machine_ui_done = 0;
 
@@ -45,7 +46,10 @@ void video_canvas_resize(struct video_canvas_s *canvas, char resize_canvas)
 video_canvas_t *video_canvas_create(video_canvas_t *canvas, 
       unsigned int *width, unsigned int *height, int mapped)
 {
-   canvas->videoconfig->rendermode = VIDEO_RENDER_RGB_1X1;
+   /* Single size mode of the chip, as the DoubleSize resource would set,
+    * otherwise the CRT emulation is not rendered */
+   canvas->videoconfig->rendermode = (canvas->videoconfig->cap)
+         ? canvas->videoconfig->cap->single_mode.rmode : VIDEO_RENDER_RGB_1X1;
    canvas->depth = 8*pix_bytes;
    video_canvas_set_palette(canvas, canvas->palette);
    return canvas;
@@ -64,6 +68,106 @@ char video_canvas_can_resize(video_canvas_t *canvas)
    return 1;
 }
 
+/* Automatic crop row scan results, kept between frames so that only rows
+ * with changed draw buffer content need to be scanned again */
+#define CROP_ROW_UNKNOWN 0xff
+
+static struct {
+   uint8_t *rows;
+   uint8_t *hit;
+   unsigned width;
+   unsigned height;
+   const video_canvas_t *canvas;
+   int valid;
+} crop_cache = {NULL, NULL, 0, 0, NULL, 0};
+
+static void crop_cache_update(const video_canvas_t *canvas, unsigned width, unsigned height)
+{
+   if (!crop_cache.valid || crop_cache.canvas != canvas ||
+       crop_cache.width != width || crop_cache.height != height)
+   {
+      if (crop_cache.width * crop_cache.height < width * height)
+         crop_cache.rows = lib_realloc(crop_cache.rows, width * height);
+      if (crop_cache.height < height)
+         crop_cache.hit  = lib_realloc(crop_cache.hit, height);
+
+      crop_cache.width  = width;
+      crop_cache.height = height;
+      crop_cache.canvas = canvas;
+      crop_cache.valid  = 1;
+      memset(crop_cache.hit, CROP_ROW_UNKNOWN, height);
+   }
+}
+
+/* Returns nonzero if all pixels of the row are the same, checked a word at a time */
+static int crop_row_is_uniform(const uint8_t *row, unsigned width)
+{
+   uint64_t pattern = row[0] * UINT64_C(0x0101010101010101);
+   uint64_t word;
+   unsigned j = 0;
+
+   for (; j + 8 <= width; j += 8)
+   {
+      memcpy(&word, row + j, sizeof(word));
+      if (word != pattern)
+         return 0;
+   }
+
+   for (; j < width; j++)
+      if (row[j] != row[0])
+         return 0;
+
+   return 1;
+}
+
+/* Pixel color per row must return to the background color
+ * in order to count as a show-worthy row, otherwise
+ * loaders with flashing borders would count as hits */
+static int crop_row_has_content(const video_canvas_t *canvas,
+      const uint8_t *row, unsigned width, unsigned color_diff)
+{
+   unsigned color = canvas->crop_color[row[0]];
+   unsigned found = 0;
+   unsigned j     = 0;
+
+   if (crop_row_is_uniform(row, width))
+      return 0;
+
+   for (j = 0; j < width; j++)
+   {
+      unsigned pixel = canvas->crop_color[row[j]];
+
+      if (abs((int)(pixel - color)) > color_diff)
+         found++;
+
+      if (found && pixel == color)
+         return 1;
+   }
+
+   return 0;
+}
+
+/* Scans a row of the indexed draw buffer, unless it is unchanged since the previous scan */
+static int crop_row_scan(const video_canvas_t *canvas, unsigned i, unsigned color_diff)
+{
+   unsigned x0     = CROP_LEFT_BORDER + 8;
+   unsigned width  = retrow - x0 - x0;
+   uint8_t *cached = crop_cache.rows + (i * crop_cache.width);
+   const uint8_t *row = canvas->draw_buffer->draw_buffer
+         + ((retroYS + i) * canvas->draw_buffer->draw_buffer_width)
+         + retroXS + x0;
+
+   if (crop_cache.hit[i] != CROP_ROW_UNKNOWN && !memcmp(cached, row, width))
+      return crop_cache.hit[i];
+
+   memcpy(cached, row, width);
+   crop_cache.hit[i] = crop_row_has_content(canvas, row, width, color_diff);
+#if 0
+   printf("%s: %3d %d\n", __func__, i, crop_cache.hit[i]);
+#endif
+   return crop_cache.hit[i];
+}
+
 int video_canvas_set_palette(struct video_canvas_s *canvas,
                              struct palette_s *palette)
 {
@@ -82,7 +186,12 @@ int video_canvas_set_palette(struct video_canvas_s *canvas,
          col = palette->entries[i].red << 16 | palette->entries[i].green << 8 | palette->entries[i].blue;
 
       video_render_setphysicalcolor(canvas->videoconfig, i, col, canvas->depth);
+
+      /* Same value as read from retro_bmp by the former RGB based scan */
+      if (i < 256)
+         canvas->crop_color[i] = col & 0xffff;
    }
+   crop_cache.valid = 0;
 
    for (i = 0; i < 256; i++) {
       if (pix_bytes == 2)
@@ -95,28 +204,13 @@ int video_canvas_set_palette(struct video_canvas_s *canvas,
    return 0;
 }
 
-void video_canvas_refresh(struct video_canvas_s *canvas,
-      unsigned int xs, unsigned int ys,
-      unsigned int xi, unsigned int yi,
-      unsigned int w, unsigned int h)
-{ 
+/* Automatic crop of the rendered frame */
+static void video_canvas_crop(const video_canvas_t *canvas)
+{
    unsigned i = 0;
-   unsigned j = 0;
    unsigned color_diff = 0;
    unsigned crop_bottom_border = 0;
 
-#ifdef RETRO_DEBUG
-   printf("XS:%d YS:%d XI:%d YI:%d W:%d H:%d\n",xs,ys,xi,yi,w,h);
-#endif
-
-   video_canvas_render(
-         canvas, (uint8_t *)&retro_bmp,
-         retrow, retroh,
-         retroXS, retroYS,
-         0, 0, /*xi, yi,*/
-         retrow*pix_bytes, 8*pix_bytes
-   );
-
    if (!retroh || crop_id < CROP_AUTO)
       return;
 
@@ -127,40 +221,22 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
    switch (crop_id)
    {
       case CROP_AUTO:
-         /* Pixel color per row must return to the background color
-          * in order to count as a show-worthy row, otherwise
-          * loaders with flashing borders would count as hits */
          color_diff         = 3000 * pix_bytes;
          crop_bottom_border = CROP_TOP_BORDER + CROP_HEIGHT_MAX;
 
+         if (retrow <= (CROP_LEFT_BORDER + 8) * 2)
+            break;
+
+         crop_cache_update(canvas, retrow, retroh);
+
          /* Top border, start from top */
          for (i = 0; i < CROP_TOP_BORDER && !vice_raster.blanked; i++)
          {
-            unsigned row   = i * (retrow << (pix_bytes >> 2));
-            unsigned pad   = 8;
-            unsigned col_x = row + (CROP_LEFT_BORDER + pad) * (pix_bytes >> 1);
-            unsigned color = retro_bmp[col_x];
-            unsigned found = 0;
-
-            for (j = CROP_LEFT_BORDER + pad; j < retrow - CROP_LEFT_BORDER - pad; j++)
+            if (crop_row_scan(canvas, i, color_diff))
             {
-               unsigned pixel = row + j * (pix_bytes >> 1);
-
-               if (abs(retro_bmp[pixel] - color) > color_diff)
-                  found++;
-
-               if (found && retro_bmp[pixel] == color)
-               {
-#if 0
-                  printf("%s: FRST %3d %3d, %3d %d\n", __func__, i, j, found, color);
-#endif
-                  vice_raster.first_line = i;
-                  break;
-               }
-            }
-
-            if (vice_raster.first_line < CROP_TOP_BORDER)
+               vice_raster.first_line = i;
                break;
+            }
          }
 
          /* Allow bottom border upwards a few rows if top border is not used much.
@@ -171,31 +247,11 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
          /* Bottom border, start from bottom, almost */
          for (i = retroh - 2; i > crop_bottom_border && !vice_raster.blanked; i--)
          {
-            unsigned row   = i * (retrow << (pix_bytes >> 2));
-            unsigned pad   = 8;
-            unsigned col_x = row + (CROP_LEFT_BORDER + pad) * (pix_bytes >> 1);
-            unsigned color = retro_bmp[col_x];
-            unsigned found = 0;
-
-            for (j = CROP_LEFT_BORDER + pad; j < retrow - CROP_LEFT_BORDER - pad; j++)
+            if (crop_row_scan(canvas, i, color_diff))
             {
-               unsigned pixel = row + j * (pix_bytes >> 1);
-
-               if (abs(retro_bmp[pixel] - color) > color_diff)
-                  found++;
-
-               if (found && retro_bmp[pixel] == color)
-               {
-#if 0
-                  printf("%s: LAST %3d %3d, %3d %d\n", __func__, i, j, found, color);
-#endif
-                  vice_raster.last_line = i + 1;
-                  break;
-               }
-            }
-
-            if (vice_raster.last_line > CROP_TOP_BORDER + CROP_HEIGHT_MAX)
+               vice_raster.last_line = i + 1;
                break;
+            }
          }
 
          /* Align the resulting screen height to even number */
@@ -280,6 +336,35 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
    vice_raster.blanked         = 0;
 }
 
+void video_canvas_refresh(struct video_canvas_s *canvas,
+      unsigned int xs, unsigned int ys,
+      unsigned int xi, unsigned int yi,
+      unsigned int w, unsigned int h)
+{ 
+#ifdef RETRO_DEBUG
+   printf("XS:%d YS:%d XI:%d YI:%d W:%d H:%d\n",xs,ys,xi,yi,w,h);
+#endif
+
+   /* Changed video options repaint once with the next frame instead of
+    * immediately for every resource set */
+   if (updating_variables)
+      return;
+
+   RETRO_PERF_ENTER(RETRO_PERF_CANVAS);
+
+   video_canvas_render(
+         canvas, (uint8_t *)&retro_bmp,
+         retrow, retroh,
+         retroXS, retroYS,
+         0, 0, /*xi, yi,*/
+         retrow*pix_bytes, 8*pix_bytes
+   );
+
+   video_canvas_crop(canvas);
+
+   RETRO_PERF_LEAVE();
+}
+
 int video_init()
 {
    return 0;
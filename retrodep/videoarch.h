@@ -29,6 +29,9 @@ typedef struct video_canvas_s {
     struct video_draw_buffer_callback_s *video_draw_buffer_callback;
     
     unsigned int depth;
+
+    /** \brief Palette colors as compared by the automatic crop. */
+    unsigned short crop_color[256];
 } video_canvas_t;
 
 typedef struct vice_renderer_backend_s {
@@ -56,6 +56,7 @@ void vsyncarch_presync(void)
     }
 #endif
     retro_renderloop = 0;
+    retro_warp_frame_end();
     retro_lightpen_update();
 }
 
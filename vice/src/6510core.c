@@ -2240,6 +2240,16 @@ static const uint8_t rewind_fetch_tab[] = {
 #endif
 #endif
 
+#ifdef __LIBRETRO__
+#ifdef DRIVE_CPU
+        RETRO_TRACE_INSN(TRACE_CPU_DRIVE8 + drv->mynumber, 0, CLK, reg_pc, p0, p1, p2 >> 8,
+                         reg_a_read, reg_x_read, reg_y_read, reg_sp, LOCAL_STATUS());
+#else
+        RETRO_TRACE_INSN(TRACE_CPU_MAIN, 0, maincpu_clk, reg_pc, p0, p1, p2 >> 8,
+                         reg_a_read, reg_x_read, reg_y_read, reg_sp, LOCAL_STATUS());
+#endif
+#endif
+
 #ifdef DEBUG
 #ifdef DRIVE_CPU
         if (TRACEFLG) {
@@ -1717,6 +1717,11 @@ static const uint8_t fetch_tab[] = {
         memmap_state &= ~(MEMMAP_STATE_INSTR | MEMMAP_STATE_OPCODE);
 #endif
 
+#ifdef __LIBRETRO__
+        RETRO_TRACE_INSN(TRACE_CPU_MAIN, 0, maincpu_clk, reg_pc, p0, p1, p2 >> 8,
+                         reg_a_read, reg_x, reg_y, reg_sp, LOCAL_STATUS());
+#endif
+
 #ifdef DEBUG
         if (TRACEFLG) {
             uint8_t op = (uint8_t)(p0);
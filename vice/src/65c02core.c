@@ -1663,6 +1663,11 @@
 #endif
 #endif
 
+#if defined(__LIBRETRO__) && defined(DRIVE_CPU)
+        RETRO_TRACE_INSN(TRACE_CPU_DRIVE8 + drv->mynumber, TRACE_FLAG_65C02, CLK, reg_pc, p0, p1, p2 >> 8,
+                         reg_a, reg_x, reg_y, reg_sp, LOCAL_STATUS());
+#endif
+
 #ifdef DEBUG
 #ifdef DRIVE_CPU
         if (TRACEFLG) {
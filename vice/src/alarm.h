@@ -30,6 +30,10 @@
 
 #include "types.h"
 
+#ifdef __LIBRETRO__
+#include "libretro-perf.h"
+#endif
+
 #define ALARM_CONTEXT_MAX_PENDING_ALARMS 0x100
 
 typedef void (*alarm_callback_t)(CLOCK offset, void *data);
@@ -142,7 +146,13 @@ inline static void alarm_context_dispatch(alarm_context_t *context,
     idx = context->next_pending_alarm_idx;
     alarm = context->pending_alarms[idx].alarm;
 
+#ifdef __LIBRETRO__
+    RETRO_PERF_ENTER(RETRO_PERF_ALARM);
+#endif
     (alarm->callback)(offset, alarm->data);
+#ifdef __LIBRETRO__
+    RETRO_PERF_LEAVE();
+#endif
 }
 
 inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
@@ -76,6 +76,8 @@ int         archdep_stat(const char *file_name,
                          size_t *len,
                          unsigned int *isdir);
 int         archdep_rename(const char *oldpath, const char *newpath);
+int         archdep_file_mtime(const char *path, int64_t *mtime);
+int         archdep_access(const char *pathname, int mode);
 
 char *      archdep_default_sysfile_pathlist(const char *emu_id);
 void        archdep_default_sysfile_pathlist_free(void);
@@ -1412,17 +1412,41 @@ void autostart_advance(void)
     }
 }
 
+#ifdef __LIBRETRO__
+/* Flag: the machine has already been booted for autostart (such as from a
+   cached boot image), so the next autostart does not reset it */
+static int autostart_booted = 0;
+
+void autostart_set_booted(int booted)
+{
+    autostart_booted = booted;
+}
+#endif
+
+/* Cycles from reset until the machine is expected to be ready.  */
+CLOCK autostart_get_initial_delay(void)
+{
+    return (CLOCK)(((AutostartDelay == 0) ? AutostartDelayDefaultSeconds : AutostartDelay)
+                   * machine_get_cycles_per_second());
+}
+
 /* Clean memory and reboot for autostart.  */
 static void reboot_for_autostart(const char *program_name, unsigned int mode,
                                  unsigned int runmode)
 {
     int rnd;
+    int reset = 1;
     char *temp_name = NULL, *temp;
 
     if (!autostart_enabled) {
         return;
     }
 
+#ifdef __LIBRETRO__
+    reset = !autostart_booted;
+    autostart_booted = 0;
+#endif
+
     DBG(("reboot_for_autostart %s mode: %u runmode: %u", program_name, mode, runmode));
 
     /* program_name may be petscii or ascii at this point, ANDing the charcodes
@@ -1434,15 +1458,18 @@ static void reboot_for_autostart(const char *program_name, unsigned int mode,
             *temp++ &= 0x7f;
         }
     }
-    log_message(autostart_log, "Resetting the machine to autostart '%s'",
+    log_message(autostart_log, reset ? "Resetting the machine to autostart '%s'"
+                                     : "Autostarting '%s' on the booted machine",
                 program_name ? temp_name : "*");
     if (program_name) {
         lib_free(temp_name);
     }
 
-    mem_powerup();
+    if (reset) {
+        mem_powerup();
+        autostart_ignore_reset = 1;
+    }
 
-    autostart_ignore_reset = 1;
     deallocate_program_name();
     if (program_name && program_name[0]) {
         autostart_program_name = lib_strdup(program_name);
@@ -1450,11 +1477,9 @@ static void reboot_for_autostart(const char *program_name, unsigned int mode,
 
     autostartmode = mode;
     autostart_run_mode = runmode;
-    autostart_wait_for_reset = 1;
+    autostart_wait_for_reset = reset;
 
-    autostart_initial_delay_cycles =
-        (CLOCK)(((AutostartDelay == 0) ? AutostartDelayDefaultSeconds : AutostartDelay)
-                        * machine_get_cycles_per_second());
+    autostart_initial_delay_cycles = reset ? autostart_get_initial_delay() : maincpu_clk;
     DBG(("reboot_for_autostart AutostartDelay: %d AutostartDelayDefaultSeconds: %d autostart_initial_delay_cycles: %"PRIu64"",
            AutostartDelay, AutostartDelayDefaultSeconds, autostart_initial_delay_cycles));
 
@@ -1465,7 +1490,9 @@ static void reboot_for_autostart(const char *program_name, unsigned int mode,
     }
     DBG(("reboot_for_autostart - autostart_initial_delay_cycles: %"PRIu64, autostart_initial_delay_cycles));
 
-    machine_trigger_reset(MACHINE_RESET_MODE_HARD);
+    if (reset) {
+        machine_trigger_reset(MACHINE_RESET_MODE_HARD);
+    }
 
     /* enable warp before reset */
     if (mode != AUTOSTART_HASSNAPSHOT) {
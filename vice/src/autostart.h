@@ -62,6 +62,10 @@ extern int autostart_tapecart(const char *file_name, void *unused);
 
 extern void autostart_disable(void);
 extern void autostart_advance(void);
+extern CLOCK autostart_get_initial_delay(void);
+#ifdef __LIBRETRO__
+extern void autostart_set_booted(int booted);
+#endif
 
 /* extern int autostart_device(int unit); */
 extern void autostart_reset(void);
@@ -133,6 +133,10 @@ static int tape_motor_in = 0;
 */
 static int watchpoints_active = 0;
 
+/* Pages with watchpoints, only these go through the watch handlers */
+static bool watch_page_load[0x100];
+static bool watch_page_store[0x100];
+
 /* ------------------------------------------------------------------------- */
 
 static uint8_t zero_read_watch(uint16_t addr)
@@ -161,10 +165,30 @@ static void store_watch(uint16_t addr, uint8_t value)
     mem_write_tab[mem_config][addr >> 8](addr, value);
 }
 
+/* called by mem_update_tab_ptrs() */
+static void mem_update_watch_tabs(void)
+{
+    int i;
+
+    for (i = 0; i <= 0x100; i++) {
+        if (watch_page_load[i & 0xff]) {
+            mem_read_tab_watch[i] = i ? read_watch : zero_read_watch;
+        } else {
+            mem_read_tab_watch[i] = mem_read_tab[mem_config][i];
+        }
+        if (watch_page_store[i & 0xff]) {
+            mem_write_tab_watch[i] = i ? store_watch : zero_store_watch;
+        } else {
+            mem_write_tab_watch[i] = mem_write_tab[mem_config][i];
+        }
+    }
+}
+
 /* called by mem_pla_config_changed(), mem_toggle_watchpoints() */
 static void mem_update_tab_ptrs(int flag)
 {
     if (flag) {
+        mem_update_watch_tabs();
         _mem_read_tab_ptr = mem_read_tab_watch;
         _mem_write_tab_ptr = mem_write_tab_watch;
         if (flag > 1) {
@@ -186,6 +210,12 @@ static void mem_update_tab_ptrs(int flag)
 
 void mem_toggle_watchpoints(int flag, void *context)
 {
+    unsigned int i;
+
+    for (i = 0; i < 0x100; i++) {
+        watch_page_load[i] = flag && monitor_watched_page(e_comp_space, i, false);
+        watch_page_store[i] = flag && monitor_watched_page(e_comp_space, i, true);
+    }
     mem_update_tab_ptrs(flag);
     watchpoints_active = flag;
 }
@@ -680,6 +680,23 @@ void *disk_image_fsimage_fd_get(const disk_image_t *image)
     return NULL;
 }
 
+int disk_image_fsimage_read(const disk_image_t *image, void *buf, size_t num, long offset)
+{
+    return -1;
+}
+
+void disk_image_flush_all(void)
+{
+}
+
+void disk_image_flush_barrier(void)
+{
+}
+
+void disk_image_shutdown(void)
+{
+}
+
 void P64ImageDestroy(PP64Image Instance)
 {
 }
@@ -31,6 +31,7 @@
 #include "vice.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "alarm.h"
@@ -61,21 +62,47 @@
 #endif
 
 #define MOTOR_DELAY         32000
-#define TAP_BUFFER_LENGTH   100000
+
+/* number of pulses between two entries of the tape index */
+#define TAP_INDEX_STEP      256
 
 /* at least every DATASETTE_MAX_GAP cycle there should be an alarm */
 #define DATASETTE_MAX_GAP   100000
 
+/* When accelerating, pilots of the known formats with at least
+   DATASETTE_PILOT_MIN pulses are cut down to their last second, which leaves
+   loaders the time they wait after starting the motor.  */
+#define DATASETTE_PILOT_PERIOD  8
+#define DATASETTE_PILOT_MIN     1024
+
 
 /* Attached TAP tape image.  */
 static tap_t *current_image = NULL;
 
-/* Buffer for the TAP */
-static uint8_t tap_buffer[TAP_BUFFER_LENGTH];
+/* Contents of the TAP after the header, kept in memory by tap_open() */
+static const uint8_t *tap_buffer = NULL;
 
 /* Pointer and length of the tap-buffer */
 static long next_tap, last_tap;
 
+/* Tape counter (machine-cycles/8) at every TAP_INDEX_STEP pulses */
+typedef struct tap_index_entry_s {
+    long position;
+    int cycle_counter;
+} tap_index_entry_t;
+
+static struct {
+    tap_index_entry_t *entries;
+    int len;
+    int allocated;
+    int total;
+    /* image and settings the index was built for */
+    const tap_t *image;
+    int data_len;
+    int zero_gap_delay;
+    int speed_tuning;
+} tap_index;
+
 /* State of the datasette motor.  */
 static int datasette_motor = 0;
 
@@ -120,6 +147,12 @@ static CLOCK fullwave_gap;
 /* random wobble to be added to tape pulses */
 static int datasette_tape_wobble = 0;
 
+/* decode Kernal blocks straight from the image, and shorten pilots? */
+static int datasette_accelerate = 0;
+
+/* Range of the image known not to start a pilot */
+static long datasette_pilot_from = 0, datasette_pilot_to = 0;
+
 /* datasette device enable */
 static int datasette_enable = 0;
 
@@ -216,6 +249,15 @@ static int set_datasette_tape_wobble(int val, void *param)
     return 0;
 }
 
+static int set_datasette_accelerate(int val, void *param)
+{
+    datasette_accelerate = val ? 1 : 0;
+
+    tape_traps_update_tap();
+
+    return 0;
+}
+
 static int set_datasette_enable(int value, void *param)
 {
     int val = value ? 1 : 0;
@@ -275,6 +317,9 @@ static const resource_int_t resources_int[] = {
     { "DatasetteTapeWobble", 10, RES_EVENT_SAME, NULL,
       &datasette_tape_wobble,
       set_datasette_tape_wobble, NULL },
+    { "DatasetteAccelerate", 0, RES_EVENT_SAME, NULL,
+      &datasette_accelerate,
+      set_datasette_accelerate, NULL },
     { "DatasetteSound", 0, RES_EVENT_SAME, NULL,
       &datasette_sound_emulation,
       set_datasette_sound_emulation, NULL },
@@ -318,6 +363,12 @@ static const cmdline_option_t cmdline_options[] =
     { "-dstapewobble", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "DatasetteTapeWobble", NULL,
       "<value>", "Set maximum random number of cycles added to each gap in the tap" },
+    { "-dsaccelerate", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DatasetteAccelerate", (resource_value_t)1,
+      NULL, "Decode TAP blocks loaded by the Kernal straight from the image (needs virtual devices), and shorten CBM and Turbo Tape pilots" },
+    { "+dsaccelerate", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DatasetteAccelerate", (resource_value_t)0,
+      NULL, "Always play TAP images pulse by pulse" },
     { "-datasettesound", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
       NULL, NULL, "DatasetteSound", (resource_value_t)1,
       NULL, "Enable Datasette sound" },
@@ -374,19 +425,20 @@ void datasette_reset_counter(void)
 }
 
 
+/* The whole image is in memory, only the position in the buffer needs to
+   follow current_file_seek_position when it was reset.  */
+static void datasette_sync_buffer(void)
+{
+    tap_buffer = current_image->data + current_image->offset;
+    last_tap = current_image->data_len - current_image->offset;
+    next_tap = current_image->current_file_seek_position;
+}
+
 inline static int datasette_move_buffer_forward(int offset)
 {
-    /* reads buffer to fit the next gap-read
-       tap_buffer[next_tap] ~ current_file_seek_position
-    */
+    /* tap_buffer[next_tap] ~ current_file_seek_position */
     if (next_tap + offset >= last_tap) {
-        if (fseek(current_image->fd, current_image->current_file_seek_position
-                  + current_image->offset, SEEK_SET)) {
-            log_error(datasette_log, "Cannot read in tap-file.");
-            return 0;
-        }
-        last_tap = (long)fread(tap_buffer, 1, TAP_BUFFER_LENGTH, current_image->fd);
-        next_tap = 0;
+        datasette_sync_buffer();
         if (next_tap >= last_tap) {
             return 0;
         }
@@ -396,21 +448,9 @@ inline static int datasette_move_buffer_forward(int offset)
 
 inline static int datasette_move_buffer_back(int offset)
 {
-    /* reads buffer to fit the next gap-read at current_file_seek_position-1
-       tap_buffer[next_tap] ~ current_file_seek_position
-    */
+    /* tap_buffer[next_tap] ~ current_file_seek_position */
     if (next_tap + offset < 0) {
-        if (current_image->current_file_seek_position >= TAP_BUFFER_LENGTH) {
-            next_tap = TAP_BUFFER_LENGTH;
-        } else {
-            next_tap = current_image->current_file_seek_position;
-        }
-        if (fseek(current_image->fd, current_image->current_file_seek_position
-                  - next_tap + current_image->offset, SEEK_SET)) {
-            log_error(datasette_log, "Cannot read in tap-file.");
-            return 0;
-        }
-        last_tap = (long)fread(tap_buffer, 1, TAP_BUFFER_LENGTH, current_image->fd);
+        datasette_sync_buffer();
         if (next_tap > last_tap) {
             return 0;
         }
@@ -418,15 +458,16 @@ inline static int datasette_move_buffer_back(int offset)
     return 1;
 }
 
-inline static int fetch_gap(CLOCK *gap, int *direction, long read_tap)
+/* Get the length of the pulse at read_tap without wobble, and the number of
+   bytes it takes in the image.  */
+inline static int datasette_pulse_at(long read_tap, CLOCK *gap, int *length)
 {
-    int wobble;
-
     if ((read_tap >= last_tap) || (read_tap < 0)) {
         return -1;
     }
 
     *gap = tap_buffer[read_tap];
+    *length = 1;
 
     if ((current_image->version == 0) || *gap) {
         *gap = (*gap ? (CLOCK)(*gap * 8) : (CLOCK)datasette_zero_gap_delay)
@@ -435,7 +476,7 @@ inline static int fetch_gap(CLOCK *gap, int *direction, long read_tap)
         if (read_tap >= last_tap - 3) {
             return -1;
         }
-        *direction *= 4;
+        *length = 4;
         *gap = tap_buffer[read_tap + 1]
                + (tap_buffer[read_tap + 2] << 8)
                + (tap_buffer[read_tap + 3] << 16);
@@ -443,6 +484,18 @@ inline static int fetch_gap(CLOCK *gap, int *direction, long read_tap)
             *gap = (CLOCK)datasette_zero_gap_delay;
         }
     }
+    return 0;
+}
+
+inline static int fetch_gap(CLOCK *gap, int *direction, long read_tap)
+{
+    int wobble, length;
+
+    if (datasette_pulse_at(read_tap, gap, &length) < 0) {
+        return -1;
+    }
+    *direction *= length;
+
     /* add some random wobble */
     if (datasette_tape_wobble) {
         wobble = lib_unsigned_rand(-datasette_tape_wobble, datasette_tape_wobble);
@@ -455,63 +508,337 @@ inline static int fetch_gap(CLOCK *gap, int *direction, long read_tap)
     return 0;
 }
 
-inline static void read_gap_forward(long *read_tap)
-{
-    *read_tap = next_tap;
-}
+/*---------------------------------------------------------------------*/
 
-inline static void read_gap_backward_v0(long *read_tap)
+/* Tape counter advance of a pulse as played by datasette_read_gap() */
+static int datasette_pulse_counter(CLOCK gap)
 {
-    *read_tap = next_tap - 1;
+    if (machine_tape_behaviour() == TAPE_BEHAVIOUR_C16) {
+        /* two half waves, or a doubled full wave; version 0 images are
+           taken as half waves as well */
+        return (int)((gap * 2) / 8);
+    }
+    return (int)(gap / 8);
 }
 
-inline static int read_gap_backward_v1(long *read_tap)
+static void datasette_index_update(void)
 {
-    /* examine, if previous gap was long
-       by rewinding until 3 non-zero-values
-       in a row found, then reading forward (FIXME???)
-    */
-    int non_zeros_in_a_row = 0;
-    long remember_file_seek_position;
+    long pos = 0;
+    int count = 0, counter = 0, length;
+    CLOCK gap;
 
-    remember_file_seek_position = current_image->current_file_seek_position;
+    if (tap_index.image == current_image
+        && tap_index.data_len == current_image->data_len
+        && tap_index.zero_gap_delay == datasette_zero_gap_delay
+        && tap_index.speed_tuning == datasette_speed_tuning) {
+        return;
+    }
 
-    current_image->current_file_seek_position -= 4;
-    next_tap -= 4;
+    datasette_sync_buffer();
+    tap_index.len = 0;
 
-    while ((non_zeros_in_a_row < 3) && current_image->current_file_seek_position) {
-        if (!datasette_move_buffer_back(-1)) {
-            return 1;
+    while (datasette_pulse_at(pos, &gap, &length) == 0 && gap) {
+        if ((count % TAP_INDEX_STEP) == 0) {
+            if (tap_index.len == tap_index.allocated) {
+                tap_index.allocated = tap_index.allocated ? tap_index.allocated * 2 : 256;
+                tap_index.entries = lib_realloc(tap_index.entries,
+                                                tap_index.allocated * sizeof(tap_index_entry_t));
+            }
+            tap_index.entries[tap_index.len].position = pos;
+            tap_index.entries[tap_index.len].cycle_counter = counter;
+            tap_index.len++;
         }
-        current_image->current_file_seek_position--;
-        next_tap--;
-        if (tap_buffer[next_tap]) {
-            non_zeros_in_a_row++;
+        counter += datasette_pulse_counter(gap);
+        pos += length;
+        count++;
+    }
+
+    tap_index.total = counter;
+    tap_index.image = current_image;
+    tap_index.data_len = current_image->data_len;
+    tap_index.zero_gap_delay = datasette_zero_gap_delay;
+    tap_index.speed_tuning = datasette_speed_tuning;
+}
+
+/* Index of the last entry before position, or -1 */
+static int datasette_index_find(long position)
+{
+    int lo = 0, hi = tap_index.len - 1, mid, found = -1;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (tap_index.entries[mid].position < position) {
+            found = mid;
+            lo = mid + 1;
         } else {
-            non_zeros_in_a_row = 0;
+            hi = mid - 1;
         }
     }
+    return found;
+}
+
+/* Start of the pulse ending at position, which may be a long one */
+static long datasette_previous_pulse(long position)
+{
+    long pos;
+    int i, length;
+    CLOCK gap;
+
+    datasette_index_update();
+    i = datasette_index_find(position);
+    if (i < 0) {
+        return -1;
+    }
+
+    pos = tap_index.entries[i].position;
+    while (datasette_pulse_at(pos, &gap, &length) == 0 && pos + length < position) {
+        pos += length;
+    }
+    return pos;
+}
+
+/** \brief  Get the tape time at a position of the attached tape
+ *
+ * \param[in]   position    offset in the TAP data, after the header
+ *
+ * \return  machine cycles the tape needs to play up to \a position
+ */
+CLOCK datasette_position_to_cycles(long position)
+{
+    long pos;
+    int i, length, counter;
+    CLOCK gap;
+
+    if (current_image == NULL) {
+        return 0;
+    }
+
+    datasette_index_update();
+    i = datasette_index_find(position + 1);
+    if (i < 0) {
+        return 0;
+    }
+
+    pos = tap_index.entries[i].position;
+    counter = tap_index.entries[i].cycle_counter;
+    while (pos < position && datasette_pulse_at(pos, &gap, &length) == 0 && gap) {
+        counter += datasette_pulse_counter(gap);
+        pos += length;
+    }
+    return (CLOCK)counter * 8;
+}
+
+/* Move the tape to position as if it had been played up to there.  */
+static void datasette_skip_to(long position)
+{
+    CLOCK from, to;
+
+    from = datasette_position_to_cycles(current_image->current_file_seek_position);
+    to = datasette_position_to_cycles(position);
+
+    current_image->cycle_counter += (int)((to - from) / 8);
+    if (current_image->cycle_counter_total < current_image->cycle_counter) {
+        current_image->cycle_counter_total = current_image->cycle_counter;
+    }
+    current_image->current_file_seek_position = (int)position;
+    fseek(current_image->fd, position + current_image->offset, SEEK_SET);
+
+    datasette_sync_buffer();
+    datasette_long_gap_pending = 0;
+    datasette_long_gap_elapsed = 0;
+    fullwave = 0;
+    datasette_update_ui_counter();
+}
+
+int datasette_accelerate_enabled(void)
+{
+    return datasette_accelerate
+           && machine_tape_behaviour() == TAPE_BEHAVIOUR_NORMAL;
+}
+
+/* Decode the next CBM block of size bytes (without the checksum) from the
+   image for the tape traps, and move the tape behind it.  With header set,
+   blocks which are not a file header are passed over like the Kernal does.
+   Returns the number of bytes read, or -1 if the block has to be read by
+   playing the tape instead: the tape is not moved in that case.  */
+int datasette_accelerate_block(uint8_t *buffer, int size, int header)
+{
+    uint8_t *block;
+    long position, start;
+    int len;
+
+    if (!datasette_accelerate_enabled() || current_image == NULL
+        || current_image->mode != DATASETTE_CONTROL_START
+        || current_image->version == 2) {
+        return -1;
+    }
 
-    /* now forward */
-    while (current_image->current_file_seek_position < remember_file_seek_position - 4) {
-        if (!datasette_move_buffer_forward(1)) {
+    block = lib_malloc(size + 1);
+    position = current_image->current_file_seek_position;
+
+    while (1) {
+        start = position;
+        len = tap_read_cbm_block_at(current_image, &position, block, size);
+        if (len == -1 || (len < 0 && (!header || position <= start))) {
+            /* end of tape or unreadable block: play the tape instead */
+            fseek(current_image->fd, current_image->current_file_seek_position
+                  + current_image->offset, SEEK_SET);
+            lib_free(block);
             return -1;
         }
-        if (tap_buffer[next_tap]) {
-            current_image->current_file_seek_position++;
-            next_tap++;
-        } else {
-            current_image->current_file_seek_position += 4;
-            next_tap += 4;
+        if (!header || (len == size && block[0] != 2 && block[0] >= 1 && block[0] <= 5)) {
+            break;
         }
     }
-    if (!datasette_move_buffer_forward(4)) {
-        return -1;
+
+    DBG(("datasette_accelerate_block: %d bytes, tape %d -> %ld", len,
+         current_image->current_file_seek_position, position));
+
+    memcpy(buffer, block, len);
+    lib_free(block);
+    datasette_skip_to(position);
+
+    return len;
+}
+
+/* Pilot formats, as TAP values: the pulses of one period of the pilot, and
+   the sync pulses that must follow it. A run of the pilot pulses that is not
+   followed by the sync, e.g. repeated bytes of turbo data, is left alone.  */
+typedef struct datasette_pilot_s {
+    int period;
+    uint8_t pilot[DATASETTE_PILOT_PERIOD];
+    int sync_length;
+    uint8_t sync[DATASETTE_PILOT_PERIOD];
+} datasette_pilot_t;
+
+static const datasette_pilot_t datasette_pilots[] = {
+    /* CBM Kernal: short pulses, then the long and medium pulse of a byte */
+    { 1, { 0x30 }, 2, { 0x56, 0x42 } },
+    /* Turbo Tape 64: bytes 0x02, MSB first, then the sync byte 0x09 */
+    { 8, { 0x1a, 0x1a, 0x1a, 0x1a, 0x1a, 0x1a, 0x28, 0x1a },
+      8, { 0x1a, 0x1a, 0x1a, 0x1a, 0x28, 0x1a, 0x1a, 0x28 } },
+};
+
+/* Pulse of the TAP value, give or take the jitter of the recording */
+static int datasette_pulse_is(CLOCK gap, uint8_t value)
+{
+    CLOCK ref = (CLOCK)value * 8 + (CLOCK)datasette_speed_tuning;
+    CLOCK diff = (gap > ref) ? gap - ref : ref - gap;
+
+    return diff <= ref / 8;
+}
+
+/* Count the pulses of the pilot from `pos', in whole periods, and check
+   the sync after them. Returns the count, or the negated count if the sync
+   is missing.  */
+static long datasette_pilot_match(const datasette_pilot_t *pilot, long pos, CLOCK *total)
+{
+    CLOCK gap;
+    long count = 0;
+    int i, length;
+
+    *total = 0;
+    while (datasette_pulse_at(pos, &gap, &length) == 0
+           && datasette_pulse_is(gap, pilot->pilot[count % pilot->period])) {
+        *total += gap;
+        pos += length;
+        count++;
+    }
+    pos -= count % pilot->period;
+    count -= count % pilot->period;
+
+    for (i = 0; i < pilot->sync_length; i++) {
+        if (datasette_pulse_at(pos, &gap, &length) < 0
+            || !datasette_pulse_is(gap, pilot->sync[i])) {
+            return -count;
+        }
+        pos += length;
+    }
+    return count;
+}
+
+/* Cut down a pilot ahead of the tape, whatever loader is reading it, if it
+   is one of the known formats. Pulses are only passed over in whole periods
+   of the pilot, so the loader sees the same pulses, just fewer of them; the
+   data after the pilot is still played pulse by pulse.  */
+static void datasette_accelerate_pilot(void)
+{
+    const datasette_pilot_t *pilot = NULL;
+    CLOCK gap, total = 0, skipped = 0;
+    long pos, start, count = 0, longest = 1;
+    int i, skip, length;
+
+    start = current_image->current_file_seek_position;
+    if (start >= datasette_pilot_from && start < datasette_pilot_to) {
+        return;
+    }
+
+    datasette_sync_buffer();
+    for (i = 0; i < (int)(sizeof(datasette_pilots) / sizeof(datasette_pilots[0])); i++) {
+        count = datasette_pilot_match(&datasette_pilots[i], start, &total);
+        /* the run ends the same way from any later pulse of it, and pilot
+           pulses take one byte each */
+        if (((count < 0) ? -count : count) > longest) {
+            longest = (count < 0) ? -count : count;
+        }
+        if (count >= DATASETTE_PILOT_MIN) {
+            pilot = &datasette_pilots[i];
+            break;
+        }
+    }
+
+    datasette_pilot_from = start;
+    datasette_pilot_to = start + longest;
+    if (pilot == NULL) {
+        return;
     }
 
+    /* whole periods, up to the last second of the pilot */
+    pos = start;
+    while (1) {
+        CLOCK span = 0;
+        long end = pos;
+
+        for (skip = 0; skip < pilot->period
+             && datasette_pulse_at(end, &gap, &length) == 0; skip++) {
+            span += gap;
+            end += length;
+        }
+        if (total - skipped - span < (CLOCK)datasette_cycles_per_second) {
+            break;
+        }
+        skipped += span;
+        pos = end;
+    }
+
+    DBG(("datasette_accelerate_pilot: %ld pulses, tape %ld -> %ld", count, start, pos));
+
+    if (pos != start) {
+        datasette_skip_to(pos);
+    }
+}
+
+inline static void read_gap_forward(long *read_tap)
+{
     *read_tap = next_tap;
-    next_tap += (remember_file_seek_position - current_image->current_file_seek_position);
-    current_image->current_file_seek_position = (int)remember_file_seek_position;
+}
+
+inline static void read_gap_backward_v0(long *read_tap)
+{
+    *read_tap = next_tap - 1;
+}
+
+inline static int read_gap_backward_v1(long *read_tap)
+{
+    /* the previous gap may be a long one, find where it starts */
+    long start;
+
+    start = datasette_previous_pulse(current_image->current_file_seek_position);
+    if (start < 0) {
+        return -1;
+    }
+
+    *read_tap = next_tap - (current_image->current_file_seek_position - start);
 
     return 0;
 }
@@ -693,6 +1020,11 @@ static void datasette_read_bit(CLOCK offset, void *data)
         datasette_long_gap_pending = datasette_long_gap_elapsed;
         datasette_long_gap_elapsed = (CLOCK)(gap - datasette_long_gap_elapsed);
     }
+    if (direction > 0 && current_image->mode == DATASETTE_CONTROL_START
+        && !datasette_long_gap_pending && datasette_accelerate_enabled()
+        && current_image->version != 2) {
+        datasette_accelerate_pilot();
+    }
     if (datasette_long_gap_pending) {
         gap = datasette_long_gap_pending;
         datasette_long_gap_pending = 0;
@@ -771,8 +1103,6 @@ void datasette_init(void)
 
 void datasette_set_tape_image(tap_t *image)
 {
-    CLOCK gap;
-
     DBG(("datasette_set_tape_image (image present:%s)", image ? "yes" : "no"));
 
     current_image = image;
@@ -781,11 +1111,8 @@ void datasette_set_tape_image(tap_t *image)
 
     if (image != NULL) {
         /* We need the length of tape for realistic counter. */
-        current_image->cycle_counter_total = 0;
-        do {
-            gap = datasette_read_gap(1);
-            current_image->cycle_counter_total += gap / 8;
-        } while (gap);
+        datasette_index_update();
+        current_image->cycle_counter_total = tap_index.total;
         current_image->current_file_seek_position = 0;
         datasette_sound_set_halfwaves(current_image->version == 2);
     }
@@ -795,6 +1122,8 @@ void datasette_set_tape_image(tap_t *image)
 
     last_tap = next_tap = 0;
     fullwave = 0;
+    tap_index.image = NULL;
+    datasette_pilot_from = datasette_pilot_to = 0;
 
     ui_set_tape_status(current_image ? 1 : 0);
 }
@@ -1073,14 +1402,14 @@ inline static void bit_write(void)
 
     if (write_time < (CLOCK)(255 * 8 + 7)) {
         write_gap = (uint8_t)(write_time / (CLOCK)8);
-        if (fwrite(&write_gap, 1, 1, current_image->fd) < 1) {
+        if (tap_write_data(current_image, &write_gap, 1) < 1) {
             datasette_control(DATASETTE_CONTROL_STOP);
             return;
         }
         current_image->current_file_seek_position++;
     } else {
         write_gap = 0;
-        if (fwrite(&write_gap, 1, 1, current_image->fd) != 1) {
+        if (tap_write_data(current_image, &write_gap, 1) != 1) {
             log_debug("datasette bit_write failed.");
         }
         current_image->current_file_seek_position++;
@@ -1091,7 +1420,10 @@ inline static void bit_write(void)
             long_gap[1] = (uint8_t)((write_time >> 8) & 0xff);
             long_gap[2] = (uint8_t)((write_time >> 16) & 0xff);
             write_time &= 0xffffff;
-            bytes_written = (int)fwrite(long_gap, 1, 3, current_image->fd);
+            bytes_written = tap_write_data(current_image, long_gap, 3);
+            if (bytes_written < 0) {
+                bytes_written = 0;
+            }
             current_image->current_file_seek_position += bytes_written;
             if (bytes_written < 3) {
                 datasette_control(DATASETTE_CONTROL_STOP);
@@ -1114,6 +1446,9 @@ inline static void bit_write(void)
         current_image->cycle_counter_total = current_image->cycle_counter;
     }
     current_image->has_changed = 1;
+    /* the contents may have moved, and the index is no longer valid */
+    last_tap = next_tap = 0;
+    tap_index.image = NULL;
     datasette_update_ui_counter();
 }
 
@@ -57,6 +57,9 @@ extern void datasette_set_tape_image(struct tap_s *image);
 extern void datasette_control(int command);
 extern void datasette_reset(void);
 extern void datasette_reset_counter(void);
+extern CLOCK datasette_position_to_cycles(long position);
+extern int datasette_accelerate_enabled(void);
+extern int datasette_accelerate_block(uint8_t *buffer, int size, int header);
 extern void datasette_event_playback(CLOCK offset, void *data);
 
 /* Emulator specific functions.  */
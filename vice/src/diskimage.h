@@ -108,6 +108,7 @@ struct disk_addr_s {
 typedef struct disk_addr_s disk_addr_t;
 
 extern void disk_image_init(void);
+extern void disk_image_shutdown(void);
 extern int disk_image_resources_init(void);
 extern int disk_image_cmdline_options_init(void);
 extern void disk_image_resources_shutdown(void);
@@ -115,6 +116,9 @@ extern void disk_image_resources_shutdown(void);
 extern void disk_image_fsimage_name_set(disk_image_t *image, const char *name);
 extern const char *disk_image_fsimage_name_get(const disk_image_t *image);
 extern void *disk_image_fsimage_fd_get(const disk_image_t *image);
+extern int disk_image_fsimage_read(const disk_image_t *image, void *buf, size_t num, long offset);
+extern void disk_image_flush_all(void);
+extern void disk_image_flush_barrier(void);
 extern int disk_image_fsimage_create(const char *name, unsigned int type);
 extern int disk_image_fsimage_create_dxm(const char *name, const char *diskname, unsigned int type);
 
@@ -149,6 +153,8 @@ extern unsigned int disk_image_sync_size(unsigned int format, unsigned int track
 
 extern int disk_image_read_image(const disk_image_t *image);
 extern int disk_image_write_p64_image(const disk_image_t *image);
+extern int disk_image_read_half_track(const disk_image_t *image, unsigned int half_track,
+                                      struct disk_track_s *raw);
 extern int disk_image_write_half_track(disk_image_t *image, unsigned int half_track,
                                        const struct disk_track_s *raw);
 
@@ -507,6 +507,41 @@ void *disk_image_fsimage_fd_get(const disk_image_t *image)
 }
 
 
+/** \brief  Read raw contents of \a image
+ *
+ * \param[in]   image   disk image
+ * \param[out]  buf     data read
+ * \param[in]   num     number of bytes
+ * \param[in]   offset  offset from start of image
+ *
+ * \return  0 on success, -1 on error
+ */
+int disk_image_fsimage_read(const disk_image_t *image, void *buf, size_t num, long offset)
+{
+    if (image->device != DISK_IMAGE_DEVICE_FS || image->media.fsimage->fd == NULL) {
+        return -1;
+    }
+    return fsimage_read(image->media.fsimage, buf, num, offset);
+}
+
+
+/** \brief  Start writing pending changes of all attached images back to
+ *          their files
+ */
+void disk_image_flush_all(void)
+{
+    fsimage_flush_all();
+}
+
+
+/** \brief  Wait until all pending changes have been written to the files
+ */
+void disk_image_flush_barrier(void)
+{
+    fsimage_flush_barrier();
+}
+
+
 int disk_image_fsimage_create(const char *name, unsigned int type)
 {
     return fsimage_create(name, type);
@@ -716,6 +751,20 @@ int disk_image_write_half_track(disk_image_t *image, unsigned int half_track,
     }
 }
 
+int disk_image_read_half_track(const disk_image_t *image, unsigned int half_track,
+                               struct disk_track_s *raw)
+{
+    switch (image->type) {
+        case DISK_IMAGE_TYPE_P64:
+            return -1;
+        case DISK_IMAGE_TYPE_G64:
+        case DISK_IMAGE_TYPE_G71:
+            return fsimage_gcr_read_half_track(image, half_track, raw);
+        default:
+            return fsimage_dxx_read_half_track(image, half_track, raw);
+    }
+}
+
 int disk_image_read_image(const disk_image_t *image)
 {
     switch (image->type) {
@@ -752,6 +801,11 @@ int disk_image_resources_init(void)
     return 0;
 }
 
+void disk_image_shutdown(void)
+{
+    fsimage_shutdown();
+}
+
 void disk_image_resources_shutdown(void)
 {
 }
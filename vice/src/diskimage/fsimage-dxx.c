@@ -107,7 +107,7 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
         offset += X64_HEADER_LENGTH;
     }
 #endif
-    if (util_fpwrite(fsimage->fd, buffer, max_sector * 256, offset) < 0) {
+    if (fsimage_write(fsimage, buffer, max_sector * 256, offset) < 0) {
         log_error(fsimage_dxx_log, "Error writing T:%u to disk image.",
                   track);
         lib_free(buffer);
@@ -125,10 +125,10 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
 #endif
             fsimage->error_info.dirty = 0;
             if (error_info_created) {
-                res = util_fpwrite(fsimage->fd, fsimage->error_info.map,
+                res = fsimage_write(fsimage, fsimage->error_info.map,
                                    fsimage->error_info.len, fsimage->error_info.len * 256);
             } else {
-                res = util_fpwrite(fsimage->fd, fsimage->error_info.map + sectors,
+                res = fsimage_write(fsimage, fsimage->error_info.map + sectors,
                                    max_sector, offset);
             }
             if (res < 0) {
@@ -140,146 +140,135 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
         }
     }
 
-    /* Make sure the stream is visible to other readers.  */
-    fflush(fsimage->fd);
     return 0;
 }
 
-int fsimage_read_dxx_image(const disk_image_t *image)
+/* Encode a half track of the image into raw GCR.  Odd half tracks stay empty,
+   tracks beyond the image are left unformatted.  */
+int fsimage_dxx_read_half_track(const disk_image_t *image, unsigned int half_track,
+                                disk_track_t *raw)
 {
-    uint8_t buffer[256], *bam_id;
+    uint8_t buffer[256];
     int gap, headergap, synclen;
     unsigned int track, sector, track_size;
     gcr_header_t header;
     fdc_err_t rf;
-    int double_sided = 0;
     fsimage_t *fsimage = image->media.fsimage;
     unsigned int max_sector;
     uint8_t *ptr;
-    int half_track;
     int sectors;
     long offset;
-    /* unsigned long trackoffset = 0; */
-    uint8_t *tempgcr;
 
-    if (image->type == DISK_IMAGE_TYPE_D80
-        || image->type == DISK_IMAGE_TYPE_D82) {
-        sectors = disk_image_check_sector(image, BAM_TRACK_8050, BAM_SECTOR_8050);
-        bam_id = &buffer[BAM_ID_8050];
-    } else {
-        sectors = disk_image_check_sector(image, BAM_TRACK_1541, BAM_SECTOR_1541);
-        bam_id = &buffer[BAM_ID_1541];
+    track = half_track / 2;
+
+    track_size = disk_image_raw_track_size(image->type, track);
+    if (raw->data == NULL) {
+        raw->data = lib_malloc(track_size);
+    } else if (raw->size != (int)track_size) {
+        raw->data = lib_realloc(raw->data, track_size);
     }
+    raw->size = track_size;
+    ptr = raw->data;
 
-    bam_id[0] = bam_id[1] = 0xa0;
-    if (sectors >= 0) {
-        util_fpread(fsimage->fd, buffer, 256, sectors << 8);
-    } else {
-        return -1;
+    if (half_track & 1) {
+        /* create an (empty) half track */
+        memset(ptr, 0, track_size);
+        return 0;
     }
-    header.id1 = bam_id[0];
-    header.id2 = bam_id[1];
 
-    /* check double sided images */
-    double_sided = (image->type == DISK_IMAGE_TYPE_D71) && !(buffer[0x03] & 0x80);
+    /* Clear track to avoid read errors.  */
+    memset(ptr, 0x55, track_size);
 
-    for (header.track = track = 1; track <= image->max_half_tracks / 2; track++, header.track++) {
-        half_track = track * 2 - 2;
+    if (track > image->gcr->pending.tracks) {
+        return 0;
+    }
 
-        track_size = disk_image_raw_track_size(image->type, track);
-        if (image->gcr->tracks[half_track].data == NULL) {
-            image->gcr->tracks[half_track].data = lib_malloc(track_size);
-        } else if (image->gcr->tracks[half_track].size != (int)track_size) {
-            image->gcr->tracks[half_track].data = lib_realloc(image->gcr->tracks[half_track].data, track_size);
-        }
-        ptr = image->gcr->tracks[half_track].data;
-        image->gcr->tracks[half_track].size = track_size;
+    header = image->gcr->pending.header[0];
+    header.track = track;
+    if (image->gcr->pending.double_sided && track > 35) {
+        header = image->gcr->pending.header[1]; /* second side, update id and track */
+        header.track = track - 35;
+    }
 
-        if (track <= image->tracks) {
-            /* get temp buffer */
-            ptr = tempgcr = lib_malloc(track_size);
+    gap = disk_image_gap_size(image->type, track);
+    headergap = disk_image_header_gap_size(image->type, track);
+    synclen = disk_image_sync_size(image->type, track);
 
-            if (double_sided && track == 36) {
-                sectors = disk_image_check_sector(image, BAM_TRACK_1571 + 35, BAM_SECTOR_1571);
+    max_sector = disk_image_sector_per_track(image->type, track);
+
+    for (sector = 0; sector < max_sector; sector++) {
+        sectors = disk_image_check_sector(image, track, sector);
+        offset = sectors * 256;
 
-                buffer[BAM_ID_1571] = buffer[BAM_ID_1571 + 1] = 0xa0;
-                if (sectors >= 0) {
-                    util_fpread(fsimage->fd, buffer, 256, sectors << 8);
+#ifdef HAVE_X64_IMAGE
+        if (image->type == DISK_IMAGE_TYPE_X64) {
+            offset += X64_HEADER_LENGTH;
+        }
+#endif
+        if (sectors >= 0) {
+            rf = CBMDOS_FDC_ERR_DRIVE;
+            if (fsimage_read(fsimage, buffer, 256, offset) >= 0) {
+                if (fsimage->error_info.map != NULL) {
+                    rf = fsimage->error_info.map[sectors];
                 }
-                header.id1 = buffer[BAM_ID_1571]; /* second side, update id and track */
-                header.id2 = buffer[BAM_ID_1571 + 1];
-                header.track = 1;
             }
+            header.sector = sector;
+            gcr_convert_sector_to_GCR(buffer, ptr, &header, headergap, synclen, rf);
+        }
+
+        ptr += SECTOR_GCR_SIZE_WITH_HEADER + headergap + gap + (synclen * 2);
+    }
+
+    return 0;
+}
 
-            gap = disk_image_gap_size(image->type, track);
-            headergap = disk_image_header_gap_size(image->type, track);
-            synclen = disk_image_sync_size(image->type, track);
+/* Prepare the GCR image of a D64/D71.  The half tracks are only encoded by
+   gcr_prepare_track() once the drive accesses them.  */
+int fsimage_read_dxx_image(const disk_image_t *image)
+{
+    uint8_t buffer[256], *bam_id;
+    gcr_t *gcr = image->gcr;
+    unsigned int half_track;
+    int sectors;
 
-            max_sector = disk_image_sector_per_track(image->type, track);
+    if (image->type == DISK_IMAGE_TYPE_D80
+        || image->type == DISK_IMAGE_TYPE_D82) {
+        sectors = disk_image_check_sector(image, BAM_TRACK_8050, BAM_SECTOR_8050);
+        bam_id = &buffer[BAM_ID_8050];
+    } else {
+        sectors = disk_image_check_sector(image, BAM_TRACK_1541, BAM_SECTOR_1541);
+        bam_id = &buffer[BAM_ID_1541];
+    }
 
-            /* Clear track to avoid read errors.  */
-            memset(ptr, 0x55, track_size);
+    bam_id[0] = bam_id[1] = 0xa0;
+    if (sectors >= 0) {
+        fsimage_read(image->media.fsimage, buffer, 256, sectors << 8);
+    } else {
+        return -1;
+    }
 
-            for (sector = 0; sector < max_sector; sector++) {
-                sectors = disk_image_check_sector(image, track, sector);
-                offset = sectors * 256;
+    gcr_clear_pending(gcr);
+    gcr->pending.image = image;
+    gcr->pending.tracks = image->tracks;
+    gcr->pending.header[0].id1 = bam_id[0];
+    gcr->pending.header[0].id2 = bam_id[1];
 
-#ifdef HAVE_X64_IMAGE
-                if (image->type == DISK_IMAGE_TYPE_X64) {
-                    offset += X64_HEADER_LENGTH;
-                }
-#endif
-                if (sectors >= 0) {
-                    rf = CBMDOS_FDC_ERR_DRIVE;
-                    if (util_fpread(fsimage->fd, buffer, 256, offset) >= 0) {
-                        if (fsimage->error_info.map != NULL) {
-                            rf = fsimage->error_info.map[sectors];
-                        }
-                    }
-                    header.sector = sector;
-                    gcr_convert_sector_to_GCR(buffer, ptr, &header, headergap, synclen, rf);
-                }
+    /* check double sided images */
+    gcr->pending.double_sided = (image->type == DISK_IMAGE_TYPE_D71) && !(buffer[0x03] & 0x80);
 
-                ptr += SECTOR_GCR_SIZE_WITH_HEADER + headergap + gap + (synclen * 2);
-            }
+    if (gcr->pending.double_sided && image->tracks >= 36) {
+        sectors = disk_image_check_sector(image, BAM_TRACK_1571 + 35, BAM_SECTOR_1571);
 
-            ptr = image->gcr->tracks[half_track].data;
-#if 1
-            memcpy(ptr, tempgcr, track_size);
-#else
-            /* FIXME: copy gcr data to final buffer with offset+wraparound */
-            memset(ptr, 0x55, track_size);
-            trackoffset %= track_size;
-            memcpy(ptr + trackoffset, tempgcr, track_size - trackoffset);
-            memcpy(ptr, tempgcr + (track_size - trackoffset), track_size - (track_size - trackoffset));
-            trackoffset += 200; /* FIXME */
-#endif
-            lib_free(tempgcr);
-        } else {
-            memset(ptr, 0x55, track_size);
+        buffer[BAM_ID_1571] = buffer[BAM_ID_1571 + 1] = 0xa0;
+        if (sectors >= 0) {
+            fsimage_read(image->media.fsimage, buffer, 256, sectors << 8);
         }
+        gcr->pending.header[1].id1 = buffer[BAM_ID_1571];
+        gcr->pending.header[1].id2 = buffer[BAM_ID_1571 + 1];
+    }
 
-        /* Clear odd track */
-        half_track++;
-#if 0
-        /* this does not work for some reason (skew.d64 fails) */
-        if (image->gcr->tracks[half_track].data) {
-            image->gcr->tracks[half_track].size = track_size;
-            ptr = image->gcr->tracks[half_track].data;
-            memset(ptr, 0, track_size);
-        }
-#else
-        /* create an (empty) half track */
-        if (image->gcr->tracks[half_track].data == NULL) {
-            image->gcr->tracks[half_track].data = lib_malloc(track_size);
-        } else if (image->gcr->tracks[half_track].size != (int)track_size) {
-            image->gcr->tracks[half_track].data = lib_realloc(image->gcr->tracks[half_track].data, track_size);
-        }
-        image->gcr->tracks[half_track].size = track_size;
-        ptr = image->gcr->tracks[half_track].data;
-        memset(ptr, 0, track_size);        
-#endif
-        
+    for (half_track = 0; half_track < image->max_half_tracks && half_track < MAX_GCR_TRACKS; half_track++) {
+        gcr->pending.track[half_track] = 1;
     }
     return 0;
 }
@@ -307,7 +296,7 @@ int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_
     }
 #endif
     if (image->gcr == NULL) {
-        if (util_fpread(fsimage->fd, buf, 256, offset) < 0) {
+        if (fsimage_read(fsimage, buf, 256, offset) < 0) {
             log_error(fsimage_dxx_log,
                       "Error reading T:%u S:%u from disk image.",
                       dadr->track, dadr->sector);
@@ -316,6 +305,7 @@ int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_
             rf = fsimage->error_info.map ? fsimage->error_info.map[sectors] : CBMDOS_FDC_ERR_OK;
         }
     } else {
+        gcr_prepare_track(image->gcr, (dadr->track * 2) - 2);
         rf = gcr_read_sector(&image->gcr->tracks[(dadr->track * 2) - 2], buf, (uint8_t)dadr->sector);
         /* HACK: if the image has an error map, and the "FDC" did not detect an 
            error in the GCR stream, use the error from the error map instead.
@@ -380,12 +370,13 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
         offset += X64_HEADER_LENGTH;
     }
 #endif
-    if (util_fpwrite(fsimage->fd, buf, 256, offset) < 0) {
+    if (fsimage_write(fsimage, buf, 256, offset) < 0) {
         log_error(fsimage_dxx_log, "Error writing T:%u S:%u to disk image.",
                   dadr->track, dadr->sector);
         return -1;
     }
-    if (image->gcr != NULL) {
+    /* A pending track picks the sector up from the image when encoded.  */
+    if (image->gcr != NULL && !image->gcr->pending.track[(dadr->track * 2) - 2]) {
         gcr_write_sector(&image->gcr->tracks[(dadr->track * 2) - 2], buf, (uint8_t)dadr->sector);
     }
 
@@ -399,15 +390,13 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
         }
 #endif
         fsimage->error_info.map[sectors] = CBMDOS_FDC_ERR_OK;
-        if (util_fpwrite(fsimage->fd, &fsimage->error_info.map[sectors], 1, offset) < 0) {
+        if (fsimage_write(fsimage, &fsimage->error_info.map[sectors], 1, offset) < 0) {
             log_error(fsimage_dxx_log,
                     "Error writing T:%u S:%u error info to disk image.",
                     dadr->track, dadr->sector);
         }
     }
 
-    /* Make sure the stream is visible to other readers.  */
-    fflush(fsimage->fd);
     return 0;
 }
 
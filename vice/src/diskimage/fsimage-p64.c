@@ -58,9 +58,9 @@ int fsimage_read_p64_image(const disk_image_t *image)
 
     fsimage = image->media.fsimage;
 
-    lSize = util_file_length(fsimage->fd);
+    lSize = fsimage_length(fsimage);
     buffer = lib_malloc(lSize);
-    if (util_fpread(fsimage->fd, buffer, lSize, 0) < 0) {
+    if (fsimage_read(fsimage, buffer, lSize, 0) < 0) {
         lib_free(buffer);
         log_error(fsimage_p64_log, "Could not read P64 disk image.");
         return -1;
@@ -97,11 +97,10 @@ int fsimage_write_p64_image(const disk_image_t *image)
     P64MemoryStreamCreate(&P64MemoryStreamInstance);
     P64MemoryStreamClear(&P64MemoryStreamInstance);
     if (P64ImageWriteToStream(P64Image, &P64MemoryStreamInstance)) {
-        if (util_fpwrite(fsimage->fd, P64MemoryStreamInstance.Data, P64MemoryStreamInstance.Size, 0) < 0) {
+        if (fsimage_write(fsimage, P64MemoryStreamInstance.Data, P64MemoryStreamInstance.Size, 0) < 0) {
             rc = -1;
             log_error(fsimage_p64_log, "Could not write P64 disk image.");
         } else {
-            fflush(fsimage->fd);
             rc = 0;
         }
     } else {
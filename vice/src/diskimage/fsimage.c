@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "archdep.h"
 #include "diskconstants.h"
@@ -44,9 +45,20 @@
 #include "util.h"
 #include "cbmdos.h"
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef USE_LIBRETRO_VFS
+#include "libretro-vfs.h"
+#endif
+
 
 static log_t fsimage_log = LOG_DEFAULT;
 
+/* Images currently held in memory, for fsimage_flush_all() */
+static fsimage_t *fsimage_mem_list = NULL;
+
 
 /** \brief  Set image name
  *
@@ -122,6 +134,462 @@ void fsimage_media_destroy(disk_image_t *image)
 
 /*-----------------------------------------------------------------------*/
 
+/* Read the whole image into memory.  Sector and track access then no longer
+   touches the file until fsimage_flush() writes the dirty blocks back.  */
+static void fsimage_mem_load(disk_image_t *image)
+{
+    fsimage_t *fsimage = image->media.fsimage;
+    size_t len;
+
+    /* The CMD HD emulation accesses the file directly */
+    if (image->type == DISK_IMAGE_TYPE_DHD) {
+        return;
+    }
+
+    len = util_file_length(fsimage->fd);
+    if (len == 0 || len > FSIMAGE_MEM_MAX) {
+        return;
+    }
+
+    fsimage->mem.data = lib_malloc(len);
+    if (util_fpread(fsimage->fd, fsimage->mem.data, len, 0) < 0) {
+        lib_free(fsimage->mem.data);
+        fsimage->mem.data = NULL;
+        return;
+    }
+    fsimage->mem.size = len;
+    fsimage->mem.file_size = len;
+    fsimage->mem.allocated = len;
+    fsimage->mem.dirty_len = (len + FSIMAGE_MEM_BLOCK - 1) / FSIMAGE_MEM_BLOCK;
+    fsimage->mem.dirty = lib_calloc(1, fsimage->mem.dirty_len);
+    fsimage->mem.dirty_count = 0;
+    fsimage->mem.read_only = image->read_only;
+
+    fsimage->next = fsimage_mem_list;
+    fsimage_mem_list = fsimage;
+}
+
+static void fsimage_mem_free(fsimage_t *fsimage)
+{
+    fsimage_t **p;
+
+    if (fsimage->mem.data == NULL) {
+        return;
+    }
+
+    for (p = &fsimage_mem_list; *p != NULL; p = &(*p)->next) {
+        if (*p == fsimage) {
+            *p = fsimage->next;
+            break;
+        }
+    }
+    fsimage->next = NULL;
+
+    lib_free(fsimage->mem.data);
+    lib_free(fsimage->mem.dirty);
+    memset(&fsimage->mem, 0, sizeof(fsimage->mem));
+}
+
+/** \brief  Read from the image
+ *
+ * \param[in]   fsimage file system image
+ * \param[out]  buf     data read
+ * \param[in]   num     number of bytes
+ * \param[in]   offset  offset from start of image
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_read(fsimage_t *fsimage, void *buf, size_t num, long offset)
+{
+    if (fsimage->mem.data == NULL) {
+        return util_fpread(fsimage->fd, buf, num, offset);
+    }
+
+    if (offset < 0 || (size_t)offset > fsimage->mem.size
+        || num > fsimage->mem.size - (size_t)offset) {
+        return -1;
+    }
+    memcpy(buf, fsimage->mem.data + offset, num);
+    return 0;
+}
+
+/** \brief  Write to the image, extending it when writing past the end
+ *
+ * \param[in]   fsimage file system image
+ * \param[in]   buf     data to write
+ * \param[in]   num     number of bytes
+ * \param[in]   offset  offset from start of image
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_write(fsimage_t *fsimage, const void *buf, size_t num, long offset)
+{
+    size_t end, block, dirty_len;
+
+    if (fsimage->mem.data == NULL) {
+        return util_fpwrite(fsimage->fd, buf, num, offset);
+    }
+
+    if (fsimage->mem.read_only || offset < 0) {
+        return -1;
+    }
+
+    end = (size_t)offset + num;
+    if (end > FSIMAGE_MEM_MAX) {
+        return -1;
+    }
+    if (end > fsimage->mem.allocated) {
+        fsimage->mem.allocated = end + end / 4;
+        fsimage->mem.data = lib_realloc(fsimage->mem.data, fsimage->mem.allocated);
+    }
+    if ((size_t)offset > fsimage->mem.size) {
+        memset(fsimage->mem.data + fsimage->mem.size, 0, (size_t)offset - fsimage->mem.size);
+    }
+    if (end > fsimage->mem.size) {
+        fsimage->mem.size = end;
+    }
+
+    dirty_len = (fsimage->mem.size + FSIMAGE_MEM_BLOCK - 1) / FSIMAGE_MEM_BLOCK;
+    if (dirty_len > fsimage->mem.dirty_len) {
+        fsimage->mem.dirty = lib_realloc(fsimage->mem.dirty, dirty_len);
+        memset(fsimage->mem.dirty + fsimage->mem.dirty_len, 0, dirty_len - fsimage->mem.dirty_len);
+        fsimage->mem.dirty_len = dirty_len;
+    }
+
+    memcpy(fsimage->mem.data + offset, buf, num);
+
+    for (block = (size_t)offset / FSIMAGE_MEM_BLOCK;
+         num > 0 && block <= (end - 1) / FSIMAGE_MEM_BLOCK; block++) {
+        if (!fsimage->mem.dirty[block]) {
+            fsimage->mem.dirty[block] = 1;
+            fsimage->mem.dirty_count++;
+        }
+    }
+    return 0;
+}
+
+/** \brief  Get the current length of the image
+ *
+ * \param[in]   fsimage file system image
+ *
+ * \return  length in bytes
+ */
+long fsimage_length(fsimage_t *fsimage)
+{
+    if (fsimage->mem.data == NULL) {
+        return (long)util_file_length(fsimage->fd);
+    }
+    return (long)fsimage->mem.size;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write back of RAM-resident images.
+
+   fsimage_flush() copies the dirty blocks into write jobs, which are written
+   to the file in the order they were queued; with threads available this
+   happens on a background writer thread, so the emulation does not wait for
+   the file system.  A queued job that has not been started yet is updated in
+   place when the same range is flushed again, unless a flush point was queued
+   after it.
+
+   Blocks extending the file are queued before the blocks written in place,
+   each group followed by a flush point, so that for example the track table
+   of a G64 never refers to track data not yet in the file.  A flush point only
+   hands the buffered data to the operating system, it does not wait for the
+   data to reach the disk.
+
+   The writer thread only writes to streams on files of the operating system.
+   Other streams, such as archive members mounted by the libretro VFS, are
+   written on the emulation thread, after the jobs queued before them.  */
+
+typedef struct fsimage_job_s {
+    FILE *fd;
+    long offset;
+    size_t len;
+    uint8_t *data;
+    int flush;                  /* flush the stream after writing */
+    struct fsimage_job_s *next;
+} fsimage_job_t;
+
+static struct {
+    fsimage_job_t *head;
+    fsimage_job_t *tail;
+#ifdef HAVE_THREADS
+    sthread_t *thread;
+    slock_t *lock;
+    scond_t *cond;              /* signalled when jobs are queued or done */
+    int busy;
+    int quit;
+    int failed;
+#endif
+} fsimage_writer;
+
+static void fsimage_job_run(fsimage_job_t *job)
+{
+    if (job->len > 0 && util_fpwrite(job->fd, job->data, job->len, job->offset) < 0) {
+        log_error(fsimage_log, "Error writing back disk image at offset %ld.", job->offset);
+    }
+    if (job->flush) {
+        /* Make sure the stream is visible to other readers.  */
+        fflush(job->fd);
+    }
+    lib_free(job->data);
+    lib_free(job);
+}
+
+#ifdef HAVE_THREADS
+static void fsimage_writer_thread(void *data)
+{
+    fsimage_job_t *job;
+
+    slock_lock(fsimage_writer.lock);
+    while (!fsimage_writer.quit || fsimage_writer.head != NULL) {
+        if (fsimage_writer.head == NULL) {
+            scond_wait(fsimage_writer.cond, fsimage_writer.lock);
+            continue;
+        }
+        job = fsimage_writer.head;
+        fsimage_writer.head = job->next;
+        if (fsimage_writer.head == NULL) {
+            fsimage_writer.tail = NULL;
+        }
+        fsimage_writer.busy = 1;
+        slock_unlock(fsimage_writer.lock);
+
+        fsimage_job_run(job);
+
+        slock_lock(fsimage_writer.lock);
+        fsimage_writer.busy = 0;
+        scond_broadcast(fsimage_writer.cond);
+    }
+    slock_unlock(fsimage_writer.lock);
+}
+
+static int fsimage_writer_start(void)
+{
+    if (fsimage_writer.thread != NULL) {
+        return 0;
+    }
+    if (fsimage_writer.failed) {
+        return -1;
+    }
+
+    fsimage_writer.lock = slock_new();
+    fsimage_writer.cond = scond_new();
+    fsimage_writer.quit = 0;
+    if (fsimage_writer.lock != NULL && fsimage_writer.cond != NULL) {
+        fsimage_writer.thread = sthread_create(fsimage_writer_thread, NULL);
+    }
+    if (fsimage_writer.thread == NULL) {
+        log_warning(fsimage_log, "Cannot start disk image writer thread.");
+        fsimage_writer.failed = 1;
+        if (fsimage_writer.lock != NULL) {
+            slock_free(fsimage_writer.lock);
+            fsimage_writer.lock = NULL;
+        }
+        if (fsimage_writer.cond != NULL) {
+            scond_free(fsimage_writer.cond);
+            fsimage_writer.cond = NULL;
+        }
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+static fsimage_job_t *fsimage_job_new(fsimage_t *fsimage, size_t start, size_t len, int flush)
+{
+    fsimage_job_t *job;
+
+    job = lib_malloc(sizeof(fsimage_job_t));
+    job->fd = fsimage->fd;
+    job->offset = (long)start;
+    job->len = len;
+    job->data = len ? lib_malloc(len) : NULL;
+    if (len) {
+        memcpy(job->data, fsimage->mem.data + start, len);
+    }
+    job->flush = flush;
+    job->next = NULL;
+    return job;
+}
+
+/* Queue a write of the given range, or update a queued job for the same
+   range if no flush point follows it.  Direct writes are done right away.  */
+static void fsimage_job_queue(fsimage_t *fsimage, size_t start, size_t len, int flush, int direct)
+{
+    fsimage_job_t *job, *match = NULL;
+
+    if (direct) {
+        fsimage_job_run(fsimage_job_new(fsimage, start, len, flush));
+        return;
+    }
+
+#ifdef HAVE_THREADS
+    if (fsimage_writer.thread != NULL) {
+        slock_lock(fsimage_writer.lock);
+    }
+#endif
+    for (job = fsimage_writer.head; job != NULL && len > 0 && !flush; job = job->next) {
+        if (job->flush) {
+            match = NULL;
+        } else if (job->fd == fsimage->fd && job->offset == (long)start && job->len == len) {
+            match = job;
+        }
+    }
+    if (match != NULL) {
+        memcpy(match->data, fsimage->mem.data + start, len);
+    } else {
+        job = fsimage_job_new(fsimage, start, len, flush);
+        if (fsimage_writer.tail != NULL) {
+            fsimage_writer.tail->next = job;
+        } else {
+            fsimage_writer.head = job;
+        }
+        fsimage_writer.tail = job;
+    }
+#ifdef HAVE_THREADS
+    if (fsimage_writer.thread != NULL) {
+        scond_broadcast(fsimage_writer.cond);
+        slock_unlock(fsimage_writer.lock);
+    }
+#endif
+}
+
+/* Queue the dirty runs either beyond or within the current file length.  */
+static int fsimage_flush_runs(fsimage_t *fsimage, int extend, int direct)
+{
+    size_t block, first, start, len, file_size;
+    int queued = 0;
+
+    file_size = fsimage->mem.file_size;
+
+    for (block = 0; block < fsimage->mem.dirty_len; ) {
+        if (!fsimage->mem.dirty[block]
+            || ((block * FSIMAGE_MEM_BLOCK >= file_size) != extend)) {
+            block++;
+            continue;
+        }
+        first = block;
+        while (block < fsimage->mem.dirty_len && fsimage->mem.dirty[block]
+               && ((block * FSIMAGE_MEM_BLOCK >= file_size) == extend)) {
+            fsimage->mem.dirty[block++] = 0;
+        }
+        start = first * FSIMAGE_MEM_BLOCK;
+        len = block * FSIMAGE_MEM_BLOCK - start;
+        if (start + len > fsimage->mem.size) {
+            len = fsimage->mem.size - start;
+        }
+        fsimage_job_queue(fsimage, start, len, 0, direct);
+        if (start + len > fsimage->mem.file_size) {
+            fsimage->mem.file_size = start + len;
+        }
+        queued = 1;
+    }
+    return queued;
+}
+
+/** \brief  Write the dirty blocks of a RAM-resident image back to the file
+ *
+ * Adjacent dirty blocks are written with a single call.  The writes may still
+ * be in progress on return, use fsimage_flush_barrier() to wait for them.
+ *
+ * \param[in]   fsimage file system image
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_flush(fsimage_t *fsimage)
+{
+    int direct = 1;
+
+    if (fsimage->mem.data == NULL || fsimage->mem.dirty_count == 0) {
+        return 0;
+    }
+
+#ifdef HAVE_THREADS
+    direct = fsimage_writer_start() < 0;
+#ifdef USE_LIBRETRO_VFS
+    /* Moves mounted archive members to a file first, so the writer thread
+       never touches the mounts of the VFS, which are not thread-safe.  */
+    if (!direct && !vfs_stream_write_out(fsimage->fd)) {
+        direct = 1;
+    }
+#endif
+#endif
+    if (direct) {
+        fsimage_flush_barrier();
+    }
+
+    if (fsimage_flush_runs(fsimage, 1, direct)) {
+        fsimage_job_queue(fsimage, 0, 0, 1, direct);
+    }
+    if (fsimage_flush_runs(fsimage, 0, direct)) {
+        fsimage_job_queue(fsimage, 0, 0, 1, direct);
+    }
+    fsimage->mem.dirty_count = 0;
+    return 0;
+}
+
+/** \brief  Wait until all queued writes have reached the files
+ */
+void fsimage_flush_barrier(void)
+{
+    fsimage_job_t *job;
+
+#ifdef HAVE_THREADS
+    if (fsimage_writer.thread != NULL) {
+        slock_lock(fsimage_writer.lock);
+        while (fsimage_writer.head != NULL || fsimage_writer.busy) {
+            scond_wait(fsimage_writer.cond, fsimage_writer.lock);
+        }
+        slock_unlock(fsimage_writer.lock);
+        return;
+    }
+#endif
+    while ((job = fsimage_writer.head) != NULL) {
+        fsimage_writer.head = job->next;
+        fsimage_job_run(job);
+    }
+    fsimage_writer.tail = NULL;
+}
+
+/** \brief  Queue the pending changes of all RAM-resident images
+ */
+void fsimage_flush_all(void)
+{
+    fsimage_t *fsimage;
+
+    for (fsimage = fsimage_mem_list; fsimage != NULL; fsimage = fsimage->next) {
+        fsimage_flush(fsimage);
+    }
+}
+
+/** \brief  Write all pending changes and stop the writer thread
+ */
+void fsimage_shutdown(void)
+{
+    fsimage_flush_all();
+    fsimage_flush_barrier();
+
+#ifdef HAVE_THREADS
+    if (fsimage_writer.thread != NULL) {
+        slock_lock(fsimage_writer.lock);
+        fsimage_writer.quit = 1;
+        scond_broadcast(fsimage_writer.cond);
+        slock_unlock(fsimage_writer.lock);
+
+        sthread_join(fsimage_writer.thread);
+        fsimage_writer.thread = NULL;
+        slock_free(fsimage_writer.lock);
+        fsimage_writer.lock = NULL;
+        scond_free(fsimage_writer.cond);
+        fsimage_writer.cond = NULL;
+    }
+#endif
+}
+
+/*-----------------------------------------------------------------------*/
+
 int fsimage_open(disk_image_t *image)
 {
     fsimage_t *fsimage;
@@ -147,6 +615,7 @@ int fsimage_open(disk_image_t *image)
     }
 
     if (fsimage_probe(image) == 0) {
+        fsimage_mem_load(image);
         return 0;
     }
 
@@ -174,6 +643,9 @@ int fsimage_close(disk_image_t *image)
         lib_free(fsimage->error_info.map);
         fsimage->error_info.map = NULL;
     }
+    fsimage_flush(fsimage);
+    fsimage_flush_barrier();
+    fsimage_mem_free(fsimage);
     zfile_fclose(fsimage->fd);
     fsimage->fd = NULL;
 
@@ -289,5 +761,5 @@ uint32_t fsimage_size(const disk_image_t *image)
     fsimage_t *fsimage;
 
     fsimage = image->media.fsimage;
-    return (uint32_t)util_file_length(fsimage->fd);
+    return (uint32_t)fsimage_length(fsimage);
 }
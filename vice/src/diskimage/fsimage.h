@@ -42,8 +42,24 @@ typedef struct fsimage_s {
         int dirty;
         int len;
     } error_info;
+    /* RAM-resident copy of the image, written back by fsimage_flush() */
+    struct {
+        uint8_t *data;
+        size_t size;
+        size_t file_size;       /* length of the file once queued writes are done */
+        size_t allocated;
+        uint8_t *dirty;         /* one flag per FSIMAGE_MEM_BLOCK bytes */
+        size_t dirty_len;
+        int dirty_count;
+        int read_only;
+    } mem;
+    struct fsimage_s *next;     /* list of RAM-resident images */
 } fsimage_t;
 
+/* Larger images (and CMD HD images) are accessed through the file */
+#define FSIMAGE_MEM_MAX     (16 * 1024 * 1024)
+#define FSIMAGE_MEM_BLOCK   4096
+
 
 extern void fsimage_init(void);
 
@@ -61,4 +77,12 @@ extern int fsimage_write_sector(struct disk_image_s *image, const uint8_t *buf,
                                 const struct disk_addr_s *dadr);
 extern uint32_t fsimage_size(const disk_image_t *image);
 
+extern int fsimage_read(fsimage_t *fsimage, void *buf, size_t num, long offset);
+extern int fsimage_write(fsimage_t *fsimage, const void *buf, size_t num, long offset);
+extern long fsimage_length(fsimage_t *fsimage);
+extern int fsimage_flush(fsimage_t *fsimage);
+extern void fsimage_flush_all(void);
+extern void fsimage_flush_barrier(void);
+extern void fsimage_shutdown(void);
+
 #endif
@@ -53,6 +53,12 @@ static const cmdline_option_t cmdline_options[] =
     { "-drivesoundvolume", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "DriveSoundEmulationVolume", NULL,
       "<Volume>", "Set volume for disk drive sound emulation (0-4000)" },
+    { "-driveadaptiverotation", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DriveAdaptiveRotation", (void *)1,
+      NULL, "Use the simple disk rotation model for standard GCR tracks read by the drive DOS" },
+    { "+driveadaptiverotation", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DriveAdaptiveRotation", (void *)0,
+      NULL, "Always use the full disk rotation model for GCR images" },
     CMDLINE_LIST_END
 };
 
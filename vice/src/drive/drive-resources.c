@@ -55,6 +55,9 @@ int drive_sound_emulation;
 /* volume of the drive sound */
 int drive_sound_emulation_volume;
 
+/* Is adaptive selection of the rotation model switched on?  */
+int drive_adaptive_rotation;
+
 static int set_drive_true_emulation(int val, void *param)
 {
     unsigned int dnr;
@@ -112,6 +115,13 @@ static int set_drive_sound_emulation_volume(int val, void *param)
     return 0;
 }
 
+static int set_drive_adaptive_rotation(int val, void *param)
+{
+    drive_adaptive_rotation = val ? 1 : 0;
+
+    return 0;
+}
+
 static int set_drive_extend_image_policy(int val, void *param)
 {
     switch (val) {
@@ -351,6 +361,8 @@ static const resource_int_t resources_int[] = {
       &drive_sound_emulation, set_drive_sound_emulation, NULL },
     { "DriveSoundEmulationVolume", 1000, RES_EVENT_NO, (resource_value_t)1000,
       &drive_sound_emulation_volume, set_drive_sound_emulation_volume, NULL },
+    { "DriveAdaptiveRotation", 0, RES_EVENT_STRICT, (resource_value_t)0,
+      &drive_adaptive_rotation, set_drive_adaptive_rotation, NULL },
     RESOURCE_INT_LIST_END
 };
 
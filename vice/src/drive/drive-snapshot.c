@@ -134,11 +134,18 @@ int drive_snapshot_write_module(snapshot_t *s, int save_disks, int save_roms)
 
 #ifndef __LIBRETRO__
     if (!drive_true_emulation) {
+        disk_image_flush_all();
+        disk_image_flush_barrier();
         return 0;
     }
 #endif
 
     drive_gcr_data_writeback_all();
+    disk_image_flush_all();
+    /* Without the disks in the snapshot it relies on the image files */
+    if (!save_disks) {
+        disk_image_flush_barrier();
+    }
 
     /* TODO: drive 1? Is that loop for dual drives? or else?
        below there is NUM_DRIVES proposed
@@ -1071,6 +1078,9 @@ static int drive_snapshot_write_gcrimage_module(snapshot_t *s, unsigned int dnr)
 #else
     num_half_tracks = MAX_TRACKS_1571 * 2;
 
+    /* Encode the tracks the drive did not access yet */
+    gcr_prepare_all(drive->gcr);
+
     /* Write general data */
     if (SMW_DW(m, num_half_tracks) < 0) {
         snapshot_module_close(m);
@@ -1205,6 +1215,7 @@ static int drive_snapshot_read_gcrimage_module(snapshot_t *s, unsigned int dnr)
                 drive->gcr->tracks[i].size = 0;
             }
         }
+        gcr_clear_pending(drive->gcr);
     }
     snapshot_module_close(m);
 
@@ -1256,6 +1267,7 @@ static int drive_snapshot_read_gcrimage_module(snapshot_t *s, unsigned int dnr)
     }
     snapshot_module_close(m);
 
+    gcr_clear_pending(drive->gcr);
     drive->GCR_image_loaded = 1;
     drive->complicated_image_loaded = 1; /* TODO: verify if it's really like this */
     drive->image = NULL;
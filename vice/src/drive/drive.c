@@ -77,6 +77,7 @@
 #include <stdbool.h>
 #include "vsync.h"
 #include "libretro-core.h"
+#include "libretro-perf.h"
 extern unsigned int opt_autoloadwarp;
 extern unsigned int vice_led_state[RETRO_LED_NUM];
 extern bool retro_disk_get_eject_state(void);
@@ -339,6 +340,8 @@ void drive_shutdown(void)
         lib_free(unit);
         diskunit_context[unr] = NULL;
     }
+
+    drive_image_shutdown();
 }
 
 void drive_set_active_led_color(unsigned int type, unsigned int dnr)
@@ -636,6 +639,7 @@ void drive_set_half_track(int num, int side, drive_t *dptr)
     /* FIXME: why would the offset be different for D71 and G71? */
     tmp = (dptr->image && dptr->image->type == DISK_IMAGE_TYPE_G71) ? DRIVE_HALFTRACKS_1571 : 70;
 
+    gcr_prepare_track(dptr->gcr, dptr->current_half_track - 2 + (dptr->side * tmp));
     dptr->GCR_track_start_ptr = dptr->gcr->tracks[dptr->current_half_track - 2 + (dptr->side * tmp)].data;
 
     if (dptr->GCR_current_track_size != 0) {
@@ -725,6 +729,7 @@ void drive_gcr_data_writeback(drive_t *drive)
         }
     }
 
+    drive->gcr->written[half_track - 2] = 1;
     disk_image_write_half_track(drive->image, half_track,
                                 &drive->gcr->tracks[half_track - 2]);
 
@@ -929,12 +934,18 @@ int drive_num_leds(unsigned int dnr)
 
 void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
 {
+#ifdef __LIBRETRO__
+    RETRO_PERF_ENTER(RETRO_PERF_DRIVE);
+#endif
     if (drv->type == DRIVE_TYPE_2000 || drv->type == DRIVE_TYPE_4000 ||
         drv->type == DRIVE_TYPE_CMDHD) {
         drivecpu65c02_execute(drv, clk_value);
     } else {
         drivecpu_execute(drv, clk_value);
     }
+#ifdef __LIBRETRO__
+    RETRO_PERF_LEAVE();
+#endif
 }
 
 void drive_cpu_execute_all(CLOCK clk_value)
@@ -961,12 +972,21 @@ void drive_cpu_set_overflow(diskunit_context_t *drv)
 }
 
 /* This is called at every vsync. */
+/* Number of vsyncs between write backs of RAM-resident disk images */
+#define DRIVE_IMAGE_FLUSH_INTERVAL 50
+
 void drive_vsync_hook(void)
 {
+    static unsigned int flush_counter = 0;
     unsigned int dnr;
 
     drive_update_ui_status();
 
+    if (++flush_counter >= DRIVE_IMAGE_FLUSH_INTERVAL) {
+        flush_counter = 0;
+        disk_image_flush_all();
+    }
+
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
         diskunit_context_t *unit = diskunit_context[dnr];
         drive_t *drive = unit->drives[0];
@@ -342,6 +342,9 @@ extern struct diskunit_context_s *diskunit_context[NUM_DISK_UNITS];
 
 extern int rom_loaded;
 
+/* Use the simple rotation model for GCR images while it is safe to do so */
+extern int drive_adaptive_rotation;
+
 extern int drive_init(void);
 extern int drive_enable(struct diskunit_context_s *drv);
 extern void drive_disable(struct diskunit_context_s *drv);
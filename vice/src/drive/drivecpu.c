@@ -55,6 +55,10 @@
 #include "snapshot.h"
 #include "types.h"
 
+#ifdef __LIBRETRO__
+#include "libretro-trace.h"
+#endif
+
 
 #define DRIVE_CPU
 
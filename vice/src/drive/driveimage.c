@@ -29,12 +29,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "archdep.h"
 #include "diskconstants.h"
 #include "diskimage.h"
 #include "drive.h"
 #include "driveimage.h"
 #include "drivetypes.h"
 #include "gcr.h"
+#include "lib.h"
 #include "log.h"
 #include "types.h"
 
@@ -42,6 +44,169 @@
 /* Logging goes here.  */
 static log_t driveimage_log = LOG_DEFAULT;
 
+/* Encoded half tracks of recently detached D64/D71 images, so that swapping
+   back to a disk does not need to encode the tracks seen before again.  */
+#define DRIVE_IMAGE_CACHE_MAX 4
+
+typedef struct drive_image_cache_s {
+    char *name;
+    unsigned int type;
+    size_t len;         /* Size and modification time of the image file */
+    int64_t mtime;      /* the tracks were encoded from.  */
+    disk_track_t tracks[MAX_GCR_TRACKS];
+} drive_image_cache_t;
+
+static drive_image_cache_t drive_image_cache[DRIVE_IMAGE_CACHE_MAX];
+
+static int drive_image_is_dxx(const disk_image_t *image)
+{
+    switch (image->type) {
+        case DISK_IMAGE_TYPE_D64:
+        case DISK_IMAGE_TYPE_D67:
+        case DISK_IMAGE_TYPE_D71:
+#ifdef HAVE_X64_IMAGE
+        case DISK_IMAGE_TYPE_X64:
+#endif
+            return image->device == DISK_IMAGE_DEVICE_FS;
+        default:
+            return 0;
+    }
+}
+
+static int drive_image_cache_stamp(const disk_image_t *image, size_t *len, int64_t *mtime)
+{
+    const char *name = disk_image_fsimage_name_get(image);
+    unsigned int isdir;
+
+    if (name == NULL
+        || archdep_stat(name, len, &isdir) < 0
+        || archdep_file_mtime(name, mtime) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void drive_image_cache_remove(unsigned int i)
+{
+    drive_image_cache_t *entry = &drive_image_cache[i];
+    unsigned int j;
+
+    for (j = 0; j < MAX_GCR_TRACKS; j++) {
+        lib_free(entry->tracks[j].data);
+    }
+    lib_free(entry->name);
+
+    memmove(entry, entry + 1, (DRIVE_IMAGE_CACHE_MAX - 1 - i) * sizeof(*entry));
+    memset(&drive_image_cache[DRIVE_IMAGE_CACHE_MAX - 1], 0, sizeof(*entry));
+}
+
+static int drive_image_cache_find(const disk_image_t *image)
+{
+    const char *name = disk_image_fsimage_name_get(image);
+    unsigned int i;
+
+    for (i = 0; i < DRIVE_IMAGE_CACHE_MAX && name; i++) {
+        if (drive_image_cache[i].name
+            && drive_image_cache[i].type == image->type
+            && !strcmp(drive_image_cache[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Take over the half tracks encoded from the image before it is detached.
+   Tracks the drive wrote back may not survive decoding, so they are encoded
+   from the image again next time.  */
+static void drive_image_cache_store(drive_t *drive)
+{
+    disk_image_t *image = drive->image;
+    gcr_t *gcr = drive->gcr;
+    drive_image_cache_t *entry;
+    size_t len;
+    int64_t mtime;
+    unsigned int i, encoded = 0;
+    int found;
+
+    if (image == NULL || gcr->pending.image != image || !drive_image_is_dxx(image)) {
+        return;
+    }
+
+    for (i = 0; i < MAX_GCR_TRACKS; i += 2) {
+        if (gcr->tracks[i].data && !gcr->pending.track[i] && !gcr->written[i]) {
+            encoded++;
+        }
+    }
+    if (encoded == 0) {
+        return;
+    }
+
+    if (drive_image_cache_stamp(image, &len, &mtime) < 0) {
+        return;
+    }
+
+    found = drive_image_cache_find(image);
+    if (found >= 0) {
+        drive_image_cache_remove(found);
+    }
+    if (drive_image_cache[DRIVE_IMAGE_CACHE_MAX - 1].name) {
+        drive_image_cache_remove(DRIVE_IMAGE_CACHE_MAX - 1);
+    }
+    memmove(&drive_image_cache[1], &drive_image_cache[0],
+            (DRIVE_IMAGE_CACHE_MAX - 1) * sizeof(drive_image_cache[0]));
+
+    entry = &drive_image_cache[0];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = lib_strdup(disk_image_fsimage_name_get(image));
+    entry->type = image->type;
+    entry->len = len;
+    entry->mtime = mtime;
+
+    for (i = 0; i < MAX_GCR_TRACKS; i += 2) {
+        if (gcr->tracks[i].data && !gcr->pending.track[i] && !gcr->written[i]) {
+            entry->tracks[i] = gcr->tracks[i];
+            gcr->tracks[i].data = NULL;
+            gcr->tracks[i].size = 0;
+        }
+    }
+}
+
+/* Reuse the half tracks encoded when the same, unchanged image was attached
+   before.  */
+static void drive_image_cache_restore(drive_t *drive)
+{
+    disk_image_t *image = drive->image;
+    gcr_t *gcr = drive->gcr;
+    drive_image_cache_t *entry;
+    size_t len;
+    int64_t mtime;
+    unsigned int i;
+    int found;
+
+    if (!drive_image_is_dxx(image)) {
+        return;
+    }
+
+    found = drive_image_cache_find(image);
+    if (found < 0) {
+        return;
+    }
+    entry = &drive_image_cache[found];
+
+    if (drive_image_cache_stamp(image, &len, &mtime) == 0
+        && len == entry->len && mtime == entry->mtime) {
+        for (i = 0; i < MAX_GCR_TRACKS; i++) {
+            if (entry->tracks[i].data && gcr->pending.track[i]) {
+                lib_free(gcr->tracks[i].data);
+                gcr->tracks[i] = entry->tracks[i];
+                gcr->pending.track[i] = 0;
+                entry->tracks[i].data = NULL;
+            }
+        }
+    }
+    drive_image_cache_remove(found);
+}
+
 int drive_check_image_format(unsigned int format, unsigned int dnr)
 {
     diskunit_context_t *unit = diskunit_context[dnr];
@@ -178,10 +343,13 @@ int drive_image_attach(disk_image_t *image, unsigned int unit, unsigned int drv)
     drive->image->gcr = drive->gcr;
     drive->image->p64 = (void*)drive->p64;
 
+    gcr_clear_pending(drive->gcr);
+
     if (disk_image_read_image(drive->image) < 0) {
         drive->image = NULL;
         return -1;
     }
+    drive_image_cache_restore(drive);
     if (drive->image->type == DISK_IMAGE_TYPE_P64) {
         drive->P64_image_loaded = 1;
         drive->P64_dirty = 0;
@@ -235,7 +403,9 @@ int drive_image_detach(disk_image_t *image, unsigned int unit, unsigned int drv)
         }
     } else {
         drive_gcr_data_writeback(drive);
+        drive_image_cache_store(drive);
     }
+    gcr_clear_pending(drive->gcr);
 
     for (i = 0; i < MAX_GCR_TRACKS; i++) {
         if (drive->gcr->tracks[i].data) {
@@ -258,3 +428,10 @@ void drive_image_init(void)
 {
     driveimage_log = log_open("DriveImage");
 }
+
+void drive_image_shutdown(void)
+{
+    while (drive_image_cache[0].name) {
+        drive_image_cache_remove(0);
+    }
+}
@@ -31,6 +31,7 @@ struct disk_image_s;
 struct drive_s;
 
 extern void drive_image_init(void);
+extern void drive_image_shutdown(void);
 extern void drive_image_init_track_size_d64(struct drive_s *drive);
 extern int drive_check_image_format(unsigned int format, unsigned int dnr);
 
@@ -79,6 +79,15 @@ struct rotation_s {
     uint32_t seed;
 
     uint32_t xorShift32;
+
+    int simple_model; /* the last rotation was done by the simple model */
+
+    /* adaptive model selection state */
+    const uint8_t *standard_track_ptr; /* track last checked for standard layout */
+    unsigned int standard_track_size;
+    int standard_track; /* result of the last check */
+    int custom_code_seen; /* drive code has been executed from RAM... */
+    CLOCK custom_code_clk; /* ...last time at this clock */
 };
 typedef struct rotation_s rotation_t;
 
@@ -89,6 +98,12 @@ static rotation_t rotation[NUM_DISK_UNITS];
 static const unsigned int rot_speed_bps[2][4] = { { 250000, 266667, 285714, 307692 },
                                                   { 125000, 133333, 142857, 153846 } };
 
+/* Size of a standard GCR track in bytes in the 4 disk areas.  */
+static const unsigned int rot_track_size[4] = { 6250, 6666, 7142, 7692 };
+
+/* Drive cycles without code run from RAM, before returning to the simple model (two revolutions) */
+#define ADAPTIVE_SETTLE_CYCLES 400000
+
 
 void rotation_init(int freq, unsigned int dnr)
 {
@@ -106,6 +121,9 @@ void rotation_init(int freq, unsigned int dnr)
     rotation[dnr].so_delay = 0;
     rotation[dnr].cycle_index = 0;
     rotation[dnr].ref_advance = 0;
+    rotation[dnr].simple_model = 0;
+    rotation[dnr].standard_track_ptr = NULL;
+    rotation[dnr].custom_code_seen = 0;
 }
 
 void rotation_reset(drive_t *drive)
@@ -132,6 +150,9 @@ void rotation_reset(drive_t *drive)
     rotation[dnr].so_delay = 0;
     rotation[dnr].cycle_index = 0;
     rotation[dnr].ref_advance = 0;
+    rotation[dnr].simple_model = 0;
+    rotation[dnr].standard_track_ptr = NULL;
+    rotation[dnr].custom_code_seen = 0;
 
     drive->req_ref_cycles = 0;
 }
@@ -142,10 +163,75 @@ void rotation_speed_zone_set(unsigned int zone, unsigned int dnr)
     rotation[dnr].ue7_dcba = zone & 3;
 }
 
+/* Reference clock cycles per revolution, as used by the bitcell model */
+static uint32_t rotation_ref_per_rev(drive_t *dptr)
+{
+    uint64_t tmp = 30000UL;
+
+    tmp *= 16000000 / (300 / 60);
+    tmp /= dptr->rpm;
+    return (uint32_t)((int)tmp + dptr->wobble_factor);
+}
+
+/* Accumulator count per bit of the simple model */
+static unsigned long rotation_simple_scale(drive_t *dptr)
+{
+    uint64_t tmp = 1000000UL;
+
+    tmp += ((long)dptr->wobble_factor * 1000000L) / 3200000L;
+    tmp *= 30000UL;
+    tmp /= dptr->rpm;
+    return (unsigned long)tmp;
+}
+
+/* Carry the state of the simple model over to the bitcell model. Shifter
+   contents and byte alignment are shared, the position within the current
+   bitcell is rescaled and the read circuit is set up as right after a shift. */
+static void rotation_simple_to_gcr(drive_t *dptr, rotation_t *rptr)
+{
+    rptr->accum = (uint32_t)(((uint64_t)rptr->accum * rotation_ref_per_rev(dptr))
+                             / rotation_simple_scale(dptr));
+    rptr->ue7_counter = rptr->ue7_dcba;
+    rptr->uf4_counter = 2;
+    rptr->filter_counter = 40;
+    rptr->filter_last_state = rptr->filter_state;
+    rptr->fr_randcount = 289 + 15;
+    rptr->so_delay = 0;
+    rptr->ref_advance = 0;
+    rptr->simple_model = 0;
+}
+
+/* Carry the state of the bitcell model over to the simple model. */
+static void rotation_gcr_to_simple(drive_t *dptr, rotation_t *rptr)
+{
+    unsigned int track_bits = dptr->GCR_current_track_size << 3;
+
+    rptr->accum = (uint32_t)(((uint64_t)rptr->accum * rotation_simple_scale(dptr))
+                             / rotation_ref_per_rev(dptr));
+
+    /* the simple model shifts in the bit under the head right away, so a flux
+       reversal read but not yet shifted in by the circuit has to be read again */
+    if (dptr->read_write_mode && track_bits
+        && ((rptr->filter_last_state != rptr->filter_state) || (rptr->uf4_counter < 2))) {
+        dptr->GCR_head_offset = (dptr->GCR_head_offset ? dptr->GCR_head_offset : track_bits) - 1;
+    }
+
+    /* pending BYTE READY from the SO delay */
+    if (rptr->so_delay) {
+        rptr->so_delay = 0;
+        dptr->byte_ready_edge = 1;
+        dptr->byte_ready_level = 1;
+    }
+    rptr->ref_advance = 0;
+    dptr->req_ref_cycles = 0;
+    rptr->simple_model = 1;
+}
+
 void rotation_table_get(uint32_t *rotation_table_ptr)
 {
     unsigned int dnr, j;
     drive_t *drive;
+    rotation_t state;
 
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
         rotation_table_ptr[dnr] = rotation[dnr].speed_zone;
@@ -154,28 +240,33 @@ void rotation_table_get(uint32_t *rotation_table_ptr)
       for (j = 0; j < 1; j++) {
         drive = diskunit_context[dnr]->drives[j];
 
+        /* always save the state of the bitcell model */
+        state = rotation[dnr];
+        if (state.simple_model) {
+            rotation_simple_to_gcr(drive, &state);
+        }
 
-        drive->snap_accum = (uint32_t)(rotation[dnr].accum);
-        drive->snap_rotation_last_clk = rotation[dnr].rotation_last_clk;
-        drive->snap_last_read_data = rotation[dnr].last_read_data;
-        drive->snap_last_write_data = rotation[dnr].last_write_data;
-        drive->snap_bit_counter = rotation[dnr].bit_counter;
-        drive->snap_zero_count = rotation[dnr].zero_count;
-        drive->snap_seed = rotation[dnr].seed;
-        drive->snap_speed_zone = rotation[dnr].speed_zone;
-        drive->snap_ue7_dcba = rotation[dnr].ue7_dcba;
-        drive->snap_ue7_counter = rotation[dnr].ue7_counter;
-        drive->snap_uf4_counter = rotation[dnr].uf4_counter;
-        drive->snap_fr_randcount = rotation[dnr].fr_randcount;
-        drive->snap_filter_counter = rotation[dnr].filter_counter;
-        drive->snap_filter_state = rotation[dnr].filter_state;
-        drive->snap_filter_last_state = rotation[dnr].filter_last_state;
-        drive->snap_write_flux = rotation[dnr].write_flux;
-        drive->snap_PulseHeadPosition = rotation[dnr].PulseHeadPosition;
-        drive->snap_xorShift32 = rotation[dnr].xorShift32;
-        drive->snap_so_delay = rotation[dnr].so_delay;
-        drive->snap_cycle_index = rotation[dnr].cycle_index;
-        drive->snap_ref_advance = rotation[dnr].ref_advance;
+        drive->snap_accum = (uint32_t)(state.accum);
+        drive->snap_rotation_last_clk = state.rotation_last_clk;
+        drive->snap_last_read_data = state.last_read_data;
+        drive->snap_last_write_data = state.last_write_data;
+        drive->snap_bit_counter = state.bit_counter;
+        drive->snap_zero_count = state.zero_count;
+        drive->snap_seed = state.seed;
+        drive->snap_speed_zone = state.speed_zone;
+        drive->snap_ue7_dcba = state.ue7_dcba;
+        drive->snap_ue7_counter = state.ue7_counter;
+        drive->snap_uf4_counter = state.uf4_counter;
+        drive->snap_fr_randcount = state.fr_randcount;
+        drive->snap_filter_counter = state.filter_counter;
+        drive->snap_filter_state = state.filter_state;
+        drive->snap_filter_last_state = state.filter_last_state;
+        drive->snap_write_flux = state.write_flux;
+        drive->snap_PulseHeadPosition = state.PulseHeadPosition;
+        drive->snap_xorShift32 = state.xorShift32;
+        drive->snap_so_delay = state.so_delay;
+        drive->snap_cycle_index = state.cycle_index;
+        drive->snap_ref_advance = state.ref_advance;
         drive->snap_req_ref_cycles = drive->req_ref_cycles;
       }
     }
@@ -214,6 +305,9 @@ void rotation_table_set(uint32_t *rotation_table_ptr)
         rotation[dnr].so_delay = drive->snap_so_delay;
         rotation[dnr].cycle_index = drive->snap_cycle_index;
         rotation[dnr].ref_advance = drive->snap_ref_advance;
+        rotation[dnr].simple_model = 0;
+        rotation[dnr].standard_track_ptr = NULL;
+        rotation[dnr].custom_code_seen = 0;
         drive->req_ref_cycles = drive->snap_req_ref_cycles;
       }
     }
@@ -607,6 +701,21 @@ static void rotation_1541_gcr_cycle(drive_t *dptr)
  * see 1541 circuit description in this file for details
  ******************************************************************************/
 
+/* Calculate delta to the next NRZI transition flux pulse in the sorted pulse array,
+   after the last pulse of the track this is the first pulse of the next revolution */
+static inline uint32_t rotation_p64_get_sorted_delta(PP64PulseStream P64PulseStream, uint32_t Current, uint32_t Position)
+{
+    if (Current < P64PulseStream->SortedPulsesCount) {
+        return P64PulseStream->SortedPulses[Current].Position - Position;
+    }
+
+    /* wrap around */
+    if (P64PulseStream->SortedPulsesCount) {
+        return (P64PulseSamplesPerRotation - Position) + P64PulseStream->SortedPulses[0].Position;
+    }
+    return P64PulseSamplesPerRotation - Position;
+}
+
 /* Calculate delta to the next NRZI transition flux pulse */
 static inline int rotation_p64_get_delta(drive_t *dptr)
 {
@@ -635,30 +744,14 @@ static void rotation_1541_p64(drive_t *dptr, int ref_cycles)
 
     P64PulseStream = &dptr->p64->PulseStreams[dptr->side][dptr->current_half_track];
 
-    /* Reset if out of head position bounds */
-    if ((P64PulseStream->UsedLast >= 0) &&
-        (P64PulseStream->Pulses[P64PulseStream->UsedLast].Position <= rptr->PulseHeadPosition)) {
-        P64PulseStream->CurrentIndex = -1;
-    } else {
-        if (P64PulseStream->CurrentIndex < 0) {
-            P64PulseStream->CurrentIndex = P64PulseStream->UsedFirst;
-        } else {
-            while ((P64PulseStream->CurrentIndex >= 0) &&
-                   ((P64PulseStream->CurrentIndex != P64PulseStream->UsedFirst) &&
-                    ((P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous >= 0) &&
-                     (P64PulseStream->Pulses[P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous].Position > rptr->PulseHeadPosition)))) {
-                P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous;
-            }
-        }
-        while ((P64PulseStream->CurrentIndex >= 0) &&
-               (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Position <= rptr->PulseHeadPosition)) {
-            P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Next;
-        }
-    }
+    if (dptr->read_write_mode) {
+        uint32_t Current;
 
-    DeltaPositionToNextPulse = rotation_p64_get_delta(dptr);
+        /* look up the next pulse after the head in the sorted pulse array */
+        P64PulseStreamUpdateSorted(P64PulseStream);
+        Current = P64PulseStreamFindSortedPulse(P64PulseStream, rptr->PulseHeadPosition + 1);
+        DeltaPositionToNextPulse = rotation_p64_get_sorted_delta(P64PulseStream, Current, rptr->PulseHeadPosition);
 
-    if (dptr->read_write_mode) {
         while (ref_cycles > 0) {
             /****************************************************************************************************************************************/
             {
@@ -767,24 +860,18 @@ static void rotation_1541_p64(drive_t *dptr, int ref_cycles)
 
                 DeltaPositionToNextPulse -= ToDo;
 
-                /* Track wrap handling */
+                /* Track wrap handling, the delta already spans the index hole */
                 rptr->PulseHeadPosition += ToDo;
                 if (rptr->PulseHeadPosition >= P64PulseSamplesPerRotation) {
                     rptr->PulseHeadPosition -= P64PulseSamplesPerRotation;
-
-                    P64PulseStream->CurrentIndex = P64PulseStream->UsedFirst;
-                    while ((P64PulseStream->CurrentIndex >= 0) &&
-                           (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Position < rptr->PulseHeadPosition)) {
-                        P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Next;
-                    }
-                    DeltaPositionToNextPulse = rotation_p64_get_delta(dptr);
+                    Current = 0;
                 }
 
                 /* Next NRZI transition flux pulse handling */
                 if (!DeltaPositionToNextPulse) {
-                    if ((P64PulseStream->CurrentIndex >= 0) &&
-                        (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Position == rptr->PulseHeadPosition)) {
-                        uint32_t Strength = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Strength;
+                    if ((Current < P64PulseStream->SortedPulsesCount) &&
+                        (P64PulseStream->SortedPulses[Current].Position == rptr->PulseHeadPosition)) {
+                        uint32_t Strength = P64PulseStream->SortedPulses[Current].Strength;
 
                         /* Forward pulse high hit to the decoder logic */
                         if ((Strength == 0xffffffffUL) ||                                   /* Strong pulse */
@@ -793,9 +880,9 @@ static void rotation_1541_p64(drive_t *dptr, int ref_cycles)
                             rptr->filter_counter = 0;
                         }
 
-                        P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Next;
+                        Current++;
                     }
-                    DeltaPositionToNextPulse = rotation_p64_get_delta(dptr);
+                    DeltaPositionToNextPulse = rotation_p64_get_sorted_delta(P64PulseStream, Current, rptr->PulseHeadPosition);
                 }
             }
             /****************************************************************************************************************************************/
@@ -803,11 +890,35 @@ static void rotation_1541_p64(drive_t *dptr, int ref_cycles)
             rptr->cycle_index += ToDo;
             ref_cycles -= ToDo;
         }
+        P64PulseStream->SortedCurrent = Current;
     } else {
         int head_write;
 
         head_write = 0;
 
+        /* Reset if out of head position bounds */
+        if ((P64PulseStream->UsedLast >= 0) &&
+            (P64PulseStream->Pulses[P64PulseStream->UsedLast].Position <= rptr->PulseHeadPosition)) {
+            P64PulseStream->CurrentIndex = -1;
+        } else {
+            if (P64PulseStream->CurrentIndex < 0) {
+                P64PulseStream->CurrentIndex = P64PulseStream->UsedFirst;
+            } else {
+                while ((P64PulseStream->CurrentIndex >= 0) &&
+                       ((P64PulseStream->CurrentIndex != P64PulseStream->UsedFirst) &&
+                        ((P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous >= 0) &&
+                         (P64PulseStream->Pulses[P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous].Position > rptr->PulseHeadPosition)))) {
+                    P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Previous;
+                }
+            }
+            while ((P64PulseStream->CurrentIndex >= 0) &&
+                   (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Position <= rptr->PulseHeadPosition)) {
+                P64PulseStream->CurrentIndex = P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Next;
+            }
+        }
+
+        DeltaPositionToNextPulse = rotation_p64_get_delta(dptr);
+
         while (ref_cycles > 0) {
             /****************************************************************************************************************************************/
             {
@@ -911,6 +1022,7 @@ static void rotation_1541_p64(drive_t *dptr, int ref_cycles)
                         (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Position == rptr->PulseHeadPosition)) {
                         if (P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Strength != 0xffffffffUL) {
                             P64PulseStream->Pulses[P64PulseStream->CurrentIndex].Strength = 0xffffffffUL;
+                            P64PulseStream->SortedValid = 0;
                             dptr->P64_dirty = 1;
                         }
                     } else {
@@ -1088,6 +1200,101 @@ static void rotation_1541_simple(drive_t *dptr)
     }
 }
 
+/*******************************************************************************
+ * adaptive selection between the simple and the bitcell model for GCR images
+ ******************************************************************************/
+
+/* Start of the DOS ROM in the drive address space */
+static unsigned int rotation_rom_start(diskunit_context_t *unit)
+{
+    switch (unit->type) {
+        case DRIVE_TYPE_1570:
+        case DRIVE_TYPE_1571:
+        case DRIVE_TYPE_1571CR:
+            return 0x8000;
+        default:
+            return 0xc000;
+    }
+}
+
+/* Check for a track the simple model reads the same way as the read circuit:
+   standard size for the speed zone and no runs of more than two 0 bits, which
+   would make the circuit see random flux reversals (weak bits) */
+static int rotation_track_is_standard(const uint8_t *data, unsigned int size, unsigned int zone)
+{
+    unsigned int i, prev, zeros;
+
+    if (data == NULL || size != rot_track_size[zone]) {
+        return 0;
+    }
+
+    prev = data[size - 1];
+    for (i = 0; i < size; i++) {
+        /* three 0 bits in a row ending in this byte */
+        zeros = ~((prev << 8) | data[i]);
+        if (zeros & (zeros >> 1) & (zeros >> 2) & 0xff) {
+            return 0;
+        }
+        prev = data[i];
+    }
+    return 1;
+}
+
+/* Returns non-zero if the simple model can stand in for the bitcell model:
+   the drive runs the DOS from ROM, the track is standard and it is read at
+   its standard density. Code run from RAM switches to the bitcell model
+   until the drive has been back in ROM for a while. */
+static int rotation_adaptive_simple(drive_t *dptr)
+{
+    rotation_t *rptr = &rotation[dptr->unit];
+    diskunit_context_t *unit = dptr->diskunit;
+    unsigned int track, zone;
+
+    if (!drive_adaptive_rotation) {
+        return 0;
+    }
+
+    if (MOS6510_REGS_GET_PC(&(unit->cpu->cpu_regs)) < rotation_rom_start(unit)) {
+        rptr->custom_code_seen = 1;
+        rptr->custom_code_clk = *(dptr->clk);
+        return 0;
+    }
+    if (rptr->custom_code_seen) {
+        if (*(dptr->clk) - rptr->custom_code_clk < ADAPTIVE_SETTLE_CYCLES) {
+            return 0;
+        }
+        rptr->custom_code_seen = 0;
+    }
+
+    /* track buffers are replaced when a new image is attached */
+    if (dptr->attach_clk != (CLOCK)0 || dptr->attach_detach_clk != (CLOCK)0) {
+        rptr->standard_track_ptr = NULL;
+        return 0;
+    }
+
+    track = dptr->current_half_track / 2;
+    zone = (track < 31) + (track < 25) + (track < 18);
+    if (rptr->speed_zone != (int)zone) {
+        return 0;
+    }
+
+    if (!dptr->read_write_mode) {
+        /* keep the model for the whole write, the track gets checked again after */
+        rptr->standard_track_ptr = NULL;
+        return rptr->simple_model;
+    }
+
+    if (rptr->standard_track_ptr != dptr->GCR_track_start_ptr
+        || rptr->standard_track_size != dptr->GCR_current_track_size) {
+        rptr->standard_track_ptr = dptr->GCR_track_start_ptr;
+        rptr->standard_track_size = dptr->GCR_current_track_size;
+        rptr->standard_track = dptr->GCR_image_loaded
+                               && rotation_track_is_standard(dptr->GCR_track_start_ptr,
+                                                             dptr->GCR_current_track_size, zone);
+    }
+    return rptr->standard_track;
+}
+
 /*******************************************************************************
  * Rotate the disk according to the current value of `drive_clk[]'.
  * If `mode_change' is non-zero, there has been a Read -> Write mode switch.
@@ -1105,10 +1312,19 @@ void rotation_rotate_disk(drive_t *dptr)
         /* stuff that needs complex and slow emulation */
         if (dptr->P64_image_loaded) {
             rotation_1541_p64_cycle(dptr);
+        } else if (rotation_adaptive_simple(dptr)) {
+            if (!rotation[dptr->unit].simple_model) {
+                rotation_gcr_to_simple(dptr, &rotation[dptr->unit]);
+            }
+            rotation_1541_simple(dptr);
         } else {
+            if (rotation[dptr->unit].simple_model) {
+                rotation_simple_to_gcr(dptr, &rotation[dptr->unit]);
+            }
             rotation_1541_gcr_cycle(dptr);
         }
     } else {
+        rotation[dptr->unit].simple_model = 1;
         rotation_1541_simple(dptr);
     }
 }
@@ -345,6 +345,34 @@ fdc_err_t gcr_write_sector(disk_track_t *raw, const uint8_t *data, uint8_t secto
     return CBMDOS_FDC_ERR_OK;
 }
 
+/* Encode half track (index into `tracks') from the disk image, if it is still
+   pending.  Must be called before accessing the track data.  */
+void gcr_prepare_track(gcr_t *gcr, unsigned int half_track)
+{
+    if (half_track >= MAX_GCR_TRACKS || !gcr->pending.track[half_track]) {
+        return;
+    }
+
+    gcr->pending.track[half_track] = 0;
+    DBG(("GCR: encoding half track %u", half_track + 2));
+    disk_image_read_half_track(gcr->pending.image, half_track + 2, &gcr->tracks[half_track]);
+}
+
+void gcr_prepare_all(gcr_t *gcr)
+{
+    unsigned int i;
+
+    for (i = 0; i < MAX_GCR_TRACKS; i++) {
+        gcr_prepare_track(gcr, i);
+    }
+}
+
+void gcr_clear_pending(gcr_t *gcr)
+{
+    memset(&gcr->pending, 0, sizeof(gcr->pending));
+    memset(gcr->written, 0, sizeof(gcr->written));
+}
+
 gcr_t *gcr_create_image(void)
 {
     return (gcr_t *)lib_calloc(1, sizeof(gcr_t));
@@ -53,20 +53,39 @@ typedef struct disk_track_s {
     int size;
 } disk_track_t;
 
+typedef struct gcr_header_s {
+    uint8_t sector, track, id2, id1;
+} gcr_header_t;
+
+struct disk_image_s;
+
 typedef struct gcr_s {
     /* Raw GCR image of the disk.  */
     disk_track_t tracks[MAX_GCR_TRACKS];
-} gcr_t;
 
-typedef struct gcr_header_s {
-    uint8_t sector, track, id2, id1;
-} gcr_header_t;
+    /* Half tracks of a D64/D71 image are only encoded when first accessed,
+       see gcr_prepare_track().  */
+    struct {
+        const struct disk_image_s *image;
+        unsigned int tracks;        /* Tracks with data when attached.  */
+        int double_sided;
+        gcr_header_t header[2];     /* Disk IDs of both sides.  */
+        uint8_t track[MAX_GCR_TRACKS];
+    } pending;
+
+    /* Half tracks written back from GCR since the image was attached.  */
+    uint8_t written[MAX_GCR_TRACKS];
+} gcr_t;
 
 extern void gcr_convert_sector_to_GCR(const uint8_t *buffer, uint8_t *ptr, const gcr_header_t *header,
                                       int gap, int sync, enum fdc_err_e error_code);
 extern enum fdc_err_e gcr_read_sector(const disk_track_t *raw, uint8_t *data, uint8_t sector);
 extern enum fdc_err_e gcr_write_sector(disk_track_t *raw, const uint8_t *data, uint8_t sector);
 
+extern void gcr_prepare_track(gcr_t *gcr, unsigned int half_track);
+extern void gcr_prepare_all(gcr_t *gcr);
+extern void gcr_clear_pending(gcr_t *gcr);
+
 extern gcr_t *gcr_create_image(void);
 extern void gcr_destroy_image(gcr_t *gcr);
 
@@ -88,7 +88,11 @@ int ioutil_access(const char *pathname, int mode)
         access_mode |= ARCHDEP_F_OK;
     }
 
+#ifdef __LIBRETRO__
+    return archdep_access(pathname, access_mode);
+#else
     return access(pathname, access_mode);
+#endif
 }
 
 int ioutil_chdir(const char *path)
@@ -416,6 +416,18 @@ void P64PulseStreamClear(PP64PulseStream Instance) {
     if(Instance->Pulses) {
         p64_free(Instance->Pulses);
     }
+    if(Instance->SortedPulses) {
+        p64_free(Instance->SortedPulses);
+    }
+    if(Instance->SortedIndex) {
+        p64_free(Instance->SortedIndex);
+    }
+    Instance->SortedPulses = 0;
+    Instance->SortedPulsesAllocated = 0;
+    Instance->SortedPulsesCount = 0;
+    Instance->SortedIndex = 0;
+    Instance->SortedValid = 0;
+    Instance->SortedCurrent = 0;
     Instance->Pulses = 0;
     Instance->PulsesAllocated = 0;
     Instance->PulsesCount = 0;
@@ -454,6 +466,7 @@ p64_int32_t P64PulseStreamAllocatePulse(PP64PulseStream Instance) {
 }
 
 void P64PulseStreamFreePulse(PP64PulseStream Instance, p64_int32_t Index) {
+    Instance->SortedValid = 0;
     if(Instance->CurrentIndex == Index) {
         Instance->CurrentIndex = Instance->Pulses[Index].Next;
     }
@@ -477,6 +490,7 @@ void P64PulseStreamAddPulse(PP64PulseStream Instance, p64_uint32_t Position, p64
     while(Position >= P64PulseSamplesPerRotation) {
         Position -= P64PulseSamplesPerRotation;
     }
+    Instance->SortedValid = 0;
     Current = Instance->CurrentIndex;
     if((Instance->UsedLast >= 0) && (Instance->Pulses[Instance->UsedLast].Position < Position)) {
         Current = -1;
@@ -660,6 +674,71 @@ void P64PulseStreamSeek(PP64PulseStream Instance, p64_uint32_t Position) {
     Instance->CurrentIndex = Current;
 }
 
+void P64PulseStreamUpdateSorted(PP64PulseStream Instance) {
+    p64_int32_t Current;
+    p64_uint32_t Count, Bucket;
+    if(Instance->SortedValid) {
+        return;
+    }
+    if(!Instance->SortedIndex) {
+        Instance->SortedIndex = p64_malloc((P64PulseIndexSize + 1) * sizeof(p64_uint32_t));
+    }
+    Count = 0;
+    Current = Instance->UsedFirst;
+    while(Current >= 0) {
+        if(Count >= Instance->SortedPulsesAllocated) {
+            Instance->SortedPulsesAllocated = (Instance->SortedPulsesAllocated < 16) ? 16 : (Instance->SortedPulsesAllocated + Instance->SortedPulsesAllocated);
+            if(Instance->SortedPulses) {
+                Instance->SortedPulses = p64_realloc(Instance->SortedPulses, Instance->SortedPulsesAllocated * sizeof(TP64SortedPulse));
+            } else {
+                Instance->SortedPulses = p64_malloc(Instance->SortedPulsesAllocated * sizeof(TP64SortedPulse));
+            }
+        }
+        Instance->SortedPulses[Count].Position = Instance->Pulses[Current].Position;
+        Instance->SortedPulses[Count].Strength = Instance->Pulses[Current].Strength;
+        Count++;
+        Current = Instance->Pulses[Current].Next;
+    }
+    Instance->SortedPulsesCount = Count;
+    /* first sorted pulse at or after the start of each index step */
+    Count = 0;
+    for(Bucket = 0; Bucket < P64PulseIndexSize; Bucket++) {
+        while((Count < Instance->SortedPulsesCount) && (Instance->SortedPulses[Count].Position < (Bucket * P64PulseIndexStep))) {
+            Count++;
+        }
+        Instance->SortedIndex[Bucket] = Count;
+    }
+    Instance->SortedIndex[P64PulseIndexSize] = Instance->SortedPulsesCount;
+    Instance->SortedCurrent = 0;
+    Instance->SortedValid = 1;
+}
+
+/* Returns the index of the first sorted pulse at or after Position, or the count of sorted pulses if there is none.
+   SortedCurrent is tried first, otherwise the pulses of the index step are searched binary */
+p64_uint32_t P64PulseStreamFindSortedPulse(PP64PulseStream Instance, p64_uint32_t Position) {
+    p64_uint32_t Low, High, Middle;
+    Low = Instance->SortedCurrent;
+    if((Low <= Instance->SortedPulsesCount) &&
+       ((Low == Instance->SortedPulsesCount) || (Instance->SortedPulses[Low].Position >= Position)) &&
+       ((Low == 0) || (Instance->SortedPulses[Low - 1].Position < Position))) {
+        return Low;
+    }
+    if(Position >= P64PulseSamplesPerRotation) {
+        return Instance->SortedPulsesCount;
+    }
+    Low = Instance->SortedIndex[Position / P64PulseIndexStep];
+    High = Instance->SortedIndex[(Position / P64PulseIndexStep) + 1];
+    while(Low < High) {
+        Middle = Low + ((High - Low) >> 1);
+        if(Instance->SortedPulses[Middle].Position < Position) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+    return Low;
+}
+
 void P64PulseStreamConvertFromGCR(PP64PulseStream Instance, p64_uint8_t* Bytes, p64_uint32_t Len) {
     p64_uint32_t PositionHi, PositionLo, IncrementHi, IncrementLo, BitStreamPosition;
     P64PulseStreamClear(Instance);
@@ -55,6 +55,10 @@
 /* (16 MHz * 60) / 300 = 3200000 samples per track rotation (at 5 rotations per second) */
 #define P64PulseSamplesPerRotation 3200000
 
+/* one coarse index entry per 1/256 rotation */
+#define P64PulseIndexSize 256
+#define P64PulseIndexStep (P64PulseSamplesPerRotation / P64PulseIndexSize)
+
 #define P64FirstHalfTrack 2
 
 /* including 42.5 */
@@ -99,6 +103,13 @@ typedef TP64Pulse* PP64Pulse;
 
 typedef TP64Pulse* PP64Pulses;
 
+typedef struct {
+	p64_uint32_t Position;
+	p64_uint32_t Strength;
+} TP64SortedPulse;
+
+typedef TP64SortedPulse* PP64SortedPulses;
+
 typedef struct {
 	PP64Pulses Pulses;
 	p64_uint32_t PulsesAllocated;
@@ -107,6 +118,14 @@ typedef struct {
 	p64_int32_t UsedLast;
 	p64_int32_t FreeList;
 	p64_int32_t CurrentIndex;
+	/* position sorted copy of the used pulses with a coarse position index,
+	   rebuilt on demand after the pulse list has been changed */
+	PP64SortedPulses SortedPulses;
+	p64_uint32_t SortedPulsesAllocated;
+	p64_uint32_t SortedPulsesCount;
+	p64_uint32_t* SortedIndex;
+	p64_uint32_t SortedValid;
+	p64_uint32_t SortedCurrent;
 } TP64PulseStream;
 
 typedef TP64PulseStream* PP64PulseStream;
@@ -163,6 +182,8 @@ extern p64_uint32_t P64PulseStreamGetPulseCount(PP64PulseStream Instance);
 extern p64_uint32_t P64PulseStreamGetPulse(PP64PulseStream Instance, p64_uint32_t Position);
 extern void P64PulseStreamSetPulse(PP64PulseStream Instance, p64_uint32_t Position, p64_uint32_t Strength);
 extern void P64PulseStreamSeek(PP64PulseStream Instance, p64_uint32_t Position);
+extern void P64PulseStreamUpdateSorted(PP64PulseStream Instance);
+extern p64_uint32_t P64PulseStreamFindSortedPulse(PP64PulseStream Instance, p64_uint32_t Position);
 extern void P64PulseStreamConvertFromGCR(PP64PulseStream Instance, p64_uint8_t* Bytes, p64_uint32_t Len);
 extern void P64PulseStreamConvertToGCR(PP64PulseStream Instance, p64_uint8_t* Bytes, p64_uint32_t Len);
 extern p64_uint32_t P64PulseStreamConvertToGCRWithLogic(PP64PulseStream Instance, p64_uint8_t* Bytes, p64_uint32_t Len, p64_uint32_t SpeedZone);
@@ -357,6 +357,7 @@ void machine_shutdown(void)
 
     fliplist_shutdown();
     file_system_shutdown();
+    disk_image_shutdown();
     fsdevice_shutdown();
 
     tape_shutdown();
@@ -42,6 +42,7 @@
 #endif
 
 #include "archdep.h"
+#include "autostart.h"
 #include "cmdline.h"
 #include "console.h"
 #include "debug.h"
@@ -221,10 +222,23 @@ int main_program(int argc, char **argv)
         }
     }
 
+#ifdef __LIBRETRO__
+    retro_startup_phase("resources");
+
+    /* Core options before the command line, so that it can override them,
+       and both before the machine gets initialized with them */
+    if (ui_init_options() < 0) {
+        return -1;
+    }
+#endif
+
     DBG(("main:initcmdline_check_args(argc:%d)\n", argc));
     if (initcmdline_check_args(argc, argv) < 0) {
         return -1;
     }
+#ifdef __LIBRETRO__
+    retro_startup_phase("options");
+#endif
 
     program_name = archdep_program_name();
 
@@ -303,8 +317,19 @@ int main_program(int argc, char **argv)
     if (init_main() < 0) {
         return -1;
     }
+#ifdef __LIBRETRO__
+    retro_startup_phase("machine");
+
+    retro_boot_cache();
+    retro_startup_phase("boot");
+#endif
     
     initcmdline_check_attach();
+#ifdef __LIBRETRO__
+    /* Only the startup autostart runs on the booted machine */
+    autostart_set_booted(0);
+    retro_startup_phase("attach");
+#endif
 
 #ifdef USE_VICE_THREAD
 
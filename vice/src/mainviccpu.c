@@ -45,6 +45,10 @@
 #include "traps.h"
 #include "types.h"
 
+#ifdef __LIBRETRO__
+#include "libretro-trace.h"
+#endif
+
 #ifndef EXIT_FAILURE
 #define EXIT_FAILURE 1
 #endif
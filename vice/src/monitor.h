@@ -179,6 +179,7 @@ extern void monitor_cpu_type_set(const char *cpu_type);
 
 extern void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem);
 extern void monitor_watch_push_store_addr(uint16_t addr, MEMSPACE mem);
+extern bool monitor_watched_page(MEMSPACE mem, unsigned int page, bool store);
 
 extern monitor_interface_t *monitor_interface_new(void);
 extern void monitor_interface_destroy(monitor_interface_t *monitor_interface);
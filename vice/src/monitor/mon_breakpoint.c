@@ -53,10 +53,40 @@ struct checkpoint_list_s {
 };
 typedef struct checkpoint_list_s checkpoint_list_t;
 
+/* Lookup index of a checkpoint list, so that memory accesses are not
+   checked against every checkpoint. Single addresses are found in a
+   bitmap, ranges in an interval tree: the ranges sorted by start form
+   an implicit balanced tree, in which each node keeps the highest end
+   of its subtree. Ranges that wrap around are split in two. */
+struct checkpoint_entry_s {
+    unsigned start;
+    unsigned end;
+    unsigned max_end;
+    unsigned order;     /* position in the list */
+    mon_checkpoint_t *checkpt;
+};
+typedef struct checkpoint_entry_s checkpoint_entry_t;
+
+struct checkpoint_index_s {
+    uint8_t singles_map[0x10000 / 8];   /* low 16 bits of single addresses */
+    uint8_t pages_map[0x100 / 8];       /* pages with any checkpoint */
+    checkpoint_entry_t *singles;        /* sorted by address */
+    unsigned num_singles;
+    checkpoint_entry_t *ranges;         /* sorted by start */
+    unsigned num_ranges;
+};
+typedef struct checkpoint_index_s checkpoint_index_t;
+
+/* Hits of one address kept without allocating */
+#define CHECKPOINT_HITS_MAX 16
+
 static int breakpoint_count;
 static checkpoint_list_t *breakpoints[NUM_MEMSPACES];
 static checkpoint_list_t *watchpoints_load[NUM_MEMSPACES];
 static checkpoint_list_t *watchpoints_store[NUM_MEMSPACES];
+static checkpoint_index_t *breakpoints_index[NUM_MEMSPACES];
+static checkpoint_index_t *watchpoints_load_index[NUM_MEMSPACES];
+static checkpoint_index_t *watchpoints_store_index[NUM_MEMSPACES];
 
 
 void mon_breakpoint_init(void)
@@ -198,8 +228,249 @@ mon_checkpoint_t *mon_breakpoint_find_checkpoint(int brknum)
     return NULL;
 }
 
+static int compare_checkpoint_entries(const void *p1, const void *p2)
+{
+    const checkpoint_entry_t *e1 = (const checkpoint_entry_t *)p1;
+    const checkpoint_entry_t *e2 = (const checkpoint_entry_t *)p2;
+
+    if (e1->start != e2->start) {
+        return (e1->start < e2->start) ? -1 : 1;
+    }
+    return (e1->order < e2->order) ? -1 : (e1->order > e2->order);
+}
+
+static void index_mark_pages(checkpoint_index_t *index, unsigned start, unsigned end)
+{
+    unsigned page;
+
+    if (end - start >= 0xffff) {
+        memset(index->pages_map, 0xff, sizeof(index->pages_map));
+        return;
+    }
+    for (page = start >> 8; page <= (end >> 8); page++) {
+        index->pages_map[(page & 0xff) >> 3] |= 1 << (page & 7);
+    }
+}
+
+static void index_add_range(checkpoint_index_t *index, unsigned start, unsigned end,
+                            unsigned order, mon_checkpoint_t *cp)
+{
+    checkpoint_entry_t *entry = &index->ranges[index->num_ranges++];
+
+    entry->start = start;
+    entry->end = end;
+    entry->order = order;
+    entry->checkpt = cp;
+    index_mark_pages(index, start, end);
+}
+
+/* Sets the highest end of each subtree, the node of [lo, hi) being the middle */
+static unsigned index_set_max_end(checkpoint_entry_t *ranges, unsigned lo, unsigned hi)
+{
+    unsigned mid, max_end, sub_end;
+
+    if (lo >= hi) {
+        return 0;
+    }
+
+    mid = lo + (hi - lo) / 2;
+    max_end = ranges[mid].end;
+    sub_end = index_set_max_end(ranges, lo, mid);
+    if (sub_end > max_end) {
+        max_end = sub_end;
+    }
+    sub_end = index_set_max_end(ranges, mid + 1, hi);
+    if (sub_end > max_end) {
+        max_end = sub_end;
+    }
+    ranges[mid].max_end = max_end;
+
+    return max_end;
+}
+
+static void index_checkpoint_list(checkpoint_index_t **index_ptr, checkpoint_list_t *head)
+{
+    checkpoint_index_t *index = *index_ptr;
+    checkpoint_list_t *ptr;
+    unsigned count = 0, order = 0;
+
+    if (index) {
+        lib_free(index->singles);
+        lib_free(index->ranges);
+    }
+
+    if (!head) {
+        lib_free(index);
+        *index_ptr = NULL;
+        return;
+    }
+
+    for (ptr = head; ptr; ptr = ptr->next) {
+        count++;
+    }
+
+    if (!index) {
+        index = lib_malloc(sizeof(checkpoint_index_t));
+        *index_ptr = index;
+    }
+    memset(index->singles_map, 0, sizeof(index->singles_map));
+    memset(index->pages_map, 0, sizeof(index->pages_map));
+    index->singles = lib_malloc(sizeof(checkpoint_entry_t) * count);
+    index->ranges = lib_malloc(sizeof(checkpoint_entry_t) * count * 2);
+    index->num_singles = 0;
+    index->num_ranges = 0;
+
+    for (ptr = head; ptr; ptr = ptr->next, order++) {
+        mon_checkpoint_t *cp = ptr->checkpt;
+        unsigned start = addr_location(cp->start_addr);
+        unsigned end = mon_is_valid_addr(cp->end_addr) ? addr_location(cp->end_addr) : start;
+
+        if (start == end) {
+            checkpoint_entry_t *entry = &index->singles[index->num_singles++];
+
+            entry->start = entry->end = entry->max_end = start;
+            entry->order = order;
+            entry->checkpt = cp;
+            index->singles_map[(start & 0xffff) >> 3] |= 1 << (start & 7);
+            index_mark_pages(index, start, start);
+        } else if (end < start) {
+            index_add_range(index, start, addr_mask(~0U), order, cp);
+            index_add_range(index, 0, end, order, cp);
+        } else {
+            index_add_range(index, start, end, order, cp);
+        }
+    }
+
+    qsort(index->singles, index->num_singles, sizeof(checkpoint_entry_t), compare_checkpoint_entries);
+    qsort(index->ranges, index->num_ranges, sizeof(checkpoint_entry_t), compare_checkpoint_entries);
+    index_set_max_end(index->ranges, 0, index->num_ranges);
+}
+
+/* Stabbing query, which visits the subtrees that can hold `loc' only */
+static unsigned index_find_ranges(const checkpoint_index_t *index, unsigned lo, unsigned hi,
+                                  unsigned loc, const checkpoint_entry_t **hits, unsigned count)
+{
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        const checkpoint_entry_t *entry = &index->ranges[mid];
+
+        if (entry->max_end < loc) {
+            break;
+        }
+        count = index_find_ranges(index, lo, mid, loc, hits, count);
+        if (entry->start > loc) {
+            break;
+        }
+        if (loc <= entry->end) {
+            hits[count++] = entry;
+        }
+        lo = mid + 1;
+    }
+
+    return count;
+}
+
+/* Quick test for the common case of no checkpoint at `loc' */
+static bool index_may_hit(const checkpoint_index_t *index, unsigned loc)
+{
+    const checkpoint_entry_t *root;
+
+    if (!index) {
+        return FALSE;
+    }
+    if (index->singles_map[(loc & 0xffff) >> 3] & (1 << (loc & 7))) {
+        return TRUE;
+    }
+    if (!index->num_ranges) {
+        return FALSE;
+    }
+
+    root = &index->ranges[index->num_ranges / 2];
+    return (index->ranges[0].start <= loc) && (loc <= root->max_end);
+}
+
+/* Finds the checkpoints at `loc', in the order of the list. `hits' has
+   room for all entries of the index. */
+static unsigned index_find(const checkpoint_index_t *index, unsigned loc,
+                           const checkpoint_entry_t **hits)
+{
+    unsigned count = 0, lo = 0, hi, i, j;
+
+    if (!index) {
+        return 0;
+    }
+
+    if (index->singles_map[(loc & 0xffff) >> 3] & (1 << (loc & 7))) {
+        hi = index->num_singles;
+        while (lo < hi) {
+            unsigned mid = lo + (hi - lo) / 2;
+
+            if (index->singles[mid].start < loc) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        while (lo < index->num_singles && index->singles[lo].start == loc) {
+            hits[count++] = &index->singles[lo++];
+        }
+    }
+
+    count = index_find_ranges(index, 0, index->num_ranges, loc, hits, count);
+
+    /* Merge singles and ranges back into list order */
+    for (i = 1; i < count; i++) {
+        const checkpoint_entry_t *hit = hits[i];
+
+        for (j = i; j > 0 && hits[j - 1]->order > hit->order; j--) {
+            hits[j] = hits[j - 1];
+        }
+        hits[j] = hit;
+    }
+
+    return count;
+}
+
+/* The first checkpoint at `loc' in the list */
+static mon_checkpoint_t *search_checkpoint_index(const checkpoint_index_t *index, unsigned loc)
+{
+    const checkpoint_entry_t *local_hits[CHECKPOINT_HITS_MAX];
+    const checkpoint_entry_t **hits = local_hits;
+    mon_checkpoint_t *cp = NULL;
+
+    if (!index_may_hit(index, loc)) {
+        return NULL;
+    }
+    if (index->num_singles + index->num_ranges > CHECKPOINT_HITS_MAX) {
+        hits = lib_malloc(sizeof(checkpoint_entry_t *) * (index->num_singles + index->num_ranges));
+    }
+
+    if (index_find(index, loc, hits)) {
+        cp = hits[0]->checkpt;
+    }
+
+    if (hits != local_hits) {
+        lib_free(hits);
+    }
+    return cp;
+}
+
+/* Returns true if a watchpoint of `mem' is in `page', for the memory
+   code to use the watch handlers on such pages only */
+bool monitor_watched_page(MEMSPACE mem, unsigned int page, bool store)
+{
+    const checkpoint_index_t *index = store ? watchpoints_store_index[mem]
+                                            : watchpoints_load_index[mem];
+
+    return index && (index->pages_map[(page & 0xff) >> 3] & (1 << (page & 7)));
+}
+
 static void update_checkpoint_state(MEMSPACE mem)
 {
+    index_checkpoint_list(&breakpoints_index[mem], breakpoints[mem]);
+    index_checkpoint_list(&watchpoints_load_index[mem], watchpoints_load[mem]);
+    index_checkpoint_list(&watchpoints_store_index[mem], watchpoints_store[mem]);
+
     /* calls mem_toggle_watchpoints() */
     if (watchpoints_load[mem] != NULL || 
         watchpoints_store[mem] != NULL) {
@@ -440,27 +711,6 @@ void mon_breakpoint_set_checkpoint_command(int cp_num, char *cmd)
     }
 }
 
-static checkpoint_list_t *search_checkpoint_list(checkpoint_list_t *head, unsigned loc)
-{
-    checkpoint_list_t *cur_entry;
-
-    cur_entry = head;
-
-    /* The list should be sorted in increasing order. If the current entry
-       is > than the search item, we can drop out early.
-    */
-    while (cur_entry) {
-        if (mon_is_in_range(cur_entry->checkpt->start_addr,
-                            cur_entry->checkpt->end_addr, loc)) {
-            return cur_entry;
-        }
-
-        cur_entry = cur_entry->next;
-    }
-
-    return NULL;
-}
-
 static int compare_checkpoints(mon_checkpoint_t *bp1, mon_checkpoint_t *bp2)
 {
     unsigned addr1, addr2;
@@ -493,9 +743,13 @@ static void mon_breakpoint_event(mon_checkpoint_t *checkpt) {
 
 bool mon_breakpoint_check_checkpoint(MEMSPACE mem, unsigned int addr, unsigned int lastpc, MEMORY_OP op)
 {
-    checkpoint_list_t *ptr;
+    const checkpoint_entry_t *local_hits[CHECKPOINT_HITS_MAX];
+    const checkpoint_entry_t **hits = local_hits;
+    mon_checkpoint_t *local_checkpts[CHECKPOINT_HITS_MAX];
+    mon_checkpoint_t **checkpts = local_checkpts;
+    unsigned count, size, n;
     mon_checkpoint_t *cp;
-    checkpoint_list_t *list;
+    checkpoint_index_t *index;
     monitor_cpu_type_t *monitor_cpu;
     bool must_stop = FALSE;
     MON_ADDR instpc;
@@ -503,36 +757,54 @@ bool mon_breakpoint_check_checkpoint(MEMSPACE mem, unsigned int addr, unsigned i
     char is_loadstore = 0;
     const char *op_str;
     const char *action_str;
-    int monbank = mon_interfaces[mem]->current_bank;
-
-    monitor_cpu = monitor_cpu_for_memspace[mem];
-    instpc = new_addr(mem, (monitor_cpu->mon_register_get_val)(mem, e_PC));
-    loadstorepc = new_addr(mem, lastpc);
+    int monbank;
 
     switch (op) {
         case e_load:
-            list = watchpoints_load[mem];
+            index = watchpoints_load_index[mem];
             op_str = "load";
             is_loadstore = 1;
             break;
 
         case e_store:
-            list = watchpoints_store[mem];
+            index = watchpoints_store_index[mem];
             op_str = "store";
             is_loadstore = 1;
             break;
 
         default: /* e_exec */
-            list = breakpoints[mem];
+            index = breakpoints_index[mem];
             op_str = "exec";
             break;
     }
 
-    ptr = search_checkpoint_list(list, addr);
+    if (!index_may_hit(index, addr)) {
+        return FALSE;
+    }
+
+    size = index->num_singles + index->num_ranges;
+    if (size > CHECKPOINT_HITS_MAX) {
+        hits = lib_malloc(sizeof(checkpoint_entry_t *) * size);
+        checkpts = lib_malloc(sizeof(mon_checkpoint_t *) * size);
+    }
+
+    /* The hits are copied, as commands and temporary checkpoints may
+       change the index while they are handled */
+    count = index_find(index, addr, hits);
+    for (n = 0; n < count; n++) {
+        checkpts[n] = hits[n]->checkpt;
+    }
+    if (hits != local_hits) {
+        lib_free(hits);
+    }
 
-    while (ptr && mon_is_in_range(ptr->checkpt->start_addr, ptr->checkpt->end_addr, addr)) {
-        cp = ptr->checkpt;
-        ptr = ptr->next;
+    monbank = mon_interfaces[mem]->current_bank;
+    monitor_cpu = monitor_cpu_for_memspace[mem];
+    instpc = new_addr(mem, (monitor_cpu->mon_register_get_val)(mem, e_PC));
+    loadstorepc = new_addr(mem, lastpc);
+
+    for (n = 0; n < count; n++) {
+        cp = checkpts[n];
         if (cp && cp->enabled == e_ON) {
             /* If condition test fails, skip this checkpoint */
             if (cp->condition) {
@@ -596,6 +868,10 @@ bool mon_breakpoint_check_checkpoint(MEMSPACE mem, unsigned int addr, unsigned i
         }
     }
 
+    if (checkpts != local_checkpts) {
+        lib_free(checkpts);
+    }
+
     return must_stop;
 }
 
@@ -689,28 +965,28 @@ mon_breakpoint_type_t mon_breakpoint_is(MON_ADDR address)
 {
     MEMSPACE mem = addr_memspace(address);
     uint16_t addr = addr_location(address);
-    checkpoint_list_t *ptr;
+    mon_checkpoint_t *cp;
 
-    ptr = search_checkpoint_list(breakpoints[mem], addr);
+    cp = search_checkpoint_index(breakpoints_index[mem], addr);
 
-    if (!ptr) {
+    if (!cp) {
         return BP_NONE;
     }
 
-    return (ptr->checkpt->enabled == e_ON) ? BP_ACTIVE : BP_INACTIVE;
+    return (cp->enabled == e_ON) ? BP_ACTIVE : BP_INACTIVE;
 }
 
 void mon_breakpoint_set(MON_ADDR address)
 {
     MEMSPACE mem = addr_memspace(address);
     uint16_t addr = addr_location(address);
-    checkpoint_list_t *ptr;
+    mon_checkpoint_t *cp;
 
-    ptr = search_checkpoint_list(breakpoints[mem], addr);
+    cp = search_checkpoint_index(breakpoints_index[mem], addr);
 
-    if (ptr) {
+    if (cp) {
         /* there's a breakpoint, so enable it */
-        ptr->checkpt->enabled = e_ON;
+        cp->enabled = e_ON;
     } else {
         /* there's no breakpoint, so set a new one */
         breakpoint_add_checkpoint(address, address,
@@ -722,13 +998,14 @@ void mon_breakpoint_unset(MON_ADDR address)
 {
     MEMSPACE mem = addr_memspace(address);
     uint16_t addr = addr_location(address);
-    checkpoint_list_t *ptr;
+    mon_checkpoint_t *cp;
 
-    ptr = search_checkpoint_list(breakpoints[mem], addr);
+    cp = search_checkpoint_index(breakpoints_index[mem], addr);
 
-    if (ptr) {
+    if (cp) {
         /* there's a breakpoint, so remove it */
-        remove_checkpoint_from_list( &breakpoints[mem], ptr->checkpt );
+        remove_checkpoint_from_list( &breakpoints[mem], cp );
+        update_checkpoint_state(mem);
     }
 }
 
@@ -736,13 +1013,13 @@ void mon_breakpoint_enable(MON_ADDR address)
 {
     MEMSPACE mem = addr_memspace(address);
     uint16_t addr = addr_location(address);
-    checkpoint_list_t *ptr;
+    mon_checkpoint_t *cp;
 
-    ptr = search_checkpoint_list(breakpoints[mem], addr);
+    cp = search_checkpoint_index(breakpoints_index[mem], addr);
 
-    if (ptr) {
+    if (cp) {
         /* there's a breakpoint, so enable it */
-        ptr->checkpt->enabled = e_ON;
+        cp->enabled = e_ON;
     }
 }
 
@@ -750,12 +1027,12 @@ void mon_breakpoint_disable(MON_ADDR address)
 {
     MEMSPACE mem = addr_memspace(address);
     uint16_t addr = addr_location(address);
-    checkpoint_list_t *ptr;
+    mon_checkpoint_t *cp;
 
-    ptr = search_checkpoint_list(breakpoints[mem], addr);
+    cp = search_checkpoint_index(breakpoints_index[mem], addr);
 
-    if (ptr) {
+    if (cp) {
         /* there's a breakpoint, so disable it */
-        ptr->checkpt->enabled = e_OFF;
+        cp->enabled = e_OFF;
     }
 }
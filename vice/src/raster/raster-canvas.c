@@ -107,6 +107,17 @@ inline static void refresh_canvas(raster_t *raster)
 
 void raster_canvas_handle_end_of_frame(raster_t *raster)
 {
+    if (raster->skip_draw) {
+        /* The frame just finished has not been drawn, so do not show it and
+           start drawing with the next one if the canvas is visible again.  */
+        if (raster->canvas->viewport->update_canvas) {
+            raster->skip_draw = 0;
+            raster->dont_cache = 1;
+            raster->num_cached_lines = 0;
+        }
+        return;
+    }
+
     if (video_disabled_mode) {
         return;
     }
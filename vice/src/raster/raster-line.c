@@ -45,6 +45,7 @@
 
 #ifdef __LIBRETRO__
 #include "libretro-core.h"
+#include "libretro-perf.h"
 #endif
 
 unsigned int raster_line_get_real_mode(raster_t *raster)
@@ -98,6 +99,19 @@ inline static void update_sprite_collisions(raster_t *raster)
                                          raster->zero_gfx_msk);
 }
 
+/* hidden canvases skip pixel generation and are handled like lines outside
+   the display area, unless sprites are active on this line, in which case
+   the real graphics mask is needed for sprite-background collisions */
+inline static int skip_line_drawing(raster_t *raster)
+{
+    if (!raster->skip_draw) {
+        return 0;
+    }
+
+    return raster->sprite_status == NULL
+           || raster->sprite_status->dma_msk == 0;
+}
+
 /* map the current line so that lines 0+ in the lower border on NTSC */
 /* VIC-II are put correctly to the lower frame buffer area */
 inline static int map_current_line_to_area(raster_t *raster)
@@ -656,6 +670,9 @@ inline static void handle_visible_line(raster_t *raster)
 
 void raster_line_emulate(raster_t *raster)
 {
+#ifdef __LIBRETRO__
+    RETRO_PERF_ENTER(RETRO_PERF_VIDEO);
+#endif
     raster_draw_buffer_ptr_update(raster);
 
     /* Emulate the vertical blank flip-flops.  (Well, sort of.)  */
@@ -666,11 +683,12 @@ void raster_line_emulate(raster_t *raster)
         raster->blank_enabled = 1;
     }
 
-    if ((raster->current_line >= raster->geometry->first_displayed_line
-         && raster->current_line <= raster->geometry->last_displayed_line)
-        /* handle the case when lines 0+ are displayed in the lower border */
-        || (raster->current_line <= raster->geometry->last_displayed_line - raster->geometry->screen_size.height
-            && raster->geometry->screen_size.height <= raster->geometry->last_displayed_line)
+    if (((raster->current_line >= raster->geometry->first_displayed_line
+          && raster->current_line <= raster->geometry->last_displayed_line)
+         /* handle the case when lines 0+ are displayed in the lower border */
+         || (raster->current_line <= raster->geometry->last_displayed_line - raster->geometry->screen_size.height
+             && raster->geometry->screen_size.height <= raster->geometry->last_displayed_line))
+        && !skip_line_drawing(raster)
         ) {
         /* handle lines with no border or with changes that may affect
            the border as visible lines */
@@ -741,4 +759,7 @@ void raster_line_emulate(raster_t *raster)
     }
 
     raster->blank_this_line = 0;
+#ifdef __LIBRETRO__
+    RETRO_PERF_LEAVE();
+#endif
 }
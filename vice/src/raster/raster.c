@@ -255,6 +255,8 @@ int raster_init(raster_t *raster,
 
     raster->fake_draw_buffer_line = NULL;
 
+    raster->skip_draw = 0;
+
     raster->can_disable_border = 0;
     raster->border_disable = 0;
 
@@ -518,6 +520,12 @@ void raster_enable_cache(raster_t *raster, int enable)
 void raster_set_canvas_refresh(raster_t *raster, int enable)
 {
     raster->canvas->viewport->update_canvas = enable;
+
+    /* A hidden canvas does not need any pixels.  Drawing is resumed by
+       raster_canvas_handle_end_of_frame() once refresh is enabled again.  */
+    if (!enable) {
+        raster->skip_draw = 1;
+    }
 }
 
 void raster_screenshot(raster_t *raster, screenshot_t *screenshot)
@@ -97,6 +97,12 @@ struct raster_s {
        rate setting) */
     int skip_frame;
 
+    /* If nonzero, no pixels are generated because the canvas is hidden.
+       Registers, memory fetches and sprite collisions are still emulated.
+       Cleared at the end of the first frame after canvas refresh has been
+       enabled again, so that drawing resumes with a full frame.  */
+    int skip_draw;
+
     /* Next line to be calculated.  */
     unsigned int current_line;
 
@@ -1285,7 +1285,8 @@ static char* disabled_resources[] =
     "AutostartWarp", "AttachDevice8Readonly", "EasyFlashWriteCRT", "UserportJoy", "UserportJoyType",
     "JoyDevice1", "JoyDevice2", "JoyDevice3", "JoyDevice4",
     "JoyPort1Device", "JoyPort2Device", "JoyPort3Device", "JoyPort4Device",
-    "DriveTrueEmulation", "DriveSoundEmulation", "DriveSoundEmulationVolume",
+    "DriveTrueEmulation", "DriveSoundEmulation", "DriveSoundEmulationVolume", "DriveAdaptiveRotation",
+    "DatasetteAccelerate",
     "VICIIAudioLeak", "VICAudioLeak", "TEDAudioLeak", "SidStereo", "Sid2AddressStart",
     "SidEngine", "SidModel", "SidResidSampling", "SidResidPassband", "SidResidGain", "SidResidFilterBias",
     "SidResid8580Passband", "SidResid8580Gain", "SidResid8580FilterBias", "SFXSoundExpander", "SFXSoundExpanderChip",
@@ -63,6 +63,7 @@
 #ifdef __LIBRETRO__
 #include "sid.h"
 #include "libretro-core.h"
+#include "libretro-perf.h"
 extern unsigned int opt_warp_boost;
 extern void sound_volume_counter_reset(void);
 extern int16_t *audio_buffer;
@@ -1160,7 +1161,7 @@ void sound_close(void)
 }
 
 /* run sid */
-static int sound_run_sound(void)
+static int sound_run_sid(void)
 {
 #if 0
     static int overflow_warning_count = 0;
@@ -1246,6 +1247,20 @@ static int sound_run_sound(void)
     return 0;
 }
 
+static int sound_run_sound(void)
+{
+    int ret;
+
+#ifdef __LIBRETRO__
+    RETRO_PERF_ENTER(RETRO_PERF_SOUND);
+#endif
+    ret = sound_run_sid();
+#ifdef __LIBRETRO__
+    RETRO_PERF_LEAVE();
+#endif
+    return ret;
+}
+
 /* reset sid */
 void sound_reset(void)
 {
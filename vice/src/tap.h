@@ -75,6 +75,13 @@ typedef struct tap_s {
     /* Header offset.  */
     int offset;
 
+    /* Contents of the image file, including the header.  */
+    uint8_t *data;
+
+    /* Valid and allocated bytes of the contents.  */
+    int data_len;
+    int data_allocated;
+
     /* Pointer to the current file record.  */
     struct tape_file_record_s *tap_file_record;
 
@@ -109,5 +116,7 @@ extern void tap_get_header(tap_t *tap, uint8_t *name);
 extern struct tape_file_record_s *tap_get_current_file_record(tap_t *tap);
 
 extern int tap_read(tap_t *tap, uint8_t *buf, size_t size);
+extern int tap_write_data(tap_t *tap, const uint8_t *buf, int len);
+extern int tap_read_cbm_block_at(tap_t *tap, long *position, uint8_t *buffer, int size);
 
 #endif
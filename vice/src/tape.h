@@ -103,6 +103,7 @@ extern int tape_tap_attached(void);
 
 extern void tape_traps_install(void);
 extern void tape_traps_deinstall(void);
+extern void tape_traps_update_tap(void);
 
 extern tape_file_record_t *tape_get_current_file_record(tape_image_t *tape_image);
 extern int tape_seek_start(tape_image_t *tape_image);
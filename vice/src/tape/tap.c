@@ -156,6 +156,18 @@ tap_t *tap_open(const char *name, unsigned int *read_only)
         return NULL;
     }
 
+    /* The datasette plays the tape from memory */
+    new->data_len = new->size + TAP_HDR_SIZE;
+    new->data_allocated = new->data_len;
+    new->data = lib_malloc(new->data_allocated);
+    if (util_fpread(fd, new->data, new->data_len, 0) < 0) {
+        zfile_fclose(new->fd);
+        lib_free(new->data);
+        lib_free(new);
+        return NULL;
+    }
+    fseek(fd, TAP_HDR_SIZE, SEEK_SET);
+
     new->file_name = lib_strdup(name);
     new->tap_file_record = lib_calloc(1, sizeof(tape_file_record_t));
     new->current_file_number = -1;
@@ -182,6 +194,7 @@ int tap_close(tap_t *tap)
     }
 
     lib_free(tap->current_file_data);
+    lib_free(tap->data);
     lib_free(tap->file_name);
     lib_free(tap->tap_file_record);
     lib_free(tap);
@@ -568,13 +581,14 @@ static int tap_cbm_read_block_once(tap_t *tap, int *pass, uint8_t *buffer, int *
 }
 
 
-/* NOTE: parameter "size" must equal expected block size + 1 (for parity byte) */
-static int tap_cbm_read_block(tap_t *tap, uint8_t *buffer, int size)
+/* NOTE: parameter "size" must equal expected block size + 1 (for parity byte),
+   it is set to the size of the block actually read */
+static int tap_cbm_read_block_size(tap_t *tap, uint8_t *buffer, int *size)
 {
     int i, ret, pass, error_count, error_buf[MAX_ERRORS];
 
 #if TAP_DEBUG > 0
-    log_debug("\nTAP_CBM_READ_BLOCK(size %i): ", size);
+    log_debug("\nTAP_CBM_READ_BLOCK(size %i): ", *size);
 #endif
 
     ret = -1;
@@ -582,7 +596,7 @@ static int tap_cbm_read_block(tap_t *tap, uint8_t *buffer, int size)
     for (pass = 1; pass <= 2; pass++) {
         /* try to read data.  If tap_cbm_read_block_once() finds a sync countdown
            it will reset 'pass' to the value indicated by the countdown. */
-        ret = tap_cbm_read_block_once(tap, &pass, buffer, &size, error_buf, &error_count);
+        ret = tap_cbm_read_block_once(tap, &pass, buffer, size, error_buf, &error_count);
 
 #if TAP_DEBUG > 0
         log_debug(" PASS%i:%i/%i ", pass, ret, error_count);
@@ -607,7 +621,7 @@ static int tap_cbm_read_block(tap_t *tap, uint8_t *buffer, int size)
             /* Test checksum:
                EXORing all bytes (including checksum byte) must result in 0 */
             parity = 0;
-            for (i = 0; i < size; i++) {
+            for (i = 0; i < *size; i++) {
                 parity ^= buffer[i];
             }
             if (parity != 0) {
@@ -640,6 +654,12 @@ static int tap_cbm_read_block(tap_t *tap, uint8_t *buffer, int size)
     return ret;
 }
 
+/* NOTE: parameter "size" must equal expected block size + 1 (for parity byte) */
+static int tap_cbm_read_block(tap_t *tap, uint8_t *buffer, int size)
+{
+    return tap_cbm_read_block_size(tap, buffer, &size);
+}
+
 static int tap_cbm_read_header(tap_t *tap)
 {
     int ret;
@@ -1493,6 +1513,72 @@ int tap_read(tap_t *tap, uint8_t *buf, size_t size)
     return 0;
 }
 
+/* Write recorded data at the current position of the tape, to the file and
+   to the contents kept in memory.  Returns the number of bytes written.  */
+int tap_write_data(tap_t *tap, const uint8_t *buf, int len)
+{
+    int written, pos;
+
+    written = (int)fwrite(buf, 1, (size_t)len, tap->fd);
+    if (written <= 0) {
+        return written;
+    }
+
+    pos = tap->offset + tap->current_file_seek_position;
+    if (pos + written > tap->data_allocated) {
+        tap->data_allocated = (pos + written) * 2;
+        tap->data = lib_realloc(tap->data, tap->data_allocated);
+    }
+    if (pos > tap->data_len) {
+        memset(tap->data + tap->data_len, 0, pos - tap->data_len);
+    }
+    memcpy(tap->data + pos, buf, written);
+    if (pos + written > tap->data_len) {
+        tap->data_len = pos + written;
+    }
+    return written;
+}
+
+
+/* Decode the CBM block found at or after the tape position (relative to the
+   start of the pulses) into buffer, which must hold size bytes plus the
+   checksum.  The position is moved behind the repeated copy of the block.
+   Returns the number of bytes read without the checksum, -1 at the end of
+   the tape or another negative value if the block could not be read.  */
+int tap_read_cbm_block_at(tap_t *tap, long *position, uint8_t *buffer, int size)
+{
+    int ret, len, repeat_len, pass, error_count, error_buf[MAX_ERRORS];
+    uint8_t *repeat;
+    long fpos;
+
+    fseek(tap->fd, tap->offset + *position, SEEK_SET);
+
+    if (tap_find_pilot(tap, PILOT_TYPE_CBM) < 0) {
+        return -1;
+    }
+
+    len = size + 1;
+    ret = tap_cbm_read_block_size(tap, buffer, &len);
+    if (ret >= 0) {
+        /* skip the repeated copy, unless it was the one read */
+        repeat = lib_malloc(size + 1);
+        repeat_len = size + 1;
+        fpos = ftell(tap->fd);
+        pass = 2;
+        error_count = -1;
+        if (tap_cbm_read_block_once(tap, &pass, repeat, &repeat_len, error_buf, &error_count) < 0
+            || pass != 2) {
+            fseek(tap->fd, fpos, SEEK_SET);
+        }
+        lib_free(repeat);
+        ret = len - 1;
+    }
+
+    *position = ftell(tap->fd) - tap->offset;
+
+    return ret;
+}
+
 
 void tap_get_header(tap_t *tap, uint8_t *name)
 {
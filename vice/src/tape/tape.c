@@ -58,6 +58,7 @@
 #define CAS_STAD_OFFSET 1       /* start address */
 #define CAS_ENAD_OFFSET 3       /* end address */
 #define CAS_NAME_OFFSET 5       /* filename */
+#define CAS_HEADER_LEN  192     /* size of a header block */
 
 /* CPU addresses for tape routine variables.  */
 static uint16_t buffer_pointer_addr;
@@ -76,6 +77,9 @@ static int tape_is_initialized = 0;
 /* Tape traps to be installed.  */
 static const trap_t *tape_traps;
 
+/* Flag: are the tape traps installed?  */
+static int tape_traps_installed = 0;
+
 /* Logging goes here.  */
 static log_t tape_log = LOG_ERR;
 
@@ -95,10 +99,11 @@ void tape_traps_install(void)
 {
     const trap_t *p;
 
-    if (tape_traps != NULL) {
+    if (tape_traps != NULL && !tape_traps_installed) {
         for (p = tape_traps; p->func != NULL; p++) {
             traps_add(p);
         }
+        tape_traps_installed = 1;
     }
 }
 
@@ -106,10 +111,25 @@ void tape_traps_deinstall(void)
 {
     const trap_t *p;
 
-    if (tape_traps != NULL) {
+    if (tape_traps != NULL && tape_traps_installed) {
         for (p = tape_traps; p->func != NULL; p++) {
             traps_remove(p);
         }
+        tape_traps_installed = 0;
+    }
+}
+
+/* With a TAP image attached the traps are only needed to accelerate loading */
+void tape_traps_update_tap(void)
+{
+    if (tape_image_dev1 == NULL || !tape_tap_attached()) {
+        return;
+    }
+
+    if (datasette_accelerate_enabled()) {
+        tape_traps_install();
+    } else {
+        tape_traps_deinstall();
     }
 }
 
@@ -165,6 +185,7 @@ int tape_reinit(const tape_init_t *init)
 
     tape_init_vars(init);
     tape_traps_install();
+    tape_traps_update_tap();
 
     return 0;
 }
@@ -209,7 +230,14 @@ int tape_find_header_trap(void)
 
     cassette_buffer = mem_ram + (mem_read(buffer_pointer_addr) | (mem_read((uint16_t)(buffer_pointer_addr + 1)) << 8));
 
-    if (tape_image_dev1->name == NULL
+    if (tape_tap_attached()) {
+        /* Decode the header straight from the TAP image.  If that is not
+           possible, the Kernal reads it from the tape.  */
+        if (datasette_accelerate_block(cassette_buffer, CAS_HEADER_LEN, 1) < 0) {
+            return 0;
+        }
+        err = 0;
+    } else if (tape_image_dev1->name == NULL
         || tape_image_dev1->type != TAPE_TYPE_T64) {
         err = 1;
     } else {
@@ -245,7 +273,11 @@ int tape_find_header_trap(void)
     }
 
     mem_store(st_addr, 0);      /* Clear the STATUS word.  */
-    mem_store(verify_flag_addr, 0);
+    /* The receive trap needs the VERIFY flag to leave verifying a TAP
+       image to the Kernal.  */
+    if (!tape_tap_attached()) {
+        mem_store(verify_flag_addr, 0);
+    }
 
     if (irqtmp) {
         mem_store(irqtmp, (uint8_t)(irqval & 0xff));
@@ -359,7 +391,19 @@ int tape_receive_trap(void)
                 int amount;
 
                 len = (int)(end - start);
-                amount = t64_read((t64_t *)tape_image_dev1->data, mem_ram + (int)start, len);
+                if (tape_tap_attached()) {
+                    /* Let the Kernal verify or read the block from the
+                       tape if it cannot be decoded from the image.  */
+                    if (mem_read(verify_flag_addr)) {
+                        return 0;
+                    }
+                    amount = datasette_accelerate_block(mem_ram + (int)start, len, 0);
+                    if (amount < 0) {
+                        return 0;
+                    }
+                } else {
+                    amount = t64_read((t64_t *)tape_image_dev1->data, mem_ram + (int)start, len);
+                }
                 if (amount == len) {
                     st = 0x40;  /* EOF */
                 } else {
@@ -371,6 +415,10 @@ int tape_receive_trap(void)
             }
             break;
         default:
+            if (tape_tap_attached()) {
+                /* writing goes to the datasette */
+                return 0;
+            }
             log_error(tape_log, "Kernal command %x not supported.",
                       maincpu_get_x());
             st = 0x40;
@@ -548,7 +596,7 @@ static int tape_image_attach_internal(unsigned int unit, const char *name)
             log_message(tape_log, "TAP image version: %i, system: %i.",
                         ((tap_t *)tape_image_dev1->data)->version,
                         ((tap_t *)tape_image_dev1->data)->system);
-            tape_traps_deinstall();
+            tape_traps_update_tap();
             break;
         default:
             log_error(tape_log, "Unknown tape type %u.",
@@ -55,6 +55,7 @@
 #include "vdctypes.h"
 #include "video.h"
 #include "viewport.h"
+#include "vsync.h"
 
 vdc_t vdc;
 
@@ -622,6 +623,8 @@ static void vdc_raster_draw_alarm_handler(CLOCK offset, void *data)
             /* This SEEMS to work to reset the raster to 0, based on ted.c, but maybe there is something else needed?
                 FIXME handle cleanup of remainder of visible raster lines below the reset point somewhere somehow */
             vdc.raster.current_line = 0;
+            /* The VDC has no vsync of its own, follow the frame skipping of the VIC-II */
+            raster_skip_frame(&vdc.raster, vsync_get_skip_frame());
             raster_canvas_handle_end_of_frame(&vdc.raster);
         
             vdc.frame_counter++;    /* As far as the frame counter is concerned, we are now on a new frame */
@@ -48,6 +48,10 @@
 #include "vicii.h"
 #include "viciitypes.h"
 
+#ifdef __LIBRETRO__
+#include "libretro-perf.h"
+#endif
+
 static inline void check_badline(void)
 {
     /* Check badline condition (line range and "allow bad lines" handled outside */
@@ -382,6 +386,10 @@ int vicii_cycle(void)
 
     /*VICII_DEBUG_CYCLE(("cycle: line %i, clk %i", vicii.raster_line, vicii.raster_cycle));*/
 
+#ifdef __LIBRETRO__
+    RETRO_PERF_ENTER(RETRO_PERF_VIDEO);
+#endif
+
     /* perform phi2 fetch after the cpu has executed */
     vicii_fetch_sprites(vicii.cycle_flags);
 
@@ -615,6 +623,9 @@ int vicii_cycle(void)
         vicii_trigger_light_pen_internal(0);
     }
 
+#ifdef __LIBRETRO__
+    RETRO_PERF_LEAVE();
+#endif
     return ba_low;
 }
 
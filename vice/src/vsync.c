@@ -148,6 +148,15 @@ static int initial_warp_mode_resource;
 static unsigned long warp_render_tick_interval;
 static unsigned long warp_next_render_tick;
 
+#ifdef __LIBRETRO__
+/* Warp rendering decided by the frontend for the next frame:
+   -1 = use the wall-clock limit, 0 = skip, 1 = render. */
+static int warp_render_next_frame = -1;
+#endif
+
+/* Skip decision of the last vsync, for chips without their own vsync. */
+static int skip_frame_state;
+
 /* Triggers the vice thread to update its priorty */
 static volatile int update_thread_priority = 1;
 
@@ -186,6 +195,21 @@ int vsync_get_warp_mode(void)
     return warp_enabled;
 }
 
+#ifdef __LIBRETRO__
+/* The libretro main loop runs warp frames in batches and presents only the
+   last one, so it knows in advance which frames need to be rendered. */
+void vsync_set_warp_render_next_frame(int render)
+{
+    warp_render_next_frame = render;
+}
+#endif
+
+/* Returns nonzero if the frame following the last vsync is skipped. */
+int vsync_get_skip_frame(void)
+{
+    return skip_frame_state;
+}
+
 static int set_initial_warp_mode_resource(int val, void *param)
 {
     initial_warp_mode_resource = val ? 1 : 0;
@@ -638,6 +662,12 @@ int vsync_do_vsync(struct video_canvas_s *c, int been_skipped)
      */
     
     if (warp_enabled) {
+#ifdef __LIBRETRO__
+        if (warp_render_next_frame >= 0) {
+            skip_next_frame = !warp_render_next_frame;
+            skipped_redraw_count = skip_next_frame ? skipped_redraw_count + 1 : 0;
+        } else
+#endif
         if (now < warp_next_render_tick) {
             skip_next_frame = 1;
             skipped_redraw_count++;
@@ -660,5 +690,7 @@ int vsync_do_vsync(struct video_canvas_s *c, int been_skipped)
     
     last_vsync = now;
 
+    skip_frame_state = skip_next_frame;
+
     return skip_next_frame;
 }
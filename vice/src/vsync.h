@@ -55,5 +55,10 @@ extern int vsync_disable_timer(void);
 extern void vsync_on_vsync_do(vsync_callback_func_t callback_func, void *callback_param);
 extern void vsync_set_warp_mode(int val);
 extern int vsync_get_warp_mode(void);
+extern int vsync_get_skip_frame(void);
+
+#ifdef __LIBRETRO__
+extern void vsync_set_warp_render_next_frame(int render);
+#endif
 
 #endif
@@ -59,6 +59,10 @@
 #include "zfile.h"
 #include "zipcode.h"
 
+#ifdef USE_LIBRETRO_VFS
+#include "libretro-vfs.h"
+#endif
+
 
 /* ------------------------------------------------------------------------- */
 
@@ -93,11 +97,38 @@ struct zfile_s {
     struct zfile_s *prev, *next; /* Link to the previous and next nodes.  */
     zfile_action_t action;       /* action on close */
     char *request_string;        /* ui string for action=ZFILE_REQUEST */
+    struct zfile_cache_s *cache; /* Decompressed contents, if cached.  */
 };
 typedef struct zfile_s zfile_t;
 
 static zfile_t *zfile_list = NULL;
 
+/* This defines a list of the decompressed contents of recently opened
+   files, so that swapping between compressed images does not decompress
+   them again.  Entries are matched by the complete path, size and
+   modification time of the compressed file.  */
+struct zfile_cache_s {
+    char *name;                  /* Complete path of the compressed file.  */
+    size_t file_size;            /* Size of the compressed file.  */
+    int64_t mtime;               /* Modification time of the compressed file.  */
+    uint8_t *data;               /* Decompressed contents.  */
+    size_t size;                 /* Size of the decompressed contents.  */
+    unsigned int refs;           /* Number of open streams on the contents.  */
+    struct zfile_cache_s *next;  /* Next entry, least recently used last.  */
+};
+typedef struct zfile_cache_s zfile_cache_t;
+
+/* Limits of the cache, the most recently used entry is always kept.  */
+#define ZFILE_CACHE_ENTRIES     8
+#define ZFILE_CACHE_MAX_SIZE    (32 * 1024 * 1024)
+
+/* Size of the chunks decompressed at a time.  */
+#define ZFILE_CHUNK_SIZE        (64 * 1024)
+
+#ifdef HAVE_ZLIB
+static zfile_cache_t *zfile_cache = NULL;
+#endif
+
 static log_t zlog = LOG_ERR;
 
 /* ------------------------------------------------------------------------- */
@@ -177,6 +208,7 @@ static void zfile_list_add(const char *tmp_name,
     new_zfile->type = type;
     new_zfile->action = ZFILE_KEEP;
     new_zfile->request_string = NULL;
+    new_zfile->cache = NULL;
     new_zfile->next = zfile_list;
     new_zfile->prev = NULL;
     if (zfile_list != NULL) {
@@ -185,64 +217,247 @@ static void zfile_list_add(const char *tmp_name,
     zfile_list = new_zfile;
 }
 
-void zfile_shutdown(void)
+/* ------------------------------------------------------------------------ */
+
+/* Remove a temporary file; with the libretro VFS it may only be mounted.  */
+static int zfile_remove_tmp(const char *name)
 {
-    zfile_list_destroy();
+#ifdef USE_LIBRETRO_VFS
+    return filestream_delete(name);
+#else
+    return ioutil_remove(name);
+#endif
 }
 
-/* ------------------------------------------------------------------------ */
+/* Cache of decompressed contents.  */
 
-/* Uncompression.  */
+#ifdef HAVE_ZLIB
+static void zfile_cache_free(zfile_cache_t *p)
+{
+    lib_free(p->name);
+    lib_free(p->data);
+    lib_free(p);
+}
 
-/* If `name' has a gzip-like extension, try to uncompress it into a temporary
-   file using gzip or zlib if available.  If this succeeds, return the name
-   of the temporary file; return NULL otherwise.  */
-static char *try_uncompress_with_gzip(const char *name)
+static void zfile_cache_destroy(void)
+{
+    zfile_cache_t *p;
+
+    while (zfile_cache != NULL) {
+        p = zfile_cache;
+        zfile_cache = p->next;
+        zfile_cache_free(p);
+    }
+}
+
+/* Drop the least recently used entries which are not open until the cache
+   is within its limits again.  */
+static void zfile_cache_trim(void)
+{
+    zfile_cache_t *p, **pp, **victim;
+    unsigned int count;
+    size_t total;
+
+    while (zfile_cache != NULL) {
+        count = 1;
+        total = zfile_cache->size;
+        victim = NULL;
+        for (pp = &zfile_cache->next; *pp != NULL; pp = &(*pp)->next) {
+            count++;
+            total += (*pp)->size;
+            if ((*pp)->refs == 0) {
+                victim = pp;
+            }
+        }
+        if (victim == NULL
+            || (count <= ZFILE_CACHE_ENTRIES && total <= ZFILE_CACHE_MAX_SIZE)) {
+            break;
+        }
+        p = *victim;
+        *victim = p->next;
+        ZDEBUG(("zfile_cache_trim: dropping `%s'", p->name));
+        zfile_cache_free(p);
+    }
+}
+
+/* Uncompress the gzip file `name' into memory with zlib.  */
+static int zfile_gzip_load(const char *name, uint8_t **data, size_t *size)
 {
-#ifdef HAVE_ZLIB
-    FILE *fddest;
     gzFile fdsrc;
-    char *tmp_name = NULL;
-    int len;
+    uint8_t *buf = NULL;
+    size_t len = 0, allocated = 0;
+    int res;
+
+    fdsrc = gzopen(name, MODE_READ);
+    if (fdsrc == NULL) {
+        return -1;
+    }
+    gzbuffer(fdsrc, ZFILE_CHUNK_SIZE);
+
+    do {
+        if (allocated - len < ZFILE_CHUNK_SIZE) {
+            allocated = allocated ? allocated * 2 : ZFILE_CHUNK_SIZE * 4;
+            buf = lib_realloc(buf, allocated);
+        }
+        res = gzread(fdsrc, (void *)(buf + len), ZFILE_CHUNK_SIZE);
+        if (res > 0) {
+            len += (size_t)res;
+        }
+    } while (res > 0);
+
+    gzclose(fdsrc);
+
+    if (res < 0) {
+        lib_free(buf);
+        return -1;
+    }
+
+    *data = buf;
+    *size = len;
+    return 0;
+}
+
+/* If `name' has a gzip-like extension, return the cache entry holding its
+   uncompressed contents, uncompressing it first if needed.  Return NULL if
+   it cannot be uncompressed.  */
+static zfile_cache_t *zfile_cache_gzip(const char *name)
+{
+    zfile_cache_t *p, **pp;
+    char *fullname = NULL;
+    size_t file_size;
+    unsigned int isdir;
+    int64_t mtime;
 
     if (!file_is_gzip(name)) {
         return NULL;
     }
 
-    fddest = archdep_mkstemp_fd(&tmp_name, MODE_WRITE);
-
-    if (fddest == NULL) {
+    if (ioutil_stat(name, &file_size, &isdir) < 0 || isdir) {
         return NULL;
     }
+    archdep_file_mtime(name, &mtime);
+    archdep_expand_path(&fullname, name);
 
-    fdsrc = gzopen(name, MODE_READ);
-    if (fdsrc == NULL) {
-        fclose(fddest);
-        ioutil_remove(tmp_name);
-        lib_free(tmp_name);
+    for (pp = &zfile_cache; *pp != NULL; pp = &(*pp)->next) {
+        p = *pp;
+        if (strcmp(p->name, fullname) != 0) {
+            continue;
+        }
+        if (p->file_size == file_size && p->mtime == mtime) {
+            /* move to the front of the list */
+            *pp = p->next;
+            p->next = zfile_cache;
+            zfile_cache = p;
+            ZDEBUG(("zfile_cache_gzip: `%s' is cached", fullname));
+            lib_free(fullname);
+            return p;
+        }
+        /* the file has changed, drop the old contents unless still open */
+        if (p->refs == 0) {
+            *pp = p->next;
+            zfile_cache_free(p);
+        }
+        break;
+    }
+
+    p = lib_calloc(1, sizeof(zfile_cache_t));
+    if (zfile_gzip_load(name, &p->data, &p->size) < 0) {
+        lib_free(fullname);
+        lib_free(p);
         return NULL;
     }
+    ZDEBUG(("zfile_cache_gzip: `%s' uncompressed, %lu bytes", fullname,
+            (unsigned long)p->size));
 
-    do {
-        char buf[256];
+    p->name = fullname;
+    p->file_size = file_size;
+    p->mtime = mtime;
+    p->next = zfile_cache;
+    zfile_cache = p;
+    zfile_cache_trim();
 
-        len = gzread(fdsrc, (void *)buf, 256);
-        if (len > 0) {
-            if (fwrite((void *)buf, 1, (size_t)len, fddest) < len) {
-                gzclose(fdsrc);
-                fclose(fddest);
-                ioutil_remove(tmp_name);
-                lib_free(tmp_name);
-                return NULL;
-            }
-        }
-    } while (len > 0);
+    return p;
+}
 
-    gzclose(fdsrc);
-    fclose(fddest);
+/* Open a stream on the uncompressed contents held by `cache'.  With the
+   libretro VFS the contents are mounted in place at a temporary path, which
+   is only written to disk if the stream is written to.  Otherwise streams for
+   reading use the contents in place where the C library allows that, and
+   other streams get a temporary file written in one go.  The temporary path
+   is returned in `tmp_name'.  */
+static FILE *zfile_cache_fopen(zfile_cache_t *cache, const char *mode,
+                               int write_mode, char **tmp_name)
+{
+    FILE *stream;
 
-    return tmp_name;
+    *tmp_name = NULL;
+
+#ifdef USE_LIBRETRO_VFS
+    *tmp_name = archdep_tmpnam();
+    if (!vfs_file_add_buffer(*tmp_name, cache->data, cache->size)) {
+        lib_free(*tmp_name);
+        *tmp_name = NULL;
+        return NULL;
+    }
+    stream = fopen(*tmp_name, mode);
+    if (stream == NULL) {
+        zfile_remove_tmp(*tmp_name);
+        lib_free(*tmp_name);
+        *tmp_name = NULL;
+    }
+    return stream;
 #else
+#if defined(HAVE_FMEMOPEN)
+    if (!write_mode && cache->size > 0) {
+        return fmemopen(cache->data, cache->size, mode);
+    }
+#endif
+
+    stream = archdep_mkstemp_fd(tmp_name, MODE_WRITE);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    if (fwrite(cache->data, 1, cache->size, stream) < cache->size) {
+        fclose(stream);
+        ioutil_remove(*tmp_name);
+        lib_free(*tmp_name);
+        *tmp_name = NULL;
+        return NULL;
+    }
+    fclose(stream);
+
+    stream = fopen(*tmp_name, mode);
+    if (stream == NULL) {
+        ioutil_remove(*tmp_name);
+        lib_free(*tmp_name);
+        *tmp_name = NULL;
+    }
+
+    return stream;
+#endif
+}
+#endif
+
+void zfile_shutdown(void)
+{
+    zfile_list_destroy();
+#ifdef HAVE_ZLIB
+    zfile_cache_destroy();
+#endif
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Uncompression.  */
+
+#ifndef HAVE_ZLIB
+/* If `name' has a gzip-like extension, try to uncompress it into a temporary
+   file using gzip.  If this succeeds, return the name of the temporary file;
+   return NULL otherwise.  With zlib, gzip files are uncompressed into the
+   cache instead.  */
+static char *try_uncompress_with_gzip(const char *name)
+{
     char *tmp_name = NULL;
     int exit_status;
     char *argv[4];
@@ -273,8 +488,8 @@ static char *try_uncompress_with_gzip(const char *name)
         lib_free(tmp_name);
         return NULL;
     }
-#endif
 }
+#endif
 
 /* If `name' has a bzip-like extension, try to uncompress it into a temporary
    file using bzip.  If this succeeds, return the name of the temporary file;
@@ -769,13 +984,18 @@ static const valid_archives_t valid_archives[] = {
    temporary file, return the type of algorithm used and the name of the
    temporary file in `tmp_name'.  If `write_mode' is non-zero and the
    returned `tmp_name' has zero length, then the file cannot be accessed in
-   write mode.  */
+   write mode.  Files uncompressed in memory are returned in `cache' instead
+   of a temporary file.  */
 static enum compression_type try_uncompress(const char *name,
                                             char **tmp_name,
-                                            int write_mode)
+                                            int write_mode,
+                                            zfile_cache_t **cache)
 {
     int i;
 
+    *tmp_name = NULL;
+    *cache = NULL;
+
     for (i = 0; valid_archives[i].program; i++) {
         if ((*tmp_name = try_uncompress_archive(name, write_mode,
                                                 valid_archives[i].program,
@@ -789,9 +1009,15 @@ static enum compression_type try_uncompress(const char *name,
     }
 
     /* need this order or .tar.gz is misunderstood */
+#ifdef HAVE_ZLIB
+    if ((*cache = zfile_cache_gzip(name)) != NULL) {
+        return COMPR_GZIP;
+    }
+#else
     if ((*tmp_name = try_uncompress_with_gzip(name)) != NULL) {
         return COMPR_GZIP;
     }
+#endif
 
     if ((*tmp_name = try_uncompress_with_bzip(name)) != NULL) {
         return COMPR_BZIP;
@@ -1027,6 +1253,7 @@ FILE *zfile_fopen(const char *name, const char *mode)
     char *tmp_name;
     FILE *stream;
     enum compression_type type;
+    zfile_cache_t *cache;
     int write_mode = 0;
 
     if (!zinit_done) {
@@ -1047,7 +1274,20 @@ FILE *zfile_fopen(const char *name, const char *mode)
         return NULL;
     }
 
-    type = try_uncompress(name, &tmp_name, write_mode);
+    type = try_uncompress(name, &tmp_name, write_mode, &cache);
+#ifdef HAVE_ZLIB
+    if (cache != NULL) {
+        stream = zfile_cache_fopen(cache, mode, write_mode, &tmp_name);
+        if (stream == NULL) {
+            return NULL;
+        }
+        cache->refs++;
+        zfile_list_add(tmp_name, name, type, write_mode, stream, NULL);
+        zfile_list->cache = cache;
+        lib_free(tmp_name);
+        return stream;
+    }
+#endif
     if (type == COMPR_NONE) {
         stream = fopen(name, mode);
         if (stream == NULL) {
@@ -1116,13 +1356,17 @@ static int handle_close(zfile_t *ptr)
         }
 #endif
         /* Remove temporary file.  */
-        if (ioutil_remove(ptr->tmp_name) < 0) {
+        if (zfile_remove_tmp(ptr->tmp_name) < 0) {
             log_error(zlog, "Cannot unlink `%s': %s", ptr->tmp_name, strerror(errno));
         }
     }
 
     handle_close_action(ptr);
 
+    if (ptr->cache != NULL) {
+        ptr->cache->refs--;
+    }
+
     /* Remove item from list.  */
     if (ptr->prev != NULL) {
         ptr->prev->next = ptr->next;